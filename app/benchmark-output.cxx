@@ -0,0 +1,192 @@
+/// Write the events from an input file with several output settings, and
+/// report the size of the file and the time to write it for each setting.
+/// This is used to choose the compression and basket size for a kind of
+/// file (e.g. highly compressed raw digit skims, or quickly written
+/// intermediate files).  The events are read into memory before the
+/// benchmark so that only the writing is timed.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <TSystem.h>
+
+#include <TEvent.hxx>
+#include <TRootInput.hxx>
+#include <TRootOutput.hxx>
+#include <TCaptLog.hxx>
+
+void usage(int argc, char **argv) {
+    std::cout << std::endl
+              << argv[0] << " [options] <input-file-name>"
+              << std::endl
+              << "    -c <alg>[:<level>] -- Add a compression setting"
+              << " (zlib, lzma, lz4 or zstd)"
+              << std::endl
+              << "    -b <bytes>    -- Add a basket size [default: 128000]"
+              << std::endl
+              << "    -n <cnt>      -- Number of events to write [default: 100]"
+              << std::endl
+              << "    -o <name>     -- Name of the temporary output file"
+              << std::endl
+              << "    -h            -- print this message"
+              << std::endl
+              << std::endl
+              << "   Write the events with each compression setting and"
+              << " basket size, and"
+              << std::endl
+              << "   report the output size and the write time.  The"
+              << " default compression"
+              << std::endl
+              << "   settings are zlib:1, zlib:6, lzma:6, lz4:4, zstd:5"
+              << " and zstd:9."
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> compressions;
+    std::vector<int> basketSizes;
+    int eventCount = 100;
+    std::string outputName = "benchmark-output.root";
+    for (;;) {
+        int c = getopt(argc, argv, "b:c:n:o:h");
+        switch (c) {
+        case 'b': {
+            int bytes = 0;
+            std::istringstream(optarg) >> bytes;
+            if (bytes < 1) {
+                std::cerr << "ERROR: Invalid basket size " << optarg
+                          << std::endl;
+                return 1;
+            }
+            basketSizes.push_back(bytes);
+            break;
+        }
+        case 'c':
+            compressions.push_back(optarg);
+            break;
+        case 'n':
+            std::istringstream(optarg) >> eventCount;
+            break;
+        case 'o':
+            outputName = optarg;
+            break;
+        case 'h':
+            usage(argc,argv);
+            return 0;
+        }
+        if (c<0) break;
+    }
+
+    if (argc<optind+1) {
+        std::cerr << "ERROR: Missing input file" << std::endl;
+        usage(argc,argv);
+        return 1;
+    }
+
+    if (compressions.empty()) {
+        compressions.push_back("zlib:1");
+        compressions.push_back("zlib:6");
+        compressions.push_back("lzma:6");
+        compressions.push_back("lz4:4");
+        compressions.push_back("zstd:5");
+        compressions.push_back("zstd:9");
+    }
+    if (basketSizes.empty()) basketSizes.push_back(128000);
+
+    // Read the events into memory.
+    std::vector<CP::TEvent*> events;
+    {
+        CP::TRootInput input(argv[optind],"OLD");
+        if (!input.IsOpen()) {
+            std::cerr << "ERROR: Cannot open " << argv[optind] << std::endl;
+            return 1;
+        }
+        for (CP::TEvent* event = input.FirstEvent();
+             event && (int) events.size() < eventCount;
+             event = input.NextEvent()) {
+            events.push_back(event);
+        }
+        input.Close();
+    }
+    if (events.empty()) {
+        std::cerr << "ERROR: No events in " << argv[optind] << std::endl;
+        return 1;
+    }
+
+    std::cout << "Benchmark " << events.size() << " events from "
+              << argv[optind] << std::endl;
+    std::cout << std::setw(12) << "Compression"
+              << std::setw(12) << "Basket"
+              << std::setw(14) << "Size (MB)"
+              << std::setw(14) << "kB/event"
+              << std::setw(14) << "Write (s)"
+              << std::setw(14) << "Events/s"
+              << std::endl;
+
+    int status = 0;
+    for (std::size_t c = 0; c < compressions.size(); ++c) {
+        std::string algorithm = compressions[c];
+        int level = 1;
+        std::size_t sep = algorithm.find(':');
+        if (sep != std::string::npos) {
+            std::istringstream(algorithm.substr(sep+1)) >> level;
+            algorithm = algorithm.substr(0,sep);
+        }
+        if (CP::TRootOutput::GetCompressionAlgorithm(algorithm) < 0) {
+            std::cerr << "ERROR: Unknown compression " << compressions[c]
+                      << std::endl;
+            status = 1;
+            continue;
+        }
+        for (std::size_t b = 0; b < basketSizes.size(); ++b) {
+            std::chrono::steady_clock::time_point start
+                = std::chrono::steady_clock::now();
+            {
+                CP::TRootOutput output(outputName.c_str(),"RECREATE");
+                if (!output.IsOpen()) {
+                    std::cerr << "ERROR: Cannot open " << outputName
+                              << std::endl;
+                    return 1;
+                }
+                output.SetCompression(algorithm,level);
+                output.SetBasketSize(basketSizes[b]);
+                for (std::size_t e = 0; e < events.size(); ++e) {
+                    output.WriteEvent(*events[e]);
+                }
+                output.Close();
+            }
+            std::chrono::duration<double> elapsed
+                = std::chrono::steady_clock::now() - start;
+            FileStat_t stat;
+            Long64_t size = 0;
+            if (gSystem->GetPathInfo(outputName.c_str(),stat) == 0) {
+                size = stat.fSize;
+            }
+            std::remove(outputName.c_str());
+            double seconds = elapsed.count();
+            std::ostringstream setting;
+            setting << algorithm << ":" << level;
+            std::cout << std::setw(12) << setting.str()
+                      << std::setw(12) << basketSizes[b]
+                      << std::fixed
+                      << std::setw(14) << std::setprecision(2)
+                      << size/(1024.0*1024.0)
+                      << std::setw(14) << std::setprecision(2)
+                      << size/1024.0/events.size()
+                      << std::setw(14) << std::setprecision(3) << seconds
+                      << std::setw(14) << std::setprecision(1)
+                      << ((seconds > 0) ? events.size()/seconds: 0.0)
+                      << std::endl;
+            std::cout.unsetf(std::ios_base::floatfield);
+        }
+    }
+
+    for (std::size_t e = 0; e < events.size(); ++e) delete events[e];
+    return status;
+}
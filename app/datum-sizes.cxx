@@ -0,0 +1,53 @@
+#include <cstdlib>
+
+#include <TROOT.h>
+
+#include <eventLoop.hxx>
+#include <TDatumSizeReport.hxx>
+
+/// Report the compressed and uncompressed size of each datum in an event
+/// file.  The size is reported for each datum path (e.g. ~/digits/drift) and
+/// for each datum class with the mean, maximum and total over the events,
+/// followed by a breakdown of the largest events.  This is useful to find
+/// which datums should be pruned, split, or compressed differently.
+class TDatumSizes: public CP::TEventLoopFunction {
+public:
+    TDatumSizes() {}
+
+    virtual ~TDatumSizes() {};
+
+    void Usage(void) {
+        std::cout << "    -O largest=<n>  Show the breakdown of the <n>"
+                  << " largest events (default 5)"
+                  << std::endl;
+    }
+
+    virtual bool SetOption(std::string option,std::string value="") {
+        if (option == "largest" && value != "") {
+            fReport.SetLargestEvents(std::atoi(value.c_str()));
+            return true;
+        }
+        return false;
+    }
+
+    void BeginFile(CP::TVInputFile *const input) {
+        fReport.SetCompressionRatios(input);
+    }
+
+    bool operator () (CP::TEvent& event) {
+        fReport.AddEvent(event);
+        return false;
+    }
+
+    void Finalize(CP::TRootOutput*const output) {
+        fReport.Print(std::cout);
+    }
+
+private:
+    CP::TDatumSizeReport fReport;
+};
+
+int main(int argc, char **argv) {
+    TDatumSizes userCode;
+    CP::eventLoop(argc,argv,userCode);
+}
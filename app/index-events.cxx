@@ -0,0 +1,127 @@
+/// Build or update a catalogue of the events in directories of captEvent
+/// files, and look up events in it.  Only the files that are new or have
+/// changed since the last update are read, so this can be run each time new
+/// files arrive.  The catalogue is used by the event loop "--catalogue"
+/// option.  See CP::TEventCatalogue.
+///
+/// \code
+/// index-events.exe -c run1234.catalogue /data/run1234
+/// index-events.exe -c run1234.catalogue -f 1234,567
+/// dump-event.exe --catalogue run1234.catalogue -f 1234,567
+/// \endcode
+
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include <TEventCatalogue.hxx>
+#include <TCaptLog.hxx>
+
+void usage(int argc, char **argv) {
+    std::cout << std::endl
+              << argv[0] << " [options] <directory or file> ..."
+              << std::endl
+              << "    -c <name>     -- Name of the catalogue"
+              << " [default: events.catalogue]"
+              << std::endl
+              << "    -f <run>,<event> -- Print the file and entry of an"
+              << " event"
+              << std::endl
+              << "    -h            -- print this message"
+              << std::endl
+              << std::endl
+              << "   Add the events in the ROOT files of each directory"
+              << " (or in each file) to"
+              << std::endl
+              << "   the catalogue.  Only new and changed files are read,"
+              << " and the files that"
+              << std::endl
+              << "   have been removed from a directory are removed from"
+              << " the catalogue."
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string catalogueName = "events.catalogue";
+    std::string target;
+    for (;;) {
+        int c = getopt(argc, argv, "c:f:h");
+        if (c<0) break;
+        switch (c) {
+        case 'c':
+            catalogueName = optarg;
+            break;
+        case 'f':
+            target = optarg;
+            break;
+        case 'h':
+            usage(argc,argv);
+            return 0;
+        default:
+            usage(argc,argv);
+            return 1;
+        }
+    }
+
+    if (argc<optind+1 && target.empty()) {
+        std::cerr << "ERROR: Missing directory" << std::endl;
+        usage(argc,argv);
+        return 1;
+    }
+
+    CP::TEventCatalogue catalogue;
+    try {
+        catalogue.Read(catalogueName);
+    }
+    catch (CP::EEventCatalogue&) {
+        std::cerr << "ERROR: Cannot read " << catalogueName << std::endl;
+        return 1;
+    }
+
+    if (argc >= optind+1) {
+        int read = 0;
+        std::vector<std::string> files;
+        for (int i=optind; i<argc; ++i) {
+            struct stat status;
+            if (stat(argv[i], &status) == 0 && S_ISDIR(status.st_mode)) {
+                read += catalogue.AddDirectory(argv[i]);
+            }
+            else if (!catalogue.IsCurrent(argv[i])) files.push_back(argv[i]);
+        }
+        read += catalogue.AddFiles(files);
+        try {
+            catalogue.Write(catalogueName);
+        }
+        catch (CP::EEventCatalogue&) {
+            std::cerr << "ERROR: Cannot write " << catalogueName
+                      << std::endl;
+            return 1;
+        }
+        std::cout << "Files Read: " << read << std::endl;
+        std::cout << "Catalogue: " << catalogue.GetEventCount()
+                  << " events in " << catalogue.GetFileCount()
+                  << " files" << std::endl;
+    }
+
+    if (!target.empty()) {
+        int run = -1;
+        int event = -1;
+        std::istringstream input(target);
+        if (target.find(',') != std::string::npos) {
+            char c;
+            input >> run >> c;
+        }
+        input >> event;
+        CP::TEventCatalogue::TLocation location;
+        if (!catalogue.Find(run, event, location)) {
+            std::cerr << "ERROR: Event " << target << " is not in "
+                      << catalogueName << std::endl;
+            return 1;
+        }
+        std::cout << location.file << " " << location.entry << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+/// Merge captEvent files (e.g. the outputs of several jobs) into one file.
+/// The event trees are fast cloned so the baskets are copied without being
+/// compressed again, each geometry is copied once, and the command lines
+/// and input file names of all of the inputs are kept.  See
+/// CP::TEventFileMerger.
+///
+/// \code
+/// merge-events.exe -o run1234.root run1234-*.root
+/// \endcode
+
+#include <iostream>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <TEventFileMerger.hxx>
+#include <TCaptLog.hxx>
+
+void usage(int argc, char **argv) {
+    std::cout << std::endl
+              << argv[0] << " [options] -o <output> <input-file> ..."
+              << std::endl
+              << "    -o <name>     -- Name of the merged file"
+              << std::endl
+              << "    -s            -- Sort the events by run and event"
+              << std::endl
+              << "    -h            -- print this message"
+              << std::endl
+              << std::endl
+              << "   Merge the event trees of the input files with fast"
+              << " cloning.  The inputs"
+              << std::endl
+              << "   must have the same split datums.  When sorting, the"
+              << " events are only read"
+              << std::endl
+              << "   and written again if the inputs overlap."
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string outputName;
+    bool sortEvents = false;
+    for (;;) {
+        int c = getopt(argc, argv, "o:sh");
+        if (c<0) break;
+        switch (c) {
+        case 'o':
+            outputName = optarg;
+            break;
+        case 's':
+            sortEvents = true;
+            break;
+        case 'h':
+            usage(argc,argv);
+            return 0;
+        default:
+            usage(argc,argv);
+            return 1;
+        }
+    }
+
+    if (outputName.empty()) {
+        std::cerr << "ERROR: Missing output file" << std::endl;
+        usage(argc,argv);
+        return 1;
+    }
+    if (argc<optind+1) {
+        std::cerr << "ERROR: Missing input file" << std::endl;
+        usage(argc,argv);
+        return 1;
+    }
+
+    CP::TEventFileMerger merger;
+    merger.SetSortEvents(sortEvents);
+    std::string command;
+    for (int i=0; i<argc; ++i) {
+        if (i > 0) command += " ";
+        command += argv[i];
+    }
+    merger.SetCommandLine(command);
+    for (int i=optind; i<argc; ++i) merger.AddInput(argv[i]);
+
+    Long64_t written = 0;
+    try {
+        written = merger.Merge(outputName);
+    }
+    catch (CP::EEventFileMerger& ex) {
+        std::cerr << "ERROR: Cannot merge into " << outputName << std::endl;
+        return 1;
+    }
+
+    std::cout << "Total Events Written: " << written
+              << " to " << outputName << std::endl;
+    std::cout << "Inputs Fast Cloned: " << merger.GetFastClonedInputs()
+              << " of " << merger.GetInputs().size() << std::endl;
+    if (merger.GetCopiedEvents() > 0) {
+        std::cout << "Events Copied: " << merger.GetCopiedEvents()
+                  << std::endl;
+    }
+    if (!merger.GetFailedInputs().empty()) {
+        for (std::size_t i = 0; i < merger.GetFailedInputs().size(); ++i) {
+            std::cerr << "ERROR: Not merged: "
+                      << merger.GetFailedInputs()[i] << std::endl;
+        }
+        return 1;
+    }
+    return 0;
+}
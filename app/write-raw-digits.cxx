@@ -0,0 +1,69 @@
+#include <memory>
+
+#include <TROOT.h>
+
+#include <eventLoop.hxx>
+#include <TRawDigitWriter.hxx>
+
+/// Write the pulse digits of an event file into a raw digit file that can be
+/// read with the "rawmmap" input (see CP::TRawMmapInput).  This is used to
+/// make raw digit files from existing event files for testing.  The events
+/// can then be read back with any event loop, for example
+///
+/// \code
+/// write-raw-digits.exe -O file=run1234.dat run1234.root
+/// dump-event.exe -t rawmmap run1234.dat
+/// \endcode
+class TWriteRawDigits: public CP::TEventLoopFunction {
+public:
+    TWriteRawDigits() {
+        fFileName = "raw-digits.dat";
+        fDigits = 0;
+    }
+
+    virtual ~TWriteRawDigits() {};
+
+    void Usage(void) {
+        std::cout << "    -O file=<name>  The raw digit file to write"
+                  << " [default: raw-digits.dat]"
+                  << std::endl;
+    }
+
+    virtual bool SetOption(std::string option,std::string value="") {
+        if (option == "file" && value != "") fFileName = value;
+        else return false;
+        return true;
+    }
+
+    void Initialize(void) {
+        fWriter.reset(new CP::TRawDigitWriter(fFileName.c_str()));
+        if (!fWriter->IsOpen()) {
+            CaptError("Cannot write raw digits to " << fFileName);
+        }
+    }
+
+    bool operator () (CP::TEvent& event) {
+        if (fWriter) fDigits += fWriter->WriteEvent(event);
+        // The raw digit file is the output, so nothing is saved.
+        return false;
+    }
+
+    void Finalize(CP::TRootOutput * const output) {
+        if (!fWriter) return;
+        CaptLog("Wrote " << fDigits << " digits in "
+                << fWriter->GetEventsWritten() << " events to "
+                << fFileName);
+        fWriter->Close();
+        fWriter.reset();
+    }
+
+private:
+    std::string fFileName;
+    std::unique_ptr<CP::TRawDigitWriter> fWriter;
+    long fDigits;
+};
+
+int main(int argc, char **argv) {
+    TWriteRawDigits userCode;
+    CP::eventLoop(argc,argv,userCode);
+}
@@ -0,0 +1,229 @@
+//
+// Implement a class to read a list of event files as one input.
+//
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+
+#include <glob.h>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include "TChainInput.hxx"
+#include "TRootInput.hxx"
+#include "TEvent.hxx"
+#include "TManager.hxx"
+#include "TInputManager.hxx"
+#include "TCaptLog.hxx"
+
+namespace {
+    class TChainInputBuilder : public CP::TVInputBuilder {
+    public:
+        TChainInputBuilder()
+            : CP::TVInputBuilder("chain",
+                                 "Read a comma separated list (or glob)"
+                                 " of captEvent ROOT files as one input") {}
+        CP::TVInputFile* Open(const char* file) const {
+            return new CP::TChainInput(file);
+        }
+    };
+
+    class TChainInputRegistration {
+    public:
+        TChainInputRegistration() {
+            CP::TManager::Get().Input().Register(new TChainInputBuilder());
+        }
+    };
+    TChainInputRegistration registrationObject;
+
+    /// Return the number of entries in the event tree of a file, or -1 if
+    /// the file can't be opened.
+    int CountEntries(const std::string& name) {
+        std::unique_ptr<TFile> file(TFile::Open(name.c_str(),"OLD"));
+        if (!file || !file->IsOpen()) return -1;
+        int entries = 0;
+        TTree* tree = dynamic_cast<TTree*>(file->Get("captainEventTree"));
+        if (tree) entries = tree->GetEntries();
+        else CaptWarn("No events in " << name);
+        file->Close();
+        return entries;
+    }
+}
+
+CP::TChainInput::TChainInput(const char* names)
+    : fCurrentIndex(-1), fCurrent(NULL), fSequence(-1) {
+    // Expand the list of names and patterns.  A name that doesn't match any
+    // files is kept so that the error names it.
+    std::istringstream list(names ? names: "");
+    std::string name;
+    while (std::getline(list,name,',')) {
+        if (name.empty()) continue;
+        glob_t matches;
+        if (glob(name.c_str(), GLOB_NOCHECK, NULL, &matches) != 0) {
+            fFileNames.push_back(name);
+            continue;
+        }
+        for (std::size_t i = 0; i < matches.gl_pathc; ++i) {
+            fFileNames.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+    }
+    if (fFileNames.empty()) {
+        CaptError("No files in chain \"" << (names ? names: "") << "\"");
+        throw CP::EInputFileMissing();
+    }
+
+    // Count the entries in each file so the entries can be numbered across
+    // the chain.
+    fOffsets.push_back(0);
+    for (std::size_t i = 0; i < fFileNames.size(); ++i) {
+        int entries = CountEntries(fFileNames[i]);
+        if (entries < 0) {
+            CaptError("Cannot open " << fFileNames[i] << " in chain");
+            throw CP::EInputFileMissing();
+        }
+        fOffsets.push_back(fOffsets.back() + entries);
+    }
+    CaptVerbose("Chain of " << fFileNames.size() << " files with "
+                << fOffsets.back() << " events");
+}
+
+CP::TChainInput::~TChainInput() {
+    CloseFile();
+}
+
+int CP::TChainInput::GetFileIndex(int entry) const {
+    if (entry < 0) return 0;
+    int index = std::upper_bound(fOffsets.begin(), fOffsets.end(), entry)
+        - fOffsets.begin() - 1;
+    if ((int) fFileNames.size() <= index) index = fFileNames.size() - 1;
+    return index;
+}
+
+int CP::TChainInput::GetFirstEntry(int file) const {
+    if (file < 0) return 0;
+    if ((int) fFileNames.size() < file) return fOffsets.back();
+    return fOffsets[file];
+}
+
+bool CP::TChainInput::OpenFile(int index) {
+    if (index == fCurrentIndex && fCurrent) return true;
+    CloseFile();
+    if (index < 0 || (int) fFileNames.size() <= index) return false;
+    CaptInfo("Open " << fFileNames[index] << " in chain");
+    try {
+        fCurrent = new CP::TRootInput(fFileNames[index].c_str(),"OLD");
+    }
+    catch (CP::EInputFile&) {
+        CaptError("Cannot open " << fFileNames[index] << " in chain");
+        fCurrent = NULL;
+        return false;
+    }
+    // The new input makes its file the current input file of TManager (and
+    // does again for each event read), so the geometry is found in the
+    // file that the event came from.
+    fCurrentIndex = index;
+    return true;
+}
+
+CP::TEvent* CP::TChainInput::NextEvent(int skip) {
+    if (skip>0) fSequence += skip;
+    return ReadEvent(++fSequence);
+}
+
+CP::TEvent* CP::TChainInput::PreviousEvent(int skip) {
+    if (skip>0) fSequence -= skip;
+    return ReadEvent(--fSequence);
+}
+
+CP::TEvent* CP::TChainInput::ReadEvent(int n) {
+    fSequence = n;
+    if (fSequence<0) {
+        fSequence = -1;
+        return NULL;
+    }
+    if (GetEventsInFile() <= fSequence) {
+        fSequence = GetEventsInFile();
+        return NULL;
+    }
+    int index = GetFileIndex(fSequence);
+    if (!OpenFile(index)) {
+        fSequence = GetEventsInFile();
+        return NULL;
+    }
+    CP::TEvent* event = fCurrent->ReadEvent(fSequence - fOffsets[index]);
+    if (!event) fSequence = GetEventsInFile();
+    return event;
+}
+
+int CP::TChainInput::Seek(int entry) {
+    if (entry < 0) entry = 0;
+    if (GetEventsInFile() <= entry) {
+        fSequence = GetEventsInFile();
+        return fSequence;
+    }
+    // NextEvent() reads the entry after the current sequence number.
+    fSequence = entry - 1;
+    return entry;
+}
+
+CP::TEvent* CP::TChainInput::FindEvent(const CP::TEventContext& context) {
+    int start = (fSequence < 0) ? 0 : fSequence + 1;
+    for (int index = GetFileIndex(start);
+         index < (int) fFileNames.size(); ++index) {
+        if (fOffsets[index+1] <= start) continue;
+        if (!OpenFile(index)) break;
+        fCurrent->Seek(start - fOffsets[index]);
+        CP::TEvent* event = fCurrent->FindEvent(context);
+        if (event) {
+            fSequence = fOffsets[index] + fCurrent->GetPosition();
+            return event;
+        }
+        start = fOffsets[index+1];
+    }
+    fSequence = GetEventsInFile();
+    return NULL;
+}
+
+bool CP::TChainInput::ReadContext(int entry, CP::TEventContext& context) {
+    if (entry < 0 || GetEventsInFile() <= entry) return false;
+    int index = GetFileIndex(entry);
+    if (!OpenFile(index)) return false;
+    return fCurrent->ReadContext(entry - fOffsets[index], context);
+}
+
+int CP::TChainInput::GetEventsInFile(void) {
+    return fOffsets.back();
+}
+
+bool CP::TChainInput::IsOpen(void) {
+    return !fFileNames.empty();
+}
+
+bool CP::TChainInput::EndOfFile(void) {
+    if (fSequence<0) {
+        fSequence = -1;
+        return true;
+    }
+    if (GetEventsInFile()<=fSequence) {
+        fSequence = GetEventsInFile();
+        return true;
+    }
+    return false;
+}
+
+void CP::TChainInput::CloseFile(void) {
+    if (!fCurrent) return;
+    fCurrent->Close();
+    delete fCurrent;
+    fCurrent = NULL;
+    fCurrentIndex = -1;
+}
+
+const char* CP::TChainInput::GetFilename() const {
+    if (fCurrent) return fCurrent->GetFilename();
+    return "";
+}
+
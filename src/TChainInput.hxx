@@ -0,0 +1,124 @@
+#ifndef TChainInput_hxx_seen
+#define TChainInput_hxx_seen
+
+#include <vector>
+#include <string>
+
+#include "TVInputFile.hxx"
+
+namespace CP {
+    class TEvent;
+    class TEventContext;
+    class TRootInput;
+    class TChainInput;
+}
+
+/// Read a list of captEvent ROOT files as one input.  The files are given as
+/// a comma separated list of file names and glob patterns (e.g.
+/// "run1.root,run2-*.root"), and are read in the order of the list (the
+/// files matching a pattern are sorted by name).  The entries are numbered
+/// across all of the files, so GetPosition(), Seek(), PreviousEvent() and
+/// NextEvent(skip) work across the file boundaries.  The number of entries
+/// in each file is counted when the chain is opened (without reading any
+/// events), and only one file is open at a time.  Each file is read with a
+/// CP::TRootInput, which makes it the current input file of CP::TManager so
+/// that the geometry is found in the file the event came from.  This is
+/// registered with TInputManager as the "chain" input, so it can be used
+/// with an event loop as
+///
+/// \code
+/// dump-event.exe -t chain "run1.root,run2-*.root"
+/// \endcode
+class CP::TChainInput : public TVInputFile {
+public:
+    /// Open a chain of files.  This throws CP::EInputFileMissing if one of
+    /// the files can't be opened, or if there aren't any files.
+    explicit TChainInput(const char* names);
+
+    virtual ~TChainInput();
+
+    /// Return the first event in the chain.
+    virtual TEvent* FirstEvent(void) {return ReadEvent(0);}
+
+    /// Read the next event in the chain.
+    virtual TEvent* NextEvent(int skip = 0);
+
+    /// Read the previous event in the chain.
+    virtual TEvent* PreviousEvent(int skip = 0);
+
+    /// Read the n'th event (starting from 0) counted across all of the files
+    /// in the chain.
+    TEvent* ReadEvent(int n);
+
+    /// Position the chain so that the next call to NextEvent() reads the
+    /// entry (counted across all of the files).
+    virtual int Seek(int entry);
+
+    /// Read the first event after the current position that is at or after
+    /// the run and event in the context.  The index of each file is used
+    /// (see CP::TRootInput::FindEvent()), and the search continues in the
+    /// following files.
+    virtual TEvent* FindEvent(const CP::TEventContext& context);
+
+    /// Fill the context of the event at the entry without reading the event
+    /// (see CP::TRootInput::ReadContext()).  This opens the file with the
+    /// entry.
+    virtual bool ReadContext(int entry, CP::TEventContext& context);
+
+    /// Return the entry of the last event read, counted across all of the
+    /// files.
+    virtual int GetPosition(void) const {
+        if (fSequence<0) return -1;
+        return fSequence;
+    }
+
+    /// Return the total number of events in the chain.
+    virtual int GetEventsInFile(void);
+
+    /// Flag that the chain is ready to be read.
+    virtual bool IsOpen(void);
+
+    /// Flag that we are past the beginning or the end of the chain.
+    virtual bool EndOfFile(void);
+
+    /// Close the current file of the chain.
+    virtual void CloseFile(void);
+
+    /// Return the name of the current file of the chain.
+    virtual const char* GetFilename() const;
+
+    /// Return the names of the files in the chain.
+    const std::vector<std::string>& GetFileNames(void) const {
+        return fFileNames;
+    }
+
+    /// Return the index of the file that has the entry.
+    int GetFileIndex(int entry) const;
+
+    /// Return the first entry of a file (counted across all of the files).
+    int GetFirstEntry(int file) const;
+
+    /// Return the input for the current file, or NULL if no file is open.
+    CP::TRootInput* GetCurrentInput(void) const {return fCurrent;}
+
+private:
+    /// Make the file with the index the current file.  This returns false if
+    /// the file can't be opened.
+    bool OpenFile(int index);
+
+    /// The names of the files in the chain.
+    std::vector<std::string> fFileNames;
+
+    /// The first entry of each file, and then the total number of entries.
+    std::vector<int> fOffsets;
+
+    /// The index of the current file.
+    int fCurrentIndex;
+
+    /// The input for the current file.
+    CP::TRootInput* fCurrent;
+
+    /// The entry of the last event read.
+    int fSequence;
+};
+#endif
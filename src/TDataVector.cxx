@@ -80,6 +80,7 @@ CP::TDataVector::iterator CP::TDataVector::insert(iterator position,
                                                   TDatum* element) {
     if (!element) return end();
     element->SetBit(kCanDelete,false);
+    element->ReassignParentDatum(this);
 
     // Check if "position" is part of fVector, and insert the element at the
     // end of the permenant objects if it's not.
@@ -0,0 +1,237 @@
+//
+// Implement a class to report the serialized size of the datums in events.
+//
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <TBufferFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+
+#include "TDatumSizeReport.hxx"
+#include "TEvent.hxx"
+#include "TEventContext.hxx"
+#include "TDataVector.hxx"
+#include "TRootInput.hxx"
+#include "TRootOutput.hxx"
+
+namespace {
+    /// Return the number of bytes needed to serialize an object.
+    Long64_t SerializedSize(const TObject* object) {
+        TBufferFile buffer(TBuffer::kWrite);
+        buffer.WriteObject(object);
+        return buffer.Length();
+    }
+
+    /// Order the sizes by decreasing total size.
+    bool LargerTotal(
+        const std::pair<std::string,CP::TDatumSizeReport::TSizes>& a,
+        const std::pair<std::string,CP::TDatumSizeReport::TSizes>& b) {
+        return a.second.total > b.second.total;
+    }
+
+    /// Format a number of bytes in kilobytes.
+    std::string KiloBytes(double bytes) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << bytes/1024.0;
+        return out.str();
+    }
+}
+
+CP::TDatumSizeReport::TDatumSizeReport()
+    : fEventRatio(1.0), fEventCount(0), fLargestCount(5) {}
+
+CP::TDatumSizeReport::~TDatumSizeReport() {}
+
+void CP::TDatumSizeReport::SetCompressionRatios(TTree* tree) {
+    fRatios.clear();
+    fEventRatio = 1.0;
+    if (!tree) return;
+    TObjArray* branches = tree->GetListOfBranches();
+    if (!branches) return;
+    for (int i = 0; i < branches->GetEntriesFast(); ++i) {
+        TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+        if (!branch) continue;
+        Long64_t total = branch->GetTotBytes("*");
+        Long64_t zipped = branch->GetZipBytes("*");
+        if (total < 1 || zipped < 1) continue;
+        double ratio = 1.0*zipped/total;
+        std::string name(branch->GetName());
+        if (name == "Event") fEventRatio = ratio;
+        else if (name != "Context"
+                 && name != CP::TRootOutput::GetSplitPositionsName()) {
+            fRatios[name] = ratio;
+        }
+    }
+}
+
+void CP::TDatumSizeReport::SetCompressionRatios(CP::TVInputFile* input) {
+    CP::TRootInput* rootInput = dynamic_cast<CP::TRootInput*>(input);
+    if (!rootInput || !rootInput->GetFilePointer()) {
+        SetCompressionRatios((TTree*) NULL);
+        return;
+    }
+    SetCompressionRatios(dynamic_cast<TTree*>(
+                             rootInput->GetFilePointer()->Get(
+                                 "captainEventTree")));
+}
+
+double CP::TDatumSizeReport::GetCompressionRatio(
+    const std::string& topDatum) const {
+    std::map<std::string,double>::const_iterator ratio
+        = fRatios.find(topDatum);
+    if (ratio == fRatios.end()) return fEventRatio;
+    return ratio->second;
+}
+
+void CP::TDatumSizeReport::AddSize(TSizes& sizes, Long64_t bytes,
+                                   double ratio) {
+    ++sizes.count;
+    sizes.total += bytes;
+    sizes.max = std::max(sizes.max, bytes);
+    sizes.compressed += ratio*bytes;
+}
+
+void CP::TDatumSizeReport::AddDatum(
+    const CP::TDatum* datum, const std::string& path, double ratio,
+    std::vector< std::pair<Long64_t,std::string> >& datums) {
+    const CP::TDataVector* vector
+        = dynamic_cast<const CP::TDataVector*>(datum);
+    if (!vector) {
+        Long64_t bytes = SerializedSize(datum);
+        AddSize(fPathSizes[path], bytes, ratio);
+        AddSize(fClassSizes[datum->ClassName()], bytes, ratio);
+        datums.push_back(std::make_pair(bytes,path));
+        return;
+    }
+    CP::TDataVector* mutableVector = const_cast<CP::TDataVector*>(vector);
+    for (CP::TDataVector::const_iterator d = vector->begin();
+         d != vector->end(); ++d) {
+        if (mutableVector->IsTemporary(*d)) continue;
+        AddDatum(*d, path + "/" + (*d)->GetName(), ratio, datums);
+    }
+}
+
+void CP::TDatumSizeReport::AddEvent(const CP::TEvent& event) {
+    ++fEventCount;
+    Long64_t eventBytes = SerializedSize(&event);
+
+    // Each top-level datum has the compression ratio of its branch.
+    std::vector< std::pair<Long64_t,std::string> > datums;
+    double compressed = 0.0;
+    Long64_t datumBytes = 0;
+    CP::TEvent& mutableEvent = const_cast<CP::TEvent&>(event);
+    for (CP::TDataVector::const_iterator d = event.begin();
+         d != event.end(); ++d) {
+        if (mutableEvent.IsTemporary(*d)) continue;
+        std::size_t first = datums.size();
+        double ratio = GetCompressionRatio((*d)->GetName());
+        AddDatum(*d, std::string("~/") + (*d)->GetName(), ratio, datums);
+        for (std::size_t i = first; i < datums.size(); ++i) {
+            datumBytes += datums[i].first;
+            compressed += ratio*datums[i].first;
+        }
+    }
+
+    // The rest of the event (e.g. the context and the headers) is in the
+    // event branch.
+    Long64_t overhead = std::max((Long64_t) 0, eventBytes - datumBytes);
+    compressed += fEventRatio*overhead;
+    AddSize(fEventSizes, eventBytes, 0.0);
+    fEventSizes.compressed += compressed;
+
+    // Keep the breakdown of the largest events.
+    if (fLargestCount < 1) return;
+    if ((int) fLargest.size() >= fLargestCount
+        && fLargest.back().total >= eventBytes) return;
+    TLargeEvent large;
+    std::ostringstream context;
+    context << event.GetContext();
+    large.context = context.str();
+    large.total = eventBytes;
+    std::sort(datums.rbegin(), datums.rend());
+    large.datums.swap(datums);
+    std::vector<TLargeEvent>::iterator position = fLargest.begin();
+    while (position != fLargest.end() && position->total >= eventBytes) {
+        ++position;
+    }
+    fLargest.insert(position, large);
+    if ((int) fLargest.size() > fLargestCount) fLargest.pop_back();
+}
+
+void CP::TDatumSizeReport::Clear(void) {
+    fEventCount = 0;
+    fEventSizes = TSizes();
+    fPathSizes.clear();
+    fClassSizes.clear();
+    fLargest.clear();
+}
+
+void CP::TDatumSizeReport::PrintTable(
+    std::ostream& out, const std::string& title,
+    const std::map<std::string,TSizes>& sizes) const {
+    std::vector< std::pair<std::string,TSizes> > sorted(sizes.begin(),
+                                                        sizes.end());
+    std::sort(sorted.begin(), sorted.end(), LargerTotal);
+    std::size_t width = title.size();
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        width = std::max(width, sorted[i].first.size());
+    }
+    out << std::left << std::setw(width+2) << title << std::right
+        << std::setw(10) << "Count"
+        << std::setw(12) << "Mean(kB)"
+        << std::setw(12) << "Max(kB)"
+        << std::setw(14) << "Total(kB)"
+        << std::setw(12) << "Zip(kB)"
+        << std::setw(8) << "Frac"
+        << std::endl;
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        const TSizes& s = sorted[i].second;
+        double fraction = 0.0;
+        if (fEventSizes.total > 0) fraction = 1.0*s.total/fEventSizes.total;
+        out << std::left << std::setw(width+2) << sorted[i].first
+            << std::right
+            << std::setw(10) << s.count
+            << std::setw(12) << KiloBytes(1.0*s.total/std::max(fEventCount,
+                                                               (Long64_t) 1))
+            << std::setw(12) << KiloBytes(s.max)
+            << std::setw(14) << KiloBytes(s.total)
+            << std::setw(12) << KiloBytes(s.compressed)
+            << std::setw(8) << std::fixed << std::setprecision(3) << fraction
+            << std::endl;
+        out.unsetf(std::ios_base::floatfield);
+    }
+}
+
+void CP::TDatumSizeReport::Print(std::ostream& out) const {
+    out << "Datum sizes for " << fEventCount << " events" << std::endl;
+    if (fEventCount < 1) return;
+    out << "   Uncompressed event size:"
+        << " mean " << KiloBytes(1.0*fEventSizes.total/fEventCount) << " kB,"
+        << " max " << KiloBytes(fEventSizes.max) << " kB,"
+        << " total " << KiloBytes(fEventSizes.total) << " kB"
+        << std::endl;
+    out << "   Estimated compressed size:"
+        << " mean " << KiloBytes(fEventSizes.compressed/fEventCount) << " kB,"
+        << " total " << KiloBytes(fEventSizes.compressed) << " kB"
+        << std::endl;
+    out << "   (The \"Frac\" column is the fraction of the uncompressed"
+        << " event size)" << std::endl;
+    out << std::endl;
+    PrintTable(out, "Datum", fPathSizes);
+    out << std::endl;
+    PrintTable(out, "Class", fClassSizes);
+    for (std::size_t i = 0; i < fLargest.size(); ++i) {
+        out << std::endl;
+        out << "Large event " << fLargest[i].context
+            << ": " << KiloBytes(fLargest[i].total) << " kB" << std::endl;
+        for (std::size_t d = 0; d < fLargest[i].datums.size(); ++d) {
+            out << "    " << std::setw(12)
+                << KiloBytes(fLargest[i].datums[d].first) << " kB  "
+                << fLargest[i].datums[d].second << std::endl;
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#ifndef TDatumSizeReport_hxx_seen
+#define TDatumSizeReport_hxx_seen
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <Rtypes.h>
+
+class TTree;
+
+namespace CP {
+    class TEvent;
+    class TDatum;
+    class TEventContext;
+    class TVInputFile;
+    class TDatumSizeReport;
+}
+
+/// Collect the serialized size of each datum in a set of events, and report
+/// which datums (and which classes) dominate the size of the events.  Each
+/// datum that isn't a CP::TDataVector is serialized with TBufferFile to find
+/// its uncompressed size, and is reported by its path in the event (e.g.
+/// "~/digits/drift", or "~/truth/G4Trajectories").  The temporary datums
+/// are not counted.  ROOT compresses a basket of many events at once, so the
+/// compressed size of a datum is estimated from the compression ratio of the
+/// branch that holds it (see SetCompressionRatios()).  When the file was
+/// written with split datums (see CP::TRootOutput::SetSplitDatums()), each
+/// top-level datum has its own ratio.  The report gives the mean, maximum
+/// and total size of each path and class, and a breakdown of the largest
+/// events.
+///
+/// \code
+/// CP::TDatumSizeReport report;
+/// report.SetCompressionRatios(tree);
+/// for (...) report.AddEvent(*event);
+/// report.Print(std::cout);
+/// \endcode
+class CP::TDatumSizeReport {
+public:
+    /// The sizes collected for a datum path or class.
+    struct TSizes {
+        TSizes() : count(0), total(0), max(0), compressed(0) {}
+        /// The number of datums.
+        Long64_t count;
+        /// The total uncompressed size.
+        Long64_t total;
+        /// The largest uncompressed size.
+        Long64_t max;
+        /// The total estimated compressed size.
+        double compressed;
+    };
+
+    TDatumSizeReport();
+    virtual ~TDatumSizeReport();
+
+    /// Take the compression ratio of each top-level datum from the branches
+    /// of a captEvent event tree.  The ratio of the "Event" branch is used
+    /// for the datums that aren't in a separate branch.  Without a tree,
+    /// the datums are assumed not to be compressed.
+    void SetCompressionRatios(TTree* tree);
+
+    /// Take the compression ratios from the event tree of an input file.
+    /// Inputs that aren't a CP::TRootInput are assumed not to be
+    /// compressed.
+    void SetCompressionRatios(CP::TVInputFile* input);
+
+    /// Return the compression ratio (compressed over uncompressed bytes)
+    /// used for a top-level datum.
+    double GetCompressionRatio(const std::string& topDatum) const;
+
+    /// Set the number of the largest events that are kept for the per-event
+    /// breakdown.  The default is 5.
+    void SetLargestEvents(int count) {fLargestCount = count;}
+
+    /// Add the sizes of the datums in an event.
+    void AddEvent(const CP::TEvent& event);
+
+    /// Return the number of events added.
+    Long64_t GetEventCount(void) const {return fEventCount;}
+
+    /// Return the sizes collected for each datum path.
+    const std::map<std::string,TSizes>& GetPathSizes(void) const {
+        return fPathSizes;
+    }
+
+    /// Return the sizes collected for each datum class.
+    const std::map<std::string,TSizes>& GetClassSizes(void) const {
+        return fClassSizes;
+    }
+
+    /// Return the sizes collected for the full events.
+    const TSizes& GetEventSizes(void) const {return fEventSizes;}
+
+    /// Print the report.
+    void Print(std::ostream& out) const;
+
+    /// Forget the events that have been added (the compression ratios are
+    /// kept).
+    void Clear(void);
+
+private:
+    /// The sizes of the datums in one of the largest events.
+    struct TLargeEvent {
+        std::string context;
+        Long64_t total;
+        std::vector< std::pair<Long64_t,std::string> > datums;
+    };
+
+    /// Add the sizes of a datum (and the datums inside it).  The sizes of
+    /// the datums that are added are returned in "datums".
+    void AddDatum(const CP::TDatum* datum, const std::string& path,
+                  double ratio,
+                  std::vector< std::pair<Long64_t,std::string> >& datums);
+
+    /// Add a size to the collected sizes.
+    static void AddSize(TSizes& sizes, Long64_t bytes, double ratio);
+
+    /// Print a table of sizes sorted by the total size.
+    void PrintTable(std::ostream& out, const std::string& title,
+                    const std::map<std::string,TSizes>& sizes) const;
+
+    /// The compression ratio of each top-level datum in a separate branch.
+    std::map<std::string,double> fRatios;
+
+    /// The compression ratio of the event branch.
+    double fEventRatio;
+
+    /// The number of events added.
+    Long64_t fEventCount;
+
+    /// The sizes of the full events.
+    TSizes fEventSizes;
+
+    /// The sizes of each datum path.
+    std::map<std::string,TSizes> fPathSizes;
+
+    /// The sizes of each datum class.
+    std::map<std::string,TSizes> fClassSizes;
+
+    /// The number of largest events to keep.
+    int fLargestCount;
+
+    /// The largest events sorted by decreasing size.
+    std::vector<TLargeEvent> fLargest;
+};
+#endif
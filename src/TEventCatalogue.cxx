@@ -0,0 +1,451 @@
+//
+// Implement a catalogue of the events in a set of files.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "TEventCatalogue.hxx"
+#include "TRootInput.hxx"
+#include "TEvent.hxx"
+#include "TEventContext.hxx"
+#include "TCaptLog.hxx"
+
+namespace {
+    /// Append a little-endian 32 bit word to the buffer.
+    void AddWord(std::string& buffer, unsigned int word) {
+        buffer.push_back(word & 0xFF);
+        buffer.push_back((word >> 8) & 0xFF);
+        buffer.push_back((word >> 16) & 0xFF);
+        buffer.push_back((word >> 24) & 0xFF);
+    }
+
+    /// Append a little-endian 64 bit word to the buffer.
+    void AddLong(std::string& buffer, Long64_t word) {
+        AddWord(buffer, word & 0xFFFFFFFF);
+        AddWord(buffer, (word >> 32) & 0xFFFFFFFF);
+    }
+
+    /// Read the words of a catalogue file.  This throws
+    /// EEventCatalogueFormat if the data ends early.
+    class TCatalogueReader {
+    public:
+        explicit TCatalogueReader(const std::string& data)
+            : fData(data), fPosition(0) {}
+
+        const char* Take(std::size_t size) {
+            if (fData.size() < fPosition + size) {
+                throw CP::EEventCatalogueFormat();
+            }
+            const char* data = fData.data() + fPosition;
+            fPosition += size;
+            return data;
+        }
+
+        unsigned int Word() {
+            const unsigned char* bytes
+                = reinterpret_cast<const unsigned char*>(Take(4));
+            return bytes[0]
+                | (bytes[1] << 8)
+                | (bytes[2] << 16)
+                | (static_cast<unsigned int>(bytes[3]) << 24);
+        }
+
+        Long64_t Long() {
+            ULong64_t low = Word();
+            ULong64_t high = Word();
+            return static_cast<Long64_t>(low | (high << 32));
+        }
+
+    private:
+        const std::string& fData;
+        std::size_t fPosition;
+    };
+
+    /// Return the absolute path of a file.  Files that don't exist are
+    /// made absolute using the current directory.
+    std::string AbsolutePath(const std::string& name) {
+        // The strings from realpath() and getcwd() are made with malloc.
+        std::unique_ptr<char, void(*)(void*)>
+            resolved(realpath(name.c_str(), NULL), std::free);
+        if (resolved) return std::string(resolved.get());
+        if (!name.empty() && name[0] == '/') return name;
+        std::unique_ptr<char, void(*)(void*)>
+            current(getcwd(NULL, 0), std::free);
+        if (!current) return name;
+        return std::string(current.get()) + "/" + name;
+    }
+}
+
+bool CP::TEventCatalogue::TEntry::operator < (const TEntry& rhs) const {
+    if (run != rhs.run) return run < rhs.run;
+    if (event != rhs.event) return event < rhs.event;
+    if (subRun != rhs.subRun) return subRun < rhs.subRun;
+    if (file != rhs.file) return file < rhs.file;
+    return entry < rhs.entry;
+}
+
+CP::TEventCatalogue::TEventCatalogue() {}
+
+CP::TEventCatalogue::TEventCatalogue(const std::string& name) {
+    Read(name);
+}
+
+CP::TEventCatalogue::~TEventCatalogue() {}
+
+bool CP::TEventCatalogue::Read(const std::string& name) {
+    fFiles.clear();
+    fFileIndex.clear();
+    fEntries.clear();
+    std::ifstream input(name.c_str(), std::ios::in | std::ios::binary);
+    if (!input.is_open()) return false;
+    std::string data((std::istreambuf_iterator<char>(input)),
+                     std::istreambuf_iterator<char>());
+    try {
+        TCatalogueReader reader(data);
+        if (std::memcmp(reader.Take(8), GetMagic(), 8) != 0) {
+            CaptError("File " << name << " is not an event catalogue");
+            throw CP::EEventCatalogueFormat();
+        }
+        unsigned int version = reader.Word();
+        if (version != kVersion) {
+            CaptError("Event catalogue " << name << " has version "
+                      << version << " (expected " << kVersion << ")");
+            throw CP::EEventCatalogueFormat();
+        }
+        unsigned int files = reader.Word();
+        unsigned int events = reader.Word();
+        reader.Word();
+        fFiles.resize(files);
+        for (unsigned int i = 0; i < files; ++i) {
+            unsigned int length = reader.Word();
+            fFiles[i].name = std::string(reader.Take(length), length);
+            fFiles[i].size = reader.Long();
+            fFiles[i].modified = reader.Long();
+            fFiles[i].events = reader.Word();
+        }
+        fEntries.resize(events);
+        for (unsigned int i = 0; i < events; ++i) {
+            fEntries[i].run = reader.Word();
+            fEntries[i].subRun = reader.Word();
+            fEntries[i].event = reader.Word();
+            fEntries[i].timeStamp = reader.Word();
+            fEntries[i].file = reader.Word();
+            fEntries[i].entry = reader.Word();
+            if (files <= fEntries[i].file) throw CP::EEventCatalogueFormat();
+        }
+    }
+    catch (CP::EEventCatalogueFormat&) {
+        CaptError("Event catalogue " << name << " is corrupted");
+        fFiles.clear();
+        fEntries.clear();
+        throw;
+    }
+    for (std::size_t i = 0; i < fFiles.size(); ++i) {
+        fFileIndex[fFiles[i].name] = i;
+    }
+    CaptVerbose("Read " << fEntries.size() << " events in "
+                << fFiles.size() << " files from " << name);
+    return true;
+}
+
+void CP::TEventCatalogue::Write(const std::string& name) const {
+    std::string buffer(GetMagic(), 8);
+    AddWord(buffer, kVersion);
+    AddWord(buffer, fFiles.size());
+    AddWord(buffer, fEntries.size());
+    AddWord(buffer, 0);
+    for (std::size_t i = 0; i < fFiles.size(); ++i) {
+        AddWord(buffer, fFiles[i].name.size());
+        buffer += fFiles[i].name;
+        AddLong(buffer, fFiles[i].size);
+        AddLong(buffer, fFiles[i].modified);
+        AddWord(buffer, fFiles[i].events);
+    }
+    buffer.reserve(buffer.size() + 24*fEntries.size());
+    for (std::size_t i = 0; i < fEntries.size(); ++i) {
+        AddWord(buffer, fEntries[i].run);
+        AddWord(buffer, fEntries[i].subRun);
+        AddWord(buffer, fEntries[i].event);
+        AddWord(buffer, fEntries[i].timeStamp);
+        AddWord(buffer, fEntries[i].file);
+        AddWord(buffer, fEntries[i].entry);
+    }
+
+    std::string tmpName = name + ".tmp";
+    {
+        std::ofstream output(tmpName.c_str(),
+                             std::ios::out | std::ios::binary
+                             | std::ios::trunc);
+        output.write(buffer.data(), buffer.size());
+        output.close();
+        if (output.fail()) {
+            CaptError("Cannot write event catalogue " << tmpName);
+            throw CP::EEventCatalogueWriteFailed();
+        }
+    }
+    if (std::rename(tmpName.c_str(), name.c_str()) != 0) {
+        CaptError("Cannot rename event catalogue to " << name);
+        throw CP::EEventCatalogueWriteFailed();
+    }
+    CaptVerbose("Wrote " << fEntries.size() << " events in "
+                << fFiles.size() << " files to " << name);
+}
+
+int CP::TEventCatalogue::FindFile(const std::string& path) const {
+    std::map<std::string,int>::const_iterator found = fFileIndex.find(path);
+    if (found == fFileIndex.end()) return -1;
+    return found->second;
+}
+
+bool CP::TEventCatalogue::IsCurrent(const std::string& name) const {
+    std::string path = AbsolutePath(name);
+    int index = FindFile(path);
+    if (index < 0) return false;
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) return false;
+    return (fFiles[index].size == status.st_size
+            && fFiles[index].modified == status.st_mtime);
+}
+
+bool CP::TEventCatalogue::ReadFile(const std::string& path,
+                                   TFileRecord& record,
+                                   std::vector<TEntry>& entries) const {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        CaptError("Cannot catalogue missing file " << path);
+        return false;
+    }
+
+    // Read the contexts without reading the events when the file has a
+    // context branch.
+    entries.clear();
+    try {
+        CP::TRootInput input(path.c_str(),"OLD");
+        CP::TEventContext context;
+        int count = input.GetEventsInFile();
+        if (0 < count && input.ReadContext(0,context)) {
+            for (int i = 0; i < count; ++i) {
+                if (!input.ReadContext(i,context)) break;
+                TEntry entry = {context.GetRun(), context.GetSubRun(),
+                                context.GetEvent(),
+                                (UInt_t) context.GetTimeStamp(), 0,
+                                (UInt_t) i};
+                entries.push_back(entry);
+            }
+        }
+        else {
+            UInt_t i = 0;
+            CP::TEvent* event = input.FirstEvent();
+            while (event) {
+                const CP::TEventContext& eventContext = event->GetContext();
+                TEntry entry = {eventContext.GetRun(),
+                                eventContext.GetSubRun(),
+                                eventContext.GetEvent(),
+                                (UInt_t) eventContext.GetTimeStamp(), 0,
+                                i++};
+                entries.push_back(entry);
+                delete event;
+                event = input.NextEvent();
+            }
+        }
+        input.Close();
+    }
+    catch (CP::ENoEvents&) {
+        CaptInfo("No events in " << path);
+        entries.clear();
+    }
+    catch (CP::ECore&) {
+        CaptError("Cannot read events from " << path);
+        return false;
+    }
+    catch (std::exception& ex) {
+        CaptError("Cannot read events from " << path << ": " << ex.what());
+        return false;
+    }
+
+    record.name = path;
+    record.size = status.st_size;
+    record.modified = status.st_mtime;
+    record.events = entries.size();
+    CaptInfo("Catalogued " << entries.size() << " events in " << path);
+    return true;
+}
+
+void CP::TEventCatalogue::UpdateFiles(const std::set<std::string>& removed,
+                                      const std::vector<TFileRecord>& records,
+                                      std::vector<TEntry>& entries) {
+    // Find the files that are kept, and their new index.  The files keep
+    // their order, so the events that are kept are still sorted.
+    std::set<std::string> dropped(removed);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        dropped.insert(records[i].name);
+    }
+    std::vector<int> newIndex(fFiles.size(), -1);
+    std::vector<TFileRecord> files;
+    files.reserve(fFiles.size() + records.size());
+    for (std::size_t i = 0; i < fFiles.size(); ++i) {
+        if (dropped.count(fFiles[i].name)) continue;
+        newIndex[i] = files.size();
+        files.push_back(fFiles[i]);
+    }
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < fEntries.size(); ++i) {
+        int index = newIndex[fEntries[i].file];
+        if (index < 0) continue;
+        fEntries[kept] = fEntries[i];
+        fEntries[kept].file = index;
+        ++kept;
+    }
+    fEntries.resize(kept);
+
+    // Add the new files after the kept files, and merge their events.
+    UInt_t first = files.size();
+    files.insert(files.end(), records.begin(), records.end());
+    for (std::size_t i = 0; i < entries.size(); ++i) entries[i].file += first;
+    std::sort(entries.begin(), entries.end());
+    std::size_t middle = fEntries.size();
+    fEntries.insert(fEntries.end(), entries.begin(), entries.end());
+    std::inplace_merge(fEntries.begin(), fEntries.begin() + middle,
+                       fEntries.end());
+
+    fFiles.swap(files);
+    fFileIndex.clear();
+    for (std::size_t i = 0; i < fFiles.size(); ++i) {
+        fFileIndex[fFiles[i].name] = i;
+    }
+}
+
+int CP::TEventCatalogue::AddFile(const std::string& name) {
+    TFileRecord record;
+    std::vector<TEntry> entries;
+    if (!ReadFile(AbsolutePath(name), record, entries)) return -1;
+    UpdateFiles(std::set<std::string>(),
+                std::vector<TFileRecord>(1, record), entries);
+    return record.events;
+}
+
+int CP::TEventCatalogue::AddFiles(const std::vector<std::string>& names) {
+    std::vector<TFileRecord> records;
+    std::vector<TEntry> entries;
+    std::set<std::string> paths;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        std::string path = AbsolutePath(names[i]);
+        if (!paths.insert(path).second) continue;
+        TFileRecord record;
+        std::vector<TEntry> fileEntries;
+        if (!ReadFile(path, record, fileEntries)) continue;
+        for (std::size_t e = 0; e < fileEntries.size(); ++e) {
+            fileEntries[e].file = records.size();
+        }
+        entries.insert(entries.end(), fileEntries.begin(), fileEntries.end());
+        records.push_back(record);
+    }
+    if (!records.empty()) {
+        UpdateFiles(std::set<std::string>(), records, entries);
+    }
+    return records.size();
+}
+
+bool CP::TEventCatalogue::RemoveFile(const std::string& name) {
+    std::string path = AbsolutePath(name);
+    if (FindFile(path) < 0) return false;
+    std::vector<TEntry> entries;
+    UpdateFiles(std::set<std::string>(&path, &path + 1),
+                std::vector<TFileRecord>(), entries);
+    return true;
+}
+
+int CP::TEventCatalogue::AddDirectory(const std::string& directory) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        CaptError("Cannot read directory " << directory);
+        return 0;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name(entry->d_name);
+        if (name.size() < 6) continue;
+        if (name.compare(name.size()-5, 5, ".root") != 0) continue;
+        names.push_back(AbsolutePath(directory + "/" + name));
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    // Forget the files that have been removed from the directory.
+    std::string prefix = AbsolutePath(directory) + "/";
+    std::set<std::string> present(names.begin(), names.end());
+    std::set<std::string> removed;
+    for (std::size_t i = 0; i < fFiles.size(); ++i) {
+        const std::string& name = fFiles[i].name;
+        if (name.compare(0, prefix.size(), prefix) != 0) continue;
+        if (name.find('/', prefix.size()) != std::string::npos) continue;
+        if (present.count(name)) continue;
+        CaptInfo("Remove " << name << " from the catalogue");
+        removed.insert(name);
+    }
+
+    // Read the new and changed files, and then update the catalogue once.
+    std::vector<TFileRecord> records;
+    std::vector<TEntry> entries;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (IsCurrent(names[i])) continue;
+        TFileRecord record;
+        std::vector<TEntry> fileEntries;
+        if (!ReadFile(names[i], record, fileEntries)) continue;
+        for (std::size_t e = 0; e < fileEntries.size(); ++e) {
+            fileEntries[e].file = records.size();
+        }
+        entries.insert(entries.end(), fileEntries.begin(), fileEntries.end());
+        records.push_back(record);
+    }
+    if (!removed.empty() || !records.empty()) {
+        UpdateFiles(removed, records, entries);
+    }
+    return records.size();
+}
+
+void CP::TEventCatalogue::FillLocation(const TEntry& entry,
+                                       TLocation& location) const {
+    location.file = fFiles[entry.file].name;
+    location.entry = entry.entry;
+    location.run = entry.run;
+    location.subRun = entry.subRun;
+    location.event = entry.event;
+    location.timeStamp = entry.timeStamp;
+}
+
+bool CP::TEventCatalogue::Find(int run, int event,
+                               TLocation& location) const {
+    if (fEntries.empty()) return false;
+    if (run < 0) {
+        if (event < 0) {
+            FillLocation(fEntries.front(), location);
+            return true;
+        }
+        for (std::size_t i = 0; i < fEntries.size(); ++i) {
+            if (fEntries[i].event != (UInt_t) event) continue;
+            FillLocation(fEntries[i], location);
+            return true;
+        }
+        return false;
+    }
+    TEntry target = {(UInt_t) run, 0, (UInt_t) std::max(event,0), 0, 0, 0};
+    std::vector<TEntry>::const_iterator found
+        = std::lower_bound(fEntries.begin(), fEntries.end(), target);
+    if (found == fEntries.end()) return false;
+    if (found->run != (UInt_t) run) return false;
+    if (0 <= event && found->event != (UInt_t) event) return false;
+    FillLocation(*found, location);
+    return true;
+}
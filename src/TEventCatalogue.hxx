@@ -0,0 +1,197 @@
+#ifndef TEventCatalogue_hxx_seen
+#define TEventCatalogue_hxx_seen
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include <Rtypes.h>
+
+#include "ECore.hxx"
+
+namespace CP {
+    class TEventCatalogue;
+
+    /// Base class for event catalogue errors.
+    EXCEPTION(EEventCatalogue, ECore);
+
+    /// The catalogue file doesn't have the expected layout.
+    EXCEPTION(EEventCatalogueFormat, EEventCatalogue);
+
+    /// The catalogue file could not be written.
+    EXCEPTION(EEventCatalogueWriteFailed, EEventCatalogue);
+}
+
+/// A catalogue of the events in a set of captEvent files that gives the file
+/// and entry of an event from its run and event number, so an event can be
+/// found in thousands of files without opening them.  The catalogue is
+/// built with the index-events.exe program, and is used by the event loop
+/// "--catalogue <file>" option to open only the file with the event asked
+/// for with "-f".
+///
+/// \code
+/// CP::TEventCatalogue catalogue("run1234.catalogue");
+/// CP::TEventCatalogue::TLocation location;
+/// if (catalogue.Find(1234, 567, location)) {
+///     CP::TRootInput input(location.file.c_str());
+///     CP::TEvent* event = input.ReadEvent(location.entry);
+/// }
+/// \endcode
+///
+/// The run, sub-run and event numbers, and the time stamp of each event are
+/// taken from the "Context" branch, so the events aren't read while the
+/// catalogue is built.  The size and modification time of each file are
+/// saved so that the catalogue can be updated as new files arrive without
+/// reading the files that haven't changed (see AddDirectory()).  The
+/// catalogue is updated with one pass over the events for each call (so
+/// add many files with AddFiles() or AddDirectory() instead of AddFile()
+/// for each one).  The file
+/// names are saved as absolute paths.  The catalogue file is a little-endian
+/// binary file that starts with
+///
+/// \code
+/// char   magic[8]       "CPCATLG1"
+/// uint32 version        1
+/// uint32 files          number of files
+/// uint32 events         number of events
+/// uint32 reserved       0
+/// \endcode
+///
+/// followed by a record for each file (a uint32 name length, the name, the
+/// uint64 size, the uint64 modification time, and the uint32 number of
+/// events), and then a 24 byte record for each event (the uint32 run,
+/// sub-run, event, time stamp, file index and entry) sorted by run, event
+/// and sub-run.  The catalogue is written to a temporary name and renamed so
+/// it can be updated while it's being used.
+class CP::TEventCatalogue {
+public:
+    /// The location of an event.
+    struct TLocation {
+        /// The file with the event.
+        std::string file;
+        /// The entry of the event in the file.
+        Long64_t entry;
+        /// The context of the event.
+        UInt_t run;
+        UInt_t subRun;
+        UInt_t event;
+        UInt_t timeStamp;
+    };
+
+    /// Make an empty catalogue.
+    TEventCatalogue();
+
+    /// Read a catalogue.  A catalogue that doesn't exist is empty.  This
+    /// throws EEventCatalogueFormat if the file isn't a catalogue.
+    explicit TEventCatalogue(const std::string& name);
+
+    virtual ~TEventCatalogue();
+
+    /// Read a catalogue, replacing the current contents.  This returns
+    /// false (and leaves the catalogue empty) if the file doesn't exist, and
+    /// throws EEventCatalogueFormat if the file isn't a catalogue.
+    bool Read(const std::string& name);
+
+    /// Write the catalogue.  This throws EEventCatalogueWriteFailed if the
+    /// file can't be written.
+    void Write(const std::string& name) const;
+
+    /// Add the events in a file to the catalogue, replacing the events that
+    /// were already catalogued for the file.  This returns the number of
+    /// events added, or -1 if the file can't be read.
+    int AddFile(const std::string& name);
+
+    /// Add the events in several files to the catalogue (see AddFile()).
+    /// The catalogue is updated once after all of the files are read, so
+    /// this is much faster than calling AddFile() for each file of a large
+    /// catalogue.  This returns the number of files that were read.
+    int AddFiles(const std::vector<std::string>& names);
+
+    /// Catalogue the ROOT files (names ending in ".root") in a directory.
+    /// Only the files that are new or that have changed since they were
+    /// catalogued are read, and the files that have been removed from the
+    /// directory are removed from the catalogue.  This returns the number of
+    /// files that were read.
+    int AddDirectory(const std::string& directory);
+
+    /// Remove the events in a file from the catalogue.  This returns false
+    /// if the file isn't in the catalogue.
+    bool RemoveFile(const std::string& name);
+
+    /// Return true if a file is in the catalogue and hasn't changed since
+    /// it was catalogued.
+    bool IsCurrent(const std::string& name) const;
+
+    /// Find the event with a run and event number.  If the run is negative,
+    /// the event in the first run with the event number is found.  If the
+    /// event is negative, the first event of the run is found.  This returns
+    /// false if the event isn't in the catalogue.
+    bool Find(int run, int event, TLocation& location) const;
+
+    /// Return the number of files in the catalogue.
+    int GetFileCount(void) const {return fFiles.size();}
+
+    /// Return the name of a file in the catalogue.
+    const std::string& GetFileName(int i) const {return fFiles[i].name;}
+
+    /// Return the number of events in the catalogue.
+    Long64_t GetEventCount(void) const {return fEntries.size();}
+
+    /// The first eight bytes of a catalogue file.
+    static const char* GetMagic(void) {return "CPCATLG1";}
+
+    /// The version of the catalogue layout.
+    static const unsigned int kVersion = 1;
+
+private:
+    /// A file in the catalogue.
+    struct TFileRecord {
+        std::string name;
+        Long64_t size;
+        Long64_t modified;
+        UInt_t events;
+    };
+
+    /// An event in the catalogue.
+    struct TEntry {
+        UInt_t run;
+        UInt_t subRun;
+        UInt_t event;
+        UInt_t timeStamp;
+        UInt_t file;
+        UInt_t entry;
+        bool operator < (const TEntry& rhs) const;
+    };
+
+    /// Return the index of a file (by its absolute path), or -1 if it isn't
+    /// in the catalogue.
+    int FindFile(const std::string& path) const;
+
+    /// Read the events in a file (by its absolute path).  The file of each
+    /// entry is zero.  This returns false if the file can't be read.
+    bool ReadFile(const std::string& path, TFileRecord& record,
+                  std::vector<TEntry>& entries) const;
+
+    /// Update the catalogue in one pass.  The events of the files in
+    /// "removed", and of the files in "records" that are already
+    /// catalogued, are dropped.  Then the records are added with their
+    /// entries (the file of each entry is the index of its record), and
+    /// the events are sorted again.
+    void UpdateFiles(const std::set<std::string>& removed,
+                     const std::vector<TFileRecord>& records,
+                     std::vector<TEntry>& entries);
+
+    /// Fill a location from an entry.
+    void FillLocation(const TEntry& entry, TLocation& location) const;
+
+    /// The files in the catalogue.
+    std::vector<TFileRecord> fFiles;
+
+    /// The index in fFiles of each file by name.
+    std::map<std::string,int> fFileIndex;
+
+    /// The events sorted by run, event and sub-run.
+    std::vector<TEntry> fEntries;
+};
+#endif
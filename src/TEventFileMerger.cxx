@@ -0,0 +1,379 @@
+//
+// Implement a class to merge captEvent files.
+//
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <sstream>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+#include <TObjString.h>
+#include <TKey.h>
+#include <TClass.h>
+#include <TH1.h>
+#include <TGeoManager.h>
+
+#include "TEventFileMerger.hxx"
+#include "TRootInput.hxx"
+#include "TRootOutput.hxx"
+#include "TEvent.hxx"
+#include "TEventContext.hxx"
+#include "TCaptLog.hxx"
+
+bool CP::TEventFileMerger::TEntry::operator < (const TEntry& rhs) const {
+    if (run != rhs.run) return run < rhs.run;
+    if (event != rhs.event) return event < rhs.event;
+    if (input != rhs.input) return input < rhs.input;
+    return entry < rhs.entry;
+}
+
+CP::TEventFileMerger::TEventFileMerger()
+    : fSortEvents(false), fFastCloned(0), fCopiedEvents(0) {}
+
+CP::TEventFileMerger::~TEventFileMerger() {
+    for (std::map<std::string, TH1*>::iterator h = fHistograms.begin();
+         h != fHistograms.end(); ++h) {
+        delete h->second;
+    }
+}
+
+void CP::TEventFileMerger::AddInput(const std::string& name) {
+    fInputs.push_back(name);
+}
+
+TFile* CP::TEventFileMerger::OpenInput(int input) {
+    TFile* file = TFile::Open(fInputs[input].c_str(),"OLD");
+    if (!file || !file->IsOpen() || file->IsZombie()) {
+        CaptError("Cannot open input file " << fInputs[input]);
+        delete file;
+        fFailed.push_back(fInputs[input]);
+        return NULL;
+    }
+    return file;
+}
+
+bool CP::TEventFileMerger::ReadEntries(TTree* tree, int input,
+                                       std::vector<TEntry>& entries) {
+    TBranch* contextBranch = tree->GetBranch("Context");
+    if (!contextBranch) return false;
+    CP::TEventContext context;
+    CP::TEventContext* contextPointer = &context;
+    contextBranch->SetAddress(&contextPointer);
+    for (Long64_t i = 0; i < tree->GetEntries(); ++i) {
+        if (contextBranch->GetEntry(i) <= 0) break;
+        TEntry entry = {context.GetRun(), context.GetEvent(), input, i};
+        entries.push_back(entry);
+    }
+    contextBranch->ResetAddress();
+    return true;
+}
+
+void CP::TEventFileMerger::MergeObjects(TFile* file, int input,
+                                        CP::TRootOutput* output) {
+    // The provenance strings have a cycle for each value.  They are kept in
+    // the order they were written.
+    std::map< std::pair<std::string,Short_t>, std::string > strings;
+    std::set<std::string> seen;
+    TIter next(file->GetListOfKeys());
+    TKey* key;
+    while ((key = dynamic_cast<TKey*>(next()))) {
+        std::string name = key->GetName();
+        if (name == "captainEventTree") continue;
+        if (name == "commandLine" || name == "inputFile" || name == "shard") {
+            TObjString* value = dynamic_cast<TObjString*>(key->ReadObj());
+            if (!value) continue;
+            strings[std::make_pair(name,key->GetCycle())]
+                = value->GetString().Data();
+            delete value;
+            continue;
+        }
+        // Only look at the highest cycle of the other keys.
+        if (!seen.insert(name).second) continue;
+        // The memory usage and timing are kept for each input.
+        if (name.find("memory_") == 0 || name.find("timing_") == 0) {
+            TObject* object = key->ReadObj();
+            if (!object) continue;
+            std::ostringstream inputName;
+            inputName << name << "_input" << input;
+            output->WriteTObject(object,inputName.str().c_str());
+            delete object;
+            continue;
+        }
+        TClass* cls = TClass::GetClass(key->GetClassName());
+        if (!cls) continue;
+        if (cls->InheritsFrom(TH1::Class())) {
+            TH1* hist = dynamic_cast<TH1*>(key->ReadObj());
+            if (!hist) continue;
+            hist->SetDirectory(NULL);
+            if (fHistograms.find(name) == fHistograms.end()) {
+                fHistograms[name] = hist;
+            }
+            else {
+                fHistograms[name]->Add(hist);
+                delete hist;
+            }
+            continue;
+        }
+        // The geometries are saved with a name made from their hash, so a
+        // geometry that is already in the output isn't read again.
+        if (output->FindKey(name.c_str())) continue;
+        TObject* object = key->ReadObj();
+        if (!object) continue;
+        output->WriteTObject(object,name.c_str());
+        if (cls->InheritsFrom(TGeoManager::Class())) {
+            CaptLog("Geometry " << name << " copied from "
+                    << file->GetName());
+        }
+        delete object;
+    }
+
+    for (std::map< std::pair<std::string,Short_t>, std::string >::iterator s
+             = strings.begin();
+         s != strings.end(); ++s) {
+        std::pair<std::string,std::string> value(s->first.first, s->second);
+        if (std::find(fProvenance.begin(), fProvenance.end(), value)
+            != fProvenance.end()) continue;
+        fProvenance.push_back(value);
+    }
+}
+
+void CP::TEventFileMerger::WriteObjects(CP::TRootOutput* output) {
+    output->cd();
+    for (std::size_t i = 0; i < fProvenance.size(); ++i) {
+        TObjString value(fProvenance[i].second.c_str());
+        output->WriteObject(&value,fProvenance[i].first.c_str());
+    }
+    for (std::map<std::string, TH1*>::iterator h = fHistograms.begin();
+         h != fHistograms.end(); ++h) {
+        output->WriteTObject(h->second,h->first.c_str());
+        delete h->second;
+    }
+    fHistograms.clear();
+}
+
+bool CP::TEventFileMerger::SameBranches(TTree* a, TTree* b) {
+    TObjArray* aBranches = a->GetListOfBranches();
+    TObjArray* bBranches = b->GetListOfBranches();
+    if (!aBranches || !bBranches) return false;
+    if (aBranches->GetEntriesFast() != bBranches->GetEntriesFast()) {
+        return false;
+    }
+    for (int i = 0; i < aBranches->GetEntriesFast(); ++i) {
+        TBranch* aBranch = dynamic_cast<TBranch*>(aBranches->At(i));
+        TBranch* bBranch = dynamic_cast<TBranch*>(bBranches->At(i));
+        if (!aBranch || !bBranch) return false;
+        if (std::string(aBranch->GetName()) != bBranch->GetName()) {
+            return false;
+        }
+        if (std::string(aBranch->GetClassName())
+            != bBranch->GetClassName()) return false;
+    }
+    return true;
+}
+
+Long64_t CP::TEventFileMerger::CloneInputs(const std::vector<int>& order,
+                                           CP::TRootOutput* output) {
+    TTree* outputTree = NULL;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        TFile* file = OpenInput(order[i]);
+        if (!file) continue;
+        MergeObjects(file, order[i], output);
+        TTree* tree = dynamic_cast<TTree*>(file->Get("captainEventTree"));
+        if (!tree) {
+            CaptWarn("No events in " << fInputs[order[i]]);
+        }
+        else if (!outputTree) {
+            output->cd();
+            outputTree = tree->CloneTree(0);
+        }
+        else if (!SameBranches(tree, outputTree)) {
+            CaptError("Input " << fInputs[order[i]]
+                      << " has different branches than the first input"
+                      << " (check the split datums)");
+            fFailed.push_back(fInputs[order[i]]);
+            tree = NULL;
+        }
+        if (tree) {
+            Long64_t entries = outputTree->CopyEntries(tree,-1,"fast");
+            if (entries < 0) {
+                CaptWarn("Cannot fast clone " << fInputs[order[i]]
+                         << ", so the events are copied");
+                entries = outputTree->CopyEntries(tree);
+                if (entries > 0) fCopiedEvents += entries;
+            }
+            else ++fFastCloned;
+            CaptInfo("Merged " << entries << " events from "
+                     << fInputs[order[i]]);
+        }
+        file->Close();
+        delete file;
+    }
+    if (!outputTree) return 0;
+
+    // The output replaces its own (empty) event tree with the merged tree,
+    // so the file has one event tree, and it is indexed by run and event
+    // number when the output is closed.
+    output->AdoptEventTree(outputTree);
+    return outputTree->GetEntries();
+}
+
+Long64_t CP::TEventFileMerger::CopyEvents(const std::vector<int>& order,
+                                          const std::vector<TEntry>& entries,
+                                          CP::TRootOutput* output) {
+    // Open all of the inputs.
+    std::map<int, CP::TRootInput*> inputs;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        int input = order[i];
+        inputs[input] = NULL;
+        TFile* file = OpenInput(input);
+        if (!file) continue;
+        MergeObjects(file, input, output);
+        try {
+            inputs[input] = new CP::TRootInput(file);
+        }
+        catch (...) {
+            CaptError("Cannot read events from " << fInputs[input]);
+            fFailed.push_back(fInputs[input]);
+        }
+    }
+
+    // The output has the same split datums as the input with the first
+    // event.
+    std::string splitDatums;
+    if (!entries.empty() && inputs[entries.front().input]) {
+        TFile* file = inputs[entries.front().input]->GetFilePointer();
+        TTree* tree = dynamic_cast<TTree*>(file->Get("captainEventTree"));
+        TObjArray* branches = tree ? tree->GetListOfBranches() : NULL;
+        for (int i = 0; branches && i < branches->GetEntriesFast(); ++i) {
+            TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+            if (!branch) continue;
+            if (std::string(branch->GetClassName()) != "CP::TDataVector") {
+                continue;
+            }
+            if (!splitDatums.empty()) splitDatums += ",";
+            splitDatums += branch->GetName();
+        }
+    }
+    if (!splitDatums.empty()) output->SetSplitDatums(splitDatums);
+
+    Long64_t written = 0;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        CP::TRootInput* input = inputs[entries[i].input];
+        if (!input) continue;
+        std::unique_ptr<CP::TEvent> event(input->ReadEvent(entries[i].entry));
+        if (!event) {
+            CaptError("Cannot read entry " << entries[i].entry
+                      << " from " << fInputs[entries[i].input]);
+            continue;
+        }
+        output->WriteEvent(*event);
+        ++written;
+    }
+    fCopiedEvents += written;
+
+    for (std::map<int, CP::TRootInput*>::iterator i = inputs.begin();
+         i != inputs.end(); ++i) {
+        delete i->second;
+    }
+    return written;
+}
+
+Long64_t CP::TEventFileMerger::Merge(const std::string& outputName) {
+    fFastCloned = 0;
+    fCopiedEvents = 0;
+    fFailed.clear();
+    fProvenance.clear();
+    if (!fCommandLine.empty()) {
+        fProvenance.push_back(std::make_pair(std::string("commandLine"),
+                                             fCommandLine));
+    }
+
+    std::unique_ptr<CP::TRootOutput> output(
+        new CP::TRootOutput(outputName.c_str(),"NEW"));
+    if (!output->IsOpen() || output->IsZombie()) {
+        CaptError("Cannot create output file " << outputName);
+        throw CP::EEventFileMergerOutput();
+    }
+
+    // Find the order of the inputs.  When sorting, the inputs are put in
+    // order of their first event.  The events are only copied one at a time
+    // when the inputs overlap (or an input isn't in order).
+    std::vector<int> order;
+    std::vector<TEntry> entries;
+    bool interleaved = false;
+    if (fSortEvents) {
+        std::vector< std::pair<TEntry,int> > firstEntries;
+        std::vector<TEntry> lastEntries(fInputs.size());
+        std::vector<int> empty;
+        bool sortable = true;
+        for (std::size_t i = 0; i < fInputs.size(); ++i) {
+            TFile* file = OpenInput(i);
+            if (!file) continue;
+            order.push_back(i);
+            TTree* tree
+                = dynamic_cast<TTree*>(file->Get("captainEventTree"));
+            std::vector<TEntry> inputEntries;
+            if (tree && !ReadEntries(tree, i, inputEntries)) {
+                CaptWarn("Input " << fInputs[i]
+                         << " doesn't have the run and event numbers");
+                sortable = false;
+            }
+            file->Close();
+            delete file;
+            if (inputEntries.empty()) {
+                empty.push_back(i);
+                continue;
+            }
+            if (!std::is_sorted(inputEntries.begin(), inputEntries.end())) {
+                interleaved = true;
+            }
+            firstEntries.push_back(std::make_pair(
+                *std::min_element(inputEntries.begin(), inputEntries.end()),
+                (int) i));
+            lastEntries[i] = *std::max_element(inputEntries.begin(),
+                                               inputEntries.end());
+            entries.insert(entries.end(),
+                           inputEntries.begin(), inputEntries.end());
+        }
+        if (!sortable) {
+            CaptWarn("The events are merged without sorting");
+            interleaved = false;
+            entries.clear();
+        }
+        else {
+            // The inputs without events go first.
+            std::sort(firstEntries.begin(), firstEntries.end());
+            order.swap(empty);
+            for (std::size_t i = 0; i < firstEntries.size(); ++i) {
+                order.push_back(firstEntries[i].second);
+                if (i == 0) continue;
+                int previous = firstEntries[i-1].second;
+                if (!(lastEntries[previous] < firstEntries[i].first)) {
+                    interleaved = true;
+                }
+            }
+        }
+    }
+    else {
+        for (std::size_t i = 0; i < fInputs.size(); ++i) order.push_back(i);
+    }
+
+    Long64_t written = 0;
+    if (interleaved) {
+        CaptLog("The events in the inputs overlap, so they are copied"
+                << " one at a time");
+        std::sort(entries.begin(), entries.end());
+        written = CopyEvents(order, entries, output.get());
+    }
+    else {
+        written = CloneInputs(order, output.get());
+    }
+
+    WriteObjects(output.get());
+    output->Close();
+    return written;
+}
@@ -0,0 +1,161 @@
+#ifndef TEventFileMerger_hxx_seen
+#define TEventFileMerger_hxx_seen
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include <Rtypes.h>
+
+#include "ECore.hxx"
+
+class TFile;
+class TTree;
+class TH1;
+
+namespace CP {
+    class TRootOutput;
+    class TEventFileMerger;
+
+    /// Base class for errors merging event files.
+    EXCEPTION(EEventFileMerger, ECore);
+
+    /// The merged output file cannot be opened.
+    EXCEPTION(EEventFileMergerOutput, EEventFileMerger);
+}
+
+/// Merge captEvent files (e.g. the outputs of several jobs) into one file.
+/// The captainEventTree of each input is added to the output with
+/// TTree::CopyEntries() using fast cloning, so the compressed baskets are
+/// copied without being read or compressed again.  The inputs must have the
+/// same branches (i.e. the same split datums, see
+/// CP::TRootOutput::SetSplitDatums()), and an input with different branches
+/// is not merged.  The metadata of the files is merged the way it is by
+/// the event loop.
+///
+/// - The geometries are saved under names made from their hash (e.g.
+///   "CAPTAINGeometry-xxxxxxxx-..."), so each geometry is copied once.
+/// - The "commandLine", "inputFile" and "shard" strings of every input are
+///   kept (once each) so the provenance of the events isn't lost.
+/// - The memory usage and timing histograms ("memory_..." and
+///   "timing_...") are kept for each input with "_input<n>" added to the
+///   name.
+/// - Other histograms are summed, and other objects are copied from the
+///   first input that has them.
+///
+/// The merged tree is indexed by run and event number like a file written
+/// by CP::TRootOutput.  The events can be sorted by run and event number
+/// (see SetSortEvents()).  When the inputs hold separate ranges of events
+/// (the usual case for files from separate runs or from the shards of a
+/// job), the inputs are put in order and are still fast cloned.  When the
+/// events in the inputs are interleaved, every event is read and written
+/// again (with all of the inputs open at once).
+///
+/// \code
+/// CP::TEventFileMerger merger;
+/// merger.AddInput("reco-1.root");
+/// merger.AddInput("reco-2.root");
+/// merger.Merge("reco.root");
+/// \endcode
+class CP::TEventFileMerger {
+public:
+    TEventFileMerger();
+    virtual ~TEventFileMerger();
+
+    /// Add a file to be merged.
+    void AddInput(const std::string& name);
+
+    /// Return the files to be merged.
+    const std::vector<std::string>& GetInputs(void) const {return fInputs;}
+
+    /// Set the flag to sort the events by run and event number.
+    void SetSortEvents(bool sort) {fSortEvents = sort;}
+
+    /// Set the command line saved in the merged file (as "commandLine"
+    /// before the command lines of the inputs).
+    void SetCommandLine(const std::string& command) {fCommandLine = command;}
+
+    /// Merge the inputs into a new file and return the number of events
+    /// written.  An input that can't be read is reported and skipped (see
+    /// GetFailedInputs()).  This throws EEventFileMergerOutput if the output
+    /// file can't be created.
+    Long64_t Merge(const std::string& outputName);
+
+    /// Return the number of inputs that were fast cloned by the last
+    /// Merge().
+    int GetFastClonedInputs(void) const {return fFastCloned;}
+
+    /// Return the number of events that were read and written again (not
+    /// fast cloned) by the last Merge().
+    Long64_t GetCopiedEvents(void) const {return fCopiedEvents;}
+
+    /// Return the inputs that couldn't be merged by the last Merge().
+    const std::vector<std::string>& GetFailedInputs(void) const {
+        return fFailed;
+    }
+
+private:
+    /// The run and event number of an event, and where it's found.
+    struct TEntry {
+        UInt_t run;
+        UInt_t event;
+        int input;
+        Long64_t entry;
+        bool operator < (const TEntry& rhs) const;
+    };
+
+    /// Open an input and return its file, or NULL if it can't be read.  A
+    /// failure is added to fFailed.
+    TFile* OpenInput(int input);
+
+    /// Add the run and event numbers of the events in a tree to "entries".
+    /// This returns false if the tree doesn't have the Context branch.
+    bool ReadEntries(TTree* tree, int input, std::vector<TEntry>& entries);
+
+    /// Collect the objects other than the event tree from an input.
+    void MergeObjects(TFile* file, int input, CP::TRootOutput* output);
+
+    /// Write the provenance strings and summed histograms to the output.
+    void WriteObjects(CP::TRootOutput* output);
+
+    /// Return true if two trees have the same top-level branches.
+    static bool SameBranches(TTree* a, TTree* b);
+
+    /// Add the trees of the inputs (in the order given) to the output with
+    /// fast cloning.  Returns the number of events written.
+    Long64_t CloneInputs(const std::vector<int>& order,
+                         CP::TRootOutput* output);
+
+    /// Read the events in the order given and write them to the output.
+    /// All of the inputs (in the order given) are open at once.  Returns
+    /// the number of events written.
+    Long64_t CopyEvents(const std::vector<int>& order,
+                        const std::vector<TEntry>& entries,
+                        CP::TRootOutput* output);
+
+    /// The files to merge.
+    std::vector<std::string> fInputs;
+
+    /// The command line saved in the merged file.
+    std::string fCommandLine;
+
+    /// Flag that the events should be sorted.
+    bool fSortEvents;
+
+    /// The provenance strings (by key name) in the order they were found.
+    std::vector< std::pair<std::string,std::string> > fProvenance;
+
+    /// The summed histograms by name.
+    std::map<std::string, TH1*> fHistograms;
+
+    /// The number of inputs that were fast cloned.
+    int fFastCloned;
+
+    /// The number of events that were read and written again.
+    Long64_t fCopiedEvents;
+
+    /// The inputs that couldn't be merged.
+    std::vector<std::string> fFailed;
+};
+#endif
@@ -4,6 +4,7 @@
 
 #include <stdlib.h>
 #include <iostream>
+#include <mutex>
 
 #include <TROOT.h>
 #include <TBrowser.h>
@@ -15,7 +16,17 @@
 #include "TCaptLog.hxx"
 
 CP::TEventFolder* CP::TEventFolder::fEventFolder = NULL;
-CP::TEvent* CP::TEventFolder::fCurrentEvent = NULL;
+
+namespace {
+    /// The current event.  This is kept per thread so that events that are
+    /// read, or processed, on a different thread (e.g. by a multi-threaded
+    /// event loop) don't change the current event of the calling thread.
+    thread_local CP::TEvent* gCurrentEvent = NULL;
+
+    /// Protect the folder of events when events are created or destroyed on
+    /// several threads.
+    std::recursive_mutex gFolderMutex;
+}
 
 CP::TEventFolder::TEventFolder() {
     fFolderOfEvents = NULL;
@@ -24,7 +35,7 @@ CP::TEventFolder::TEventFolder() {
 CP::TEventFolder::~TEventFolder() {
     fFolderOfEvents = NULL;
     fEventFolder = NULL;
-    fCurrentEvent = NULL;
+    gCurrentEvent = NULL;
 }
 
 TFolder* CP::TEventFolder::GetFolder(void) const {
@@ -66,7 +77,7 @@ CP::TEvent* CP::TEventFolder::GetEvent(int indx) const {
         if (current) ++count;
         if (count > indx) break;
     }
-    if (current) fCurrentEvent = current;
+    if (current) gCurrentEvent = current;
     return current;
 }
 
@@ -76,17 +87,17 @@ void CP::TEventFolder::SetCurrentEvent(CP::TEvent* event) {
     TList* folder = dynamic_cast<TList*>(fFolderOfEvents->GetListOfFolders());
     if (!folder) return;
 
-    CP::TEvent* oldEvent = fCurrentEvent;
+    CP::TEvent* oldEvent = gCurrentEvent;
     for (TObjLink* objlink = folder->LastLink();
           objlink != NULL;
           objlink = objlink->Prev()) {
         CP::TEvent* inList = dynamic_cast<CP::TEvent*>(objlink->GetObject());
         if (inList == event) {
-            fCurrentEvent = event;
+            gCurrentEvent = event;
         }
     }
     CaptInfo("Current event changed from " << oldEvent
-              << " to " << fCurrentEvent);
+              << " to " << gCurrentEvent);
 }
 
 CP::TEvent* CP::TEventFolder::FindEvent(int, int) const {
@@ -94,12 +105,15 @@ CP::TEvent* CP::TEventFolder::FindEvent(int, int) const {
 }
 
 CP::TEvent* CP::TEventFolder::GetCurrentEvent(void) {
-    return fCurrentEvent;
+    return gCurrentEvent;
 }
 
 void CP::TEventFolder::RegisterEvent(CP::TEvent* event) {
-    fCurrentEvent = event;
-    if (fCurrentEvent && fEventFolder && fEventFolder->fFolderOfEvents) {
+    gCurrentEvent = event;
+    if (!gCurrentEvent) return;
+    std::lock_guard<std::recursive_mutex> lock(gFolderMutex);
+    if (fEventFolder && fEventFolder->fFolderOfEvents
+        && !fEventFolder->fFolderOfEvents->FindObject(event)) {
         fEventFolder->fFolderOfEvents->Add(event);
         event->SetBit(kMustCleanup);
     }
@@ -107,9 +121,10 @@ void CP::TEventFolder::RegisterEvent(CP::TEvent* event) {
 
 void CP::TEventFolder::RemoveEvent(CP::TEvent* event) {
     // Check if the event is the current event.
-    if (fCurrentEvent == event) fCurrentEvent = NULL;
+    if (gCurrentEvent == event) gCurrentEvent = NULL;
 
     // Check if the folder is active.  If not, then just return.
+    std::lock_guard<std::recursive_mutex> lock(gFolderMutex);
     if (!fEventFolder) return;
     if (!fEventFolder->GetFolder()) return;
     TList* folder = 
@@ -121,9 +136,9 @@ void CP::TEventFolder::RemoveEvent(CP::TEvent* event) {
     for (TObjLink* objlink = folder->LastLink(); 
          objlink != NULL;       
          objlink = objlink->Prev()) {
-        fCurrentEvent = dynamic_cast<CP::TEvent*>(objlink->GetObject());
+        gCurrentEvent = dynamic_cast<CP::TEvent*>(objlink->GetObject());
         // Any event is OK as long as it's not the event being removed.
-        if (fCurrentEvent != event) break;
+        if (gCurrentEvent != event) break;
     }
 }
 
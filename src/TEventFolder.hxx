@@ -63,7 +63,9 @@ public:
     /// CP::TEventFolder::GetEventFolder()->GetCurrentEvent();
     /// \endcode
     /// Accessing GetCurrentEvent through TEventFolder will cause significant
-    /// code slow downs.
+    /// code slow downs.  The current event is kept separately for each
+    /// thread, so an event registered on one thread does not change the
+    /// current event seen on another thread.
     static TEvent* GetCurrentEvent(void);
 
     /// Set the pointer to the current event.  The event will become the
@@ -101,7 +103,6 @@ public:
 
 private:
     static TEventFolder* fEventFolder; 
-    static TEvent* fCurrentEvent;
     TFolder* fFolderOfEvents;
     ClassDef(TEventFolder,2);  
 };
@@ -0,0 +1,118 @@
+#include "TEventLoopCheckpoint.hxx"
+#include "TCaptLog.hxx"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    /// Return the rest of a record as a file name.  The name is empty when
+    /// it's missing (e.g. the input after the last input file is finished).
+    std::string ReadName(std::istream& record) {
+        std::string name;
+        if (!record.good()) return name;
+        record >> std::ws;
+        if (!record.eof()) std::getline(record,name);
+        return name;
+    }
+}
+
+CP::TEventLoopCheckpoint::TEventLoopCheckpoint(const std::string& fileName)
+    : fFileName(fileName), fInputIndex(-1), fNextEntry(0),
+      fTotalRead(0), fTotalWritten(0), fFinished(false) {}
+
+CP::TEventLoopCheckpoint::~TEventLoopCheckpoint() {}
+
+void CP::TEventLoopCheckpoint::SetInput(int index, const std::string& name,
+                                        long long nextEntry) {
+    fInputIndex = index;
+    fInputName = name;
+    fNextEntry = nextEntry;
+}
+
+void CP::TEventLoopCheckpoint::SetTotals(int read, int written) {
+    fTotalRead = read;
+    fTotalWritten = written;
+}
+
+void CP::TEventLoopCheckpoint::SetOutput(const std::string& name, 
+                                         int entries) {
+    fOutputs[name] = entries;
+}
+
+int CP::TEventLoopCheckpoint::GetOutput(const std::string& name) const {
+    std::map<std::string,int>::const_iterator o = fOutputs.find(name);
+    if (o == fOutputs.end()) return -1;
+    return o->second;
+}
+
+bool CP::TEventLoopCheckpoint::Exists() const {
+    std::ifstream input(fFileName.c_str());
+    return input.is_open();
+}
+
+bool CP::TEventLoopCheckpoint::Read() {
+    std::ifstream input(fFileName.c_str());
+    if (!input.is_open()) return false;
+    fOutputs.clear();
+    fInputIndex = -1;
+    std::string line;
+    while (std::getline(input,line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream record(line);
+        std::string key;
+        record >> key;
+        if (key == "input") {
+            record >> fInputIndex >> fNextEntry;
+            fInputName = ReadName(record);
+        }
+        else if (key == "read") record >> fTotalRead;
+        else if (key == "written") record >> fTotalWritten;
+        else if (key == "output") {
+            int entries;
+            std::string name;
+            record >> entries;
+            name = ReadName(record);
+            fOutputs[name] = entries;
+        }
+        else if (key == "finished") record >> fFinished;
+        else {
+            CaptError("Invalid record in checkpoint " << fFileName
+                      << ": " << line);
+            return false;
+        }
+        if (record.fail()) {
+            CaptError("Invalid record in checkpoint " << fFileName
+                      << ": " << line);
+            return false;
+        }
+    }
+    return (0 <= fInputIndex);
+}
+
+void CP::TEventLoopCheckpoint::Write() {
+    std::string tmpName = fFileName + ".tmp";
+    {
+        std::ofstream output(tmpName.c_str());
+        output << "# CP::eventLoop checkpoint" << std::endl;
+        output << "input " << fInputIndex << " " << fNextEntry
+               << " " << fInputName << std::endl;
+        output << "read " << fTotalRead << std::endl;
+        output << "written " << fTotalWritten << std::endl;
+        for (std::map<std::string,int>::iterator o = fOutputs.begin();
+             o != fOutputs.end(); ++o) {
+            output << "output " << o->second << " " << o->first << std::endl;
+        }
+        output << "finished " << fFinished << std::endl;
+        output.close();
+        if (output.fail()) {
+            CaptError("Cannot write checkpoint " << tmpName);
+            throw CP::ECheckpointWriteFailed();
+        }
+    }
+    if (std::rename(tmpName.c_str(), fFileName.c_str()) != 0) {
+        CaptError("Cannot rename checkpoint to " << fFileName);
+        throw CP::ECheckpointWriteFailed();
+    }
+    CaptVerbose("Checkpoint at entry " << fNextEntry << " of " << fInputName);
+}
@@ -0,0 +1,103 @@
+#ifndef TEventLoopCheckpoint_hxx_seen
+#define TEventLoopCheckpoint_hxx_seen
+
+#include "ECore.hxx"
+
+#include <string>
+#include <map>
+
+namespace CP {
+    class TEventLoopCheckpoint;
+
+    /// The checkpoint file could not be written.
+    EXCEPTION(ECheckpointWriteFailed,ECore);
+};
+
+/// Record the progress of an event loop in a small text file so that a job
+/// that is killed can be restarted from the last checkpoint (the eventLoop
+/// "--checkpoint <file>" and "--resume" options).  The checkpoint is only
+/// written after the output files have been committed, so it describes
+/// entries that are safely on disk.  It records the input file being
+/// read and the next entry to be processed in that file, the event counts,
+/// and the number of events in each output file.  The file is written to a
+/// temporary name and then renamed, so a crash while writing leaves the
+/// previous checkpoint in place.  The format is one "key value" record per
+/// line:
+///
+/// \code
+/// # CP::eventLoop checkpoint
+/// input <index> <next-entry> <input-file-name>
+/// read <events-read>
+/// written <events-written>
+/// output <events-in-file> <output-file-name>
+/// finished <0 or 1>
+/// \endcode
+///
+/// The input index is the position of the input file on the command line
+/// (counting from zero for the first input file).
+class CP::TEventLoopCheckpoint {
+public:
+    /// Create a checkpoint that is saved in a file.
+    explicit TEventLoopCheckpoint(const std::string& fileName);
+    ~TEventLoopCheckpoint();
+
+    /// Return the name of the checkpoint file.
+    const std::string& GetFileName() const {return fFileName;}
+
+    /// Return true if the checkpoint file exists.
+    bool Exists() const;
+
+    /// Read the checkpoint file.  This returns false if the file doesn't
+    /// exist, or isn't a valid checkpoint.
+    bool Read();
+
+    /// Write the checkpoint file.  This throws ECheckpointWriteFailed if the
+    /// file cannot be written.
+    void Write();
+
+    /// Set the input file that is being read, and the next entry in that
+    /// file that has not been processed.
+    void SetInput(int index, const std::string& name, long long nextEntry);
+
+    /// The index of the input file on the command line.
+    int GetInputIndex() const {return fInputIndex;}
+
+    /// The name of the input file being read.
+    const std::string& GetInputName() const {return fInputName;}
+
+    /// The next entry of the input file to be processed.
+    long long GetNextEntry() const {return fNextEntry;}
+
+    /// Set the total number of events read and written by the event loop.
+    void SetTotals(int read, int written);
+
+    /// The number of events read by the event loop.
+    int GetTotalRead() const {return fTotalRead;}
+
+    /// The number of events written by the event loop.
+    int GetTotalWritten() const {return fTotalWritten;}
+
+    /// Set the number of events in an output file.
+    void SetOutput(const std::string& name, int entries);
+
+    /// Return the number of events in an output file, or -1 if the output
+    /// file isn't in the checkpoint.
+    int GetOutput(const std::string& name) const;
+
+    /// Flag that the event loop finished normally.
+    void SetFinished(bool finished) {fFinished = finished;}
+
+    /// Return true if the event loop finished normally.
+    bool IsFinished() const {return fFinished;}
+
+private:
+    std::string fFileName;
+    int fInputIndex;
+    std::string fInputName;
+    long long fNextEntry;
+    int fTotalRead;
+    int fTotalWritten;
+    std::map<std::string,int> fOutputs;
+    bool fFinished;
+};
+#endif
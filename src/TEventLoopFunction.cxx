@@ -1,7 +1,13 @@
 #include "TCaptLog.hxx"
 #include "TEventLoopFunction.hxx"
+#include "TEventFolder.hxx"
 
-CP::TEventLoopFunction::TEventLoopFunction() {}
+namespace {
+    /// The worker index for the current thread.
+    thread_local int gWorkerIndex = -1;
+}
+
+CP::TEventLoopFunction::TEventLoopFunction(): fUsesAccept(true) {}
 
 CP::TEventLoopFunction::~TEventLoopFunction() {}
 
@@ -11,11 +17,31 @@ bool CP::TEventLoopFunction::operator () (TEvent& event) {
     return true;
 }
 
+bool CP::TEventLoopFunction::Accept(const TEventContext& context) {
+    fUsesAccept = false;
+    return true;
+}
+
 int CP::TEventLoopFunction::Process(TEvent& event, int outputFiles) {
     if (operator()(event)) return 0;
     return -1;
 }
 
+std::vector<int> 
+CP::TEventLoopFunction::ProcessBatch(std::vector<TEvent*>& events,
+                                     int outputFiles) {
+    std::vector<int> saveEvents;
+    for (std::vector<TEvent*>::iterator event = events.begin();
+         event != events.end(); ++event) {
+        // Make the event current so that code using
+        // TEventFolder::GetCurrentEvent() (e.g. the geometry lookups) sees
+        // the event being processed instead of the last event read.
+        CP::TEventFolder::RegisterEvent(*event);
+        saveEvents.push_back(Process(**event, outputFiles));
+    }
+    return saveEvents;
+}
+
 void CP::TEventLoopFunction::Initialize(void) {}
 
 void CP::TEventLoopFunction::BeginFile(TVInputFile *const) {}
@@ -24,6 +50,18 @@ void CP::TEventLoopFunction::EndFile(TVInputFile *const) {}
 
 void CP::TEventLoopFunction::Finalize(TRootOutput * const value) {}
 
+bool CP::TEventLoopFunction::IsThreadSafe(void) const {return false;}
+
+void CP::TEventLoopFunction::InitializeWorker(int worker) {}
+
+void CP::TEventLoopFunction::FinalizeWorker(int worker) {}
+
+int CP::TEventLoopFunction::GetWorkerIndex(void) {return gWorkerIndex;}
+
+void CP::TEventLoopFunction::SetWorkerIndex(int worker) {
+    gWorkerIndex = worker;
+}
+
 void CP::TEventLoopFunction::Usage(void) {}
 
 bool CP::TEventLoopFunction::SetOption(std::string option,
@@ -1,6 +1,8 @@
 #ifndef TEventLoopFunction_hxx_seen
 #define TEventLoopFunction_hxx_seen
 
+#include <vector>
+
 #include "ECore.hxx"
 
 #include "TEvent.hxx"
@@ -77,6 +79,23 @@ public:
     /// operator, it should not define the Process() method.
     virtual bool operator () (TEvent& event);
 
+    /// Called with the context of an event before the event is read, and
+    /// returns true if the event should be read and processed.  This is
+    /// only called when the input file can read the context without reading
+    /// the event (e.g. a file written by CP::TRootOutput), so the rejected
+    /// events are never read from the file.  Since it isn't called for all
+    /// input files, this is an optimization and the selection must be
+    /// repeated in Process() if it matters.  The default accepts every
+    /// event, and marks that the user code doesn't select events on their
+    /// context (see UsesAccept()), so an override must not call it.
+    virtual bool Accept(const TEventContext& context);
+
+    /// Return false once the default Accept() has been called.  The event
+    /// loop calls Accept() once with an empty context before the first input
+    /// file is opened (the result is ignored), and only reads the event
+    /// contexts from the input files when this returns true.
+    bool UsesAccept(void) const {return fUsesAccept;}
+
     /// Process a file and write into multiple output files.  This is called
     /// for each event inside the event loop, and return the index of the file
     /// to save the event into (starting from zero for the first file on the
@@ -90,6 +109,22 @@ public:
     /// file is determined by the order on the command line.
     virtual int Process(TEvent& event, int outputFiles);
 
+    /// Process a batch of events and return the index of the output file for
+    /// each event in the batch (see Process()).  This is called instead of
+    /// Process() when the event loop is run with the "-B <cnt>" option, and
+    /// lets the user code work on several events at once (e.g. to
+    /// accumulate a calibration for all of the channels).  The batch has up
+    /// to "cnt" events in the order that they were read, and the events are
+    /// written after this returns.  A missing return value means the event
+    /// isn't saved.  If ENextEventLoopFile is thrown, none of the events in
+    /// the batch are saved.  The default makes each event the current event
+    /// (see TEventFolder::GetCurrentEvent()) and calls Process() for it.  The
+    /// current event is the last one read when this is called, so an
+    /// override should use CP::TEventFolder::RegisterEvent() the same way
+    /// before it uses code that depends on the current event.
+    virtual std::vector<int> ProcessBatch(std::vector<TEvent*>& events,
+                                          int outputFiles);
+
     /// Called after the arguments are processes, and before the first event
     /// is read.  Any output files are open before Initialize is called, so
     /// histograms created in this method are saved.  All histograms being
@@ -164,6 +199,43 @@ public:
     /// documents that the method *must* not change the value of the pointer.
     virtual void Finalize(TRootOutput * const file);
 
+    /// Return true if the Process() method can be called simultaneously from
+    /// several threads.  The default is false, and the event loop will only
+    /// run the user code on several threads (the "-j" option) when a daughter
+    /// class explicitly declares that it is thread safe by overriding this
+    /// method.  Thread safe user code must not change shared state in
+    /// Process() without locking it, and must not depend on the ROOT global
+    /// pointers (e.g. gFile, gDirectory, or gGeoManager navigation state).
+    /// The event being processed is the current event on the worker thread
+    /// (see CP::TEventFolder::GetCurrentEvent()).
+    virtual bool IsThreadSafe(void) const;
+
+    /// Called once on each worker thread before the first event is processed
+    /// by that thread.  This is only called when the event loop is running
+    /// with more than one thread, and is called after Initialize().  The
+    /// worker index runs from zero to the number of threads minus one, and is
+    /// also available during Process() from GetWorkerIndex().  The usual use
+    /// is to create per-worker histograms that are filled without locking.
+    /// Objects created here are not attached to the output file (gDirectory
+    /// is private to each thread).
+    virtual void InitializeWorker(int worker);
+
+    /// Called once on each worker thread after the last event has been
+    /// processed, and before Finalize() is called.  This is only called when
+    /// the event loop is running with more than one thread.  The per-worker
+    /// results can be merged here (with locking), or in Finalize() which is
+    /// called on the main thread after all of the workers have finished.
+    virtual void FinalizeWorker(int worker);
+
+    /// Return the index of the worker thread that is calling this method, or
+    /// -1 if it is called outside of a worker thread (e.g. during a single
+    /// threaded event loop).
+    static int GetWorkerIndex(void);
+
+    /// Set the worker index for the calling thread.  This is used by the
+    /// event loop and should not be called by user code.
+    static void SetWorkerIndex(int worker);
+
     /// Called when there is a usage error.  This code should print a usage
     /// message and then return. 
     virtual void Usage(void);
@@ -182,5 +254,9 @@ public:
     /// failure).
     virtual bool SetOption(std::string option,std::string value="");
 
+private:
+    /// Flag that Accept() has been overridden (cleared by the default
+    /// Accept()).
+    bool fUsesAccept;
 };
 #endif
@@ -0,0 +1,153 @@
+#include "TEventLoopMetrics.hxx"
+#include "TCaptLog.hxx"
+
+#include <TFile.h>
+#include <TSystem.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    /// Write a string as a quoted JSON string.
+    void WriteJSONString(std::ostream& output, const std::string& value) {
+        output << '"';
+        for (std::string::const_iterator c = value.begin();
+             c != value.end(); ++c) {
+            switch (*c) {
+            case '"': output << "\\\""; break;
+            case '\\': output << "\\\\"; break;
+            case '\n': output << "\\n"; break;
+            case '\t': output << "\\t"; break;
+            default:
+                if (0 <= *c && *c < 0x20) {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", *c);
+                    output << escape;
+                }
+                else output << *c;
+            }
+        }
+        output << '"';
+    }
+}
+
+CP::TEventLoopMetrics::TEventLoopMetrics(const std::string& fileName)
+    : fFileName(fileName), fInterval(10.0), fExpectedEvents(-1),
+      fTotalRead(0), fTotalWritten(0),
+      fStartBytesRead(TFile::GetFileBytesRead()),
+      fStartBytesWritten(TFile::GetFileBytesWritten()),
+      fStart(std::chrono::steady_clock::now()),
+      fLastWrite(fStart) {}
+
+CP::TEventLoopMetrics::~TEventLoopMetrics() {}
+
+void CP::TEventLoopMetrics::BeginFile(const std::string& name) {
+    FileCounts counts;
+    counts.name = name;
+    counts.read = 0;
+    counts.written = 0;
+    fFiles.push_back(counts);
+}
+
+void CP::TEventLoopMetrics::SetFileCounts(int read, int written) {
+    if (fFiles.empty()) return;
+    fFiles.back().read = read;
+    fFiles.back().written = written;
+}
+
+void CP::TEventLoopMetrics::SetTotals(int read, int written) {
+    fTotalRead = read;
+    fTotalWritten = written;
+}
+
+void CP::TEventLoopMetrics::Update() {
+    std::chrono::duration<double> sinceWrite
+        = std::chrono::steady_clock::now() - fLastWrite;
+    if (sinceWrite.count() < fInterval) return;
+    Write();
+}
+
+void CP::TEventLoopMetrics::Write(bool finished) {
+    fLastWrite = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = fLastWrite - fStart;
+    double seconds = elapsed.count();
+    double perSecond = (seconds > 0) ? 1.0/seconds: 0.0;
+    const double megabyte = 1024.0*1024.0;
+    double bytesRead = TFile::GetFileBytesRead() - fStartBytesRead;
+    double bytesWritten = TFile::GetFileBytesWritten() - fStartBytesWritten;
+
+    ProcInfo_t info;
+    gSystem->GetProcInfo(&info);
+
+    std::string tmpName = fFileName + ".tmp";
+    {
+        std::ofstream output(tmpName.c_str());
+        output << "{" << std::endl;
+        output << "  \"status\": \""
+               << (finished ? "finished": "running") << "\"," << std::endl;
+        output << "  \"elapsed_seconds\": " << seconds << "," << std::endl;
+        output << "  \"events_read\": " << fTotalRead << "," << std::endl;
+        output << "  \"events_written\": " << fTotalWritten << ","
+               << std::endl;
+        output << "  \"events_per_second\": " << fTotalRead*perSecond << ","
+               << std::endl;
+        output << "  \"input_mb_per_second\": "
+               << bytesRead/megabyte*perSecond << "," << std::endl;
+        output << "  \"output_mb_per_second\": "
+               << bytesWritten/megabyte*perSecond << "," << std::endl;
+        output << "  \"rss_mb\": " << info.fMemResident/1024.0 << ","
+               << std::endl;
+        output << "  \"expected_events\": ";
+        if (fExpectedEvents < 0) output << "null";
+        else output << fExpectedEvents;
+        output << "," << std::endl;
+        output << "  \"eta_seconds\": ";
+        if (finished) output << 0;
+        else if (fExpectedEvents < 0 || fTotalRead < 1) output << "null";
+        else {
+            double remaining = fExpectedEvents - fTotalRead;
+            if (remaining < 0) remaining = 0;
+            output << remaining*seconds/fTotalRead;
+        }
+        output << "," << std::endl;
+        output << "  \"files\": [";
+        for (std::size_t f = 0; f < fFiles.size(); ++f) {
+            if (f > 0) output << ",";
+            output << std::endl << "    {\"name\": ";
+            WriteJSONString(output, fFiles[f].name);
+            output << ", \"events_read\": " << fFiles[f].read
+                   << ", \"events_written\": " << fFiles[f].written << "}";
+        }
+        if (!fFiles.empty()) output << std::endl << "  ";
+        output << "]" << std::endl;
+        output << "}" << std::endl;
+        output.close();
+        if (output.fail()) {
+            CaptError("Cannot write metrics " << tmpName);
+            return;
+        }
+    }
+    if (std::rename(tmpName.c_str(), fFileName.c_str()) != 0) {
+        CaptError("Cannot rename metrics to " << fFileName);
+    }
+}
+
+bool CP::TEventLoopMetrics::ReadTotals(const std::string& fileName,
+                                       int& read, int& written) {
+    std::ifstream input(fileName.c_str());
+    if (!input) return false;
+    std::stringstream contents;
+    contents << input.rdbuf();
+    const std::string text = contents.str();
+    const char* fields[2] = {"\"events_read\":", "\"events_written\":"};
+    int* values[2] = {&read, &written};
+    for (int i = 0; i < 2; ++i) {
+        std::string::size_type pos = text.find(fields[i]);
+        if (pos == std::string::npos) return false;
+        std::istringstream value(text.substr(pos + std::strlen(fields[i])));
+        if (!(value >> *values[i])) return false;
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef TEventLoopMetrics_hxx_seen
+#define TEventLoopMetrics_hxx_seen
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace CP {
+    class TEventLoopMetrics;
+};
+
+/// Write the progress of an event loop to a small JSON file so that a
+/// workflow manager can follow a job without parsing the log (the eventLoop
+/// "--metrics <file>" option).  The file is rewritten at most once every
+/// interval (10 seconds by default) while events are processed, and once
+/// more when the event loop finishes.  It is written to a temporary name
+/// and then renamed, so a reader never sees a partial file.  The file looks
+/// like
+///
+/// \code
+/// {
+///   "status": "running",
+///   "elapsed_seconds": 120.5,
+///   "events_read": 1500,
+///   "events_written": 1200,
+///   "events_per_second": 12.4,
+///   "input_mb_per_second": 3.2,
+///   "output_mb_per_second": 2.1,
+///   "rss_mb": 812.4,
+///   "expected_events": 10000,
+///   "eta_seconds": 685.5,
+///   "files": [
+///     {"name": "input.root", "events_read": 1500, "events_written": 1200}
+///   ]
+/// }
+/// \endcode
+///
+/// The rates are averaged from the start of the event loop.  The
+/// "expected_events" and "eta_seconds" fields are null when the number of
+/// events to be processed isn't known.  The status is "finished" in the
+/// last version of the file.  When the events are processed by several
+/// worker processes (eventLoop -P), each worker writes its own file (named
+/// "<file>.worker<n>.<pid>"), and the parent process writes the totals of the
+/// workers to the requested file.  The "files" list is then empty, and the
+/// input and output rates only count the files read and written by the
+/// parent.
+class CP::TEventLoopMetrics {
+public:
+    /// Create the metrics that are saved in a file.
+    explicit TEventLoopMetrics(const std::string& fileName);
+    ~TEventLoopMetrics();
+
+    /// Return the name of the metrics file.
+    const std::string& GetFileName() const {return fFileName;}
+
+    /// Set the minimum time (in seconds) between writes of the file.
+    void SetInterval(double seconds) {fInterval = seconds;}
+
+    /// Set the number of events the event loop expects to read.  This is
+    /// used to estimate the time to completion.  A negative value means
+    /// that the number of events isn't known.
+    void SetExpectedEvents(long long events) {fExpectedEvents = events;}
+
+    /// Start counting events for a new input file.
+    void BeginFile(const std::string& name);
+
+    /// Set the number of events read from, and written for, the current
+    /// input file.
+    void SetFileCounts(int read, int written);
+
+    /// Set the total number of events read and written by the event loop.
+    void SetTotals(int read, int written);
+
+    /// Write the file if the interval has passed since it was last written.
+    void Update();
+
+    /// Write the file.  If finished is true, the status is "finished".
+    /// Problems writing the file are logged, but don't stop the event loop.
+    void Write(bool finished = false);
+
+    /// Read the total number of events read and written from a metrics
+    /// file.  This is used to combine the files of the worker processes
+    /// (eventLoop -P).  This returns false if the file can't be read.
+    static bool ReadTotals(const std::string& fileName,
+                           int& read, int& written);
+
+private:
+    /// The events read and written for one input file.
+    struct FileCounts {
+        std::string name;
+        int read;
+        int written;
+    };
+
+    std::string fFileName;
+    double fInterval;
+    long long fExpectedEvents;
+    int fTotalRead;
+    int fTotalWritten;
+    std::vector<FileCounts> fFiles;
+
+    /// The bytes read and written by ROOT files when the metrics started.
+    long long fStartBytesRead;
+    long long fStartBytesWritten;
+
+    std::chrono::steady_clock::time_point fStart;
+    std::chrono::steady_clock::time_point fLastWrite;
+};
+#endif
@@ -0,0 +1,178 @@
+#include "TEventLoopProcesses.hxx"
+#include "TEventLoopSlice.hxx"
+#include "TEventLoopMetrics.hxx"
+#include "TEventFileMerger.hxx"
+#include "TEvent.hxx"
+#include "TVInputFile.hxx"
+#include "TInputManager.hxx"
+#include "TManager.hxx"
+#include "TCaptLog.hxx"
+
+#include <sys/wait.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+CP::TEventLoopProcesses::TEventLoopProcesses(int processes)
+    : fProcessCount(processes), fWorker(-1), fParent(getpid()) {}
+
+CP::TEventLoopProcesses::~TEventLoopProcesses() {}
+
+void CP::TEventLoopProcesses::LoadGeometry(const std::string& fileType,
+                                           char** inputNames,
+                                           const CP::TEventLoopSlice& slice) {
+    if (slice.GetEntries() < 1) return;
+    int index = slice.FindInput(slice.GetBegin());
+    try {
+        std::unique_ptr<CP::TVInputFile> input(
+            CP::TManager::Get().Input().Builder(fileType.c_str()).Open(
+                inputNames[index]));
+        input->Seek(slice.GetBegin() - slice.GetInputOffset(index));
+        std::unique_ptr<CP::TEvent> event(input->NextEvent());
+        if (event) CP::TManager::Get().Geometry(event.get());
+        event.reset(NULL);
+        input->CloseFile();
+    }
+    catch (...) {
+        CaptWarn("Geometry not loaded before starting the workers");
+    }
+}
+
+int CP::TEventLoopProcesses::Fork() {
+    for (int i = 0; i<fProcessCount; ++i) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            CaptError("ERROR: Cannot fork worker process " << i);
+            std::exit(1);
+        }
+        if (pid == 0) {
+            fWorker = i;
+            fWorkerPids.clear();
+            return fWorker;
+        }
+        fWorkerPids.push_back(pid);
+    }
+    CaptLog("Processing events with " << fProcessCount << " processes");
+    return -1;
+}
+
+std::string CP::TEventLoopProcesses::GetWorkerName(const std::string& name,
+                                                   int worker) const {
+    std::ostringstream workerName;
+    workerName << name << ".worker" << worker << "." << fParent;
+    return workerName.str();
+}
+
+void CP::TEventLoopProcesses::UpdateMetrics(CP::TEventLoopMetrics* metrics) {
+    int totalRead = 0;
+    int totalWritten = 0;
+    for (int i = 0; i<fProcessCount; ++i) {
+        int read = 0;
+        int written = 0;
+        if (!CP::TEventLoopMetrics::ReadTotals(
+                GetWorkerName(metrics->GetFileName(), i),
+                read, written)) continue;
+        totalRead += read;
+        totalWritten += written;
+    }
+    metrics->SetTotals(totalRead, totalWritten);
+}
+
+int CP::TEventLoopProcesses::Wait(CP::TEventLoopMetrics* metrics) {
+    int exitStatus = 0;
+    std::vector<pid_t> running(fWorkerPids);
+    while (!running.empty()) {
+        std::vector<pid_t>::iterator pid = running.begin();
+        while (pid != running.end()) {
+            int status = 0;
+            pid_t result = waitpid(*pid, &status, WNOHANG);
+            if (result == 0) {
+                ++pid;
+                continue;
+            }
+            if (result < 0) {
+                CaptError("ERROR: Lost worker process " << *pid);
+                if (!exitStatus) exitStatus = 5;
+                pid = running.erase(pid);
+                continue;
+            }
+            int workerStatus = 5;
+            if (WIFEXITED(status)) workerStatus = WEXITSTATUS(status);
+            if (workerStatus != 0) {
+                CaptError("ERROR: Worker process " << *pid
+                          << " failed with status " << workerStatus);
+                if (!exitStatus) exitStatus = workerStatus;
+            }
+            pid = running.erase(pid);
+        }
+        if (running.empty()) break;
+        if (metrics) {
+            UpdateMetrics(metrics);
+            metrics->Update();
+        }
+        sleep(1);
+    }
+    return exitStatus;
+}
+
+void CP::TEventLoopProcesses::RemoveWorkerFiles(
+    const std::vector<std::string>& names) {
+    for (int i = 0; i<fProcessCount; ++i) {
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::remove(GetWorkerName(names[n], i).c_str());
+        }
+    }
+}
+
+int CP::TEventLoopProcesses::Finish(
+    const std::vector<std::string>& outputNames,
+    CP::TEventLoopMetrics* metrics) {
+    // The temporary files written by the workers are removed when the job
+    // finishes, even if it fails.
+    std::vector<std::string> workerFiles(outputNames);
+    if (metrics) workerFiles.push_back(metrics->GetFileName());
+
+    int exitStatus = Wait(metrics);
+    if (metrics) {
+        UpdateMetrics(metrics);
+        metrics->Write(true);
+    }
+
+    // The outputs of a failed job are incomplete, so they aren't merged.
+    if (exitStatus > 0) {
+        RemoveWorkerFiles(workerFiles);
+        return exitStatus;
+    }
+
+    // The worker outputs hold consecutive blocks of entries, so they are
+    // fast cloned into the output in worker order.
+    for (std::size_t f = 0; f < outputNames.size(); ++f) {
+        CP::TEventFileMerger merger;
+        for (int i = 0; i<fProcessCount; ++i) {
+            merger.AddInput(GetWorkerName(outputNames[f], i));
+        }
+        Long64_t written = 0;
+        try {
+            written = merger.Merge(outputNames[f]);
+        }
+        catch (CP::EEventFileMergerOutput&) {
+            std::cerr << "ERROR: Output file not open" << std::endl;
+            RemoveWorkerFiles(workerFiles);
+            return 2;
+        }
+        if (!merger.GetFailedInputs().empty()) {
+            CaptError("ERROR: Worker outputs not merged into "
+                      << outputNames[f]);
+            exitStatus = 5;
+        }
+        std::cout << "Total Events Written: " << written
+                  << " to " << outputNames[f]
+                  << std::endl;
+    }
+    RemoveWorkerFiles(workerFiles);
+    return exitStatus;
+}
@@ -0,0 +1,98 @@
+#ifndef TEventLoopProcesses_hxx_seen
+#define TEventLoopProcesses_hxx_seen
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/types.h>
+
+namespace CP {
+    class TEventLoopProcesses;
+    class TEventLoopSlice;
+    class TEventLoopMetrics;
+};
+
+/// Run an event loop in several forked worker processes (the eventLoop "-P
+/// <procs>" option).  The geometry is loaded before the workers are forked
+/// so that they share it.  Each worker processes one contiguous block of the
+/// slice of entries (see CP::TEventLoopSlice::Divide()), and writes each
+/// output into a temporary file named "<file>.worker<n>.<pid>" where <pid>
+/// is the process id of the parent (so files left by a job that was killed
+/// don't stop it from being run again).  The parent waits for the workers,
+/// and then fast clones the temporary files into the requested outputs in
+/// worker order with CP::TEventFileMerger, so the events are in entry
+/// order.  The temporary files are removed when the parent finishes, even
+/// if a worker fails.
+///
+/// \code
+/// CP::TEventLoopProcesses processes(4);
+/// processes.LoadGeometry(fileType, inputNames, slice);
+/// if (processes.Fork() < 0) {
+///     // The parent process.
+///     std::exit(processes.Finish(outputNames, metrics));
+/// }
+/// // A worker process.
+/// slice.Divide(processes.GetWorker(), processes.GetProcessCount());
+/// \endcode
+class CP::TEventLoopProcesses {
+public:
+    /// Create the driver for a number of worker processes.
+    explicit TEventLoopProcesses(int processes);
+    ~TEventLoopProcesses();
+
+    /// Return the number of worker processes.
+    int GetProcessCount() const {return fProcessCount;}
+
+    /// Read the first event of the slice and load its geometry.  This is
+    /// done before the workers are forked so that they share the geometry.
+    /// Problems are not fatal since the workers load the geometry
+    /// themselves.
+    void LoadGeometry(const std::string& fileType, char** inputNames,
+                      const CP::TEventLoopSlice& slice);
+
+    /// Fork the worker processes.  This returns the index of the worker (0
+    /// to GetProcessCount()-1) in a worker process, and -1 in the parent.
+    /// The event loop exits if a worker can't be forked.
+    int Fork();
+
+    /// Return the index of this worker process, or -1 in the parent.
+    int GetWorker() const {return fWorker;}
+
+    /// Return the name of the temporary file that continues a file (an
+    /// output or the metrics file) in a worker process.
+    std::string GetWorkerName(const std::string& name, int worker) const;
+
+    /// Finish the job in the parent process and return its exit status.
+    /// This waits for the workers, writing their total progress to the
+    /// metrics file (if there is one), and then merges the worker outputs
+    /// into the named outputs.  The outputs aren't merged if a worker
+    /// fails.  The temporary files are always removed.
+    int Finish(const std::vector<std::string>& outputNames,
+               CP::TEventLoopMetrics* metrics);
+
+private:
+    /// Wait for the worker processes to finish and return the first
+    /// non-zero exit status.  The metrics (if any) are updated about once a
+    /// second while the workers are running.
+    int Wait(CP::TEventLoopMetrics* metrics);
+
+    /// Set the totals of the metrics from the metrics files of the workers.
+    void UpdateMetrics(CP::TEventLoopMetrics* metrics);
+
+    /// Remove the temporary files written by the workers.
+    void RemoveWorkerFiles(const std::vector<std::string>& names);
+
+    /// The number of worker processes.
+    int fProcessCount;
+
+    /// The index of this worker process, or -1 in the parent.
+    int fWorker;
+
+    /// The process id of the parent.
+    pid_t fParent;
+
+    /// The process ids of the workers (only filled in the parent).
+    std::vector<pid_t> fWorkerPids;
+};
+#endif
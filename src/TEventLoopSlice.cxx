@@ -0,0 +1,88 @@
+#include "TEventLoopSlice.hxx"
+
+#include <algorithm>
+#include <sstream>
+
+CP::TEventLoopSlice::TEventLoopSlice()
+    : fTotalEntries(0), fBegin(0), fEnd(0), fShard(-1), fShards(0) {}
+
+CP::TEventLoopSlice::~TEventLoopSlice() {}
+
+void CP::TEventLoopSlice::AddInput(Long64_t entries) {
+    fOffsets.push_back(fTotalEntries);
+    fTotalEntries += entries;
+    fBegin = 0;
+    fEnd = fTotalEntries;
+}
+
+int CP::TEventLoopSlice::FindInput(Long64_t entry) const {
+    if (entry < 0 || fTotalEntries <= entry) return -1;
+    std::vector<Long64_t>::const_iterator next
+        = std::upper_bound(fOffsets.begin(), fOffsets.end(), entry);
+    return (next - fOffsets.begin()) - 1;
+}
+
+bool CP::TEventLoopSlice::SetEntries(const std::string& range) {
+    std::size_t sep = range.find(':');
+    if (sep == std::string::npos) return false;
+    std::string first = range.substr(0,sep);
+    std::string last = range.substr(sep+1);
+    Long64_t begin = fBegin;
+    Long64_t end = fEnd;
+    if (!first.empty()) std::istringstream(first) >> begin;
+    if (!last.empty()) std::istringstream(last) >> end;
+    fBegin = std::max((Long64_t) 0, std::min(begin, fTotalEntries));
+    fEnd = std::max(fBegin, std::min(end, fTotalEntries));
+    return true;
+}
+
+bool CP::TEventLoopSlice::SetShard(const std::string& shard) {
+    std::size_t sep = shard.find('/');
+    int part = -1;
+    int parts = 0;
+    if (sep != std::string::npos) {
+        std::istringstream(shard.substr(0,sep)) >> part;
+        std::istringstream(shard.substr(sep+1)) >> parts;
+    }
+    if (parts < 1 || part < 0 || parts <= part) return false;
+    Divide(part, parts);
+    fShard = part;
+    fShards = parts;
+    return true;
+}
+
+void CP::TEventLoopSlice::Divide(int part, int parts) {
+    Long64_t span = fEnd - fBegin;
+    Long64_t begin = fBegin + span*part/parts;
+    fEnd = fBegin + span*(part+1)/parts;
+    fBegin = begin;
+}
+
+void CP::TEventLoopSlice::Skip(Long64_t entries) {
+    fBegin = std::min(fBegin + std::max((Long64_t) 0, entries), fEnd);
+}
+
+void CP::TEventLoopSlice::Limit(Long64_t entries) {
+    fEnd = std::min(fEnd, fBegin + std::max((Long64_t) 0, entries));
+}
+
+bool CP::TEventLoopSlice::GetInputEntries(int input, Long64_t& begin,
+                                          Long64_t& end) const {
+    Long64_t offset = fOffsets[input];
+    Long64_t next = (input+1 < (int) fOffsets.size())
+        ? fOffsets[input+1] : fTotalEntries;
+    begin = std::max(fBegin, offset) - offset;
+    end = std::min(fEnd, next) - offset;
+    return begin < end;
+}
+
+std::string CP::TEventLoopSlice::GetDescription() const {
+    std::ostringstream description;
+    if (fShards > 0) {
+        description << "shard " << fShard << "/" << fShards << " ";
+    }
+    description << "entries " << fBegin << ":" << fEnd
+                << " of " << fTotalEntries
+                << " in " << fOffsets.size() << " files";
+    return description.str();
+}
@@ -0,0 +1,108 @@
+#ifndef TEventLoopSlice_hxx_seen
+#define TEventLoopSlice_hxx_seen
+
+#include <string>
+#include <vector>
+
+#include <Rtypes.h>
+
+namespace CP {
+    class TEventLoopSlice;
+};
+
+/// The slice of the entries processed by an event loop when it is one of
+/// several jobs (or worker processes) reading the same input files (the
+/// eventLoop "--shard <k>/<N>" and "--entries <a>:<b>" options, and "-P").
+/// The entries are counted across all of the input files in the order they
+/// were added, so each job gets a disjoint and deterministic range of
+/// entries, and the ranges of the N shards cover all of the entries.  The
+/// slice starts as all of the entries and is narrowed by SetEntries(), and
+/// then by SetShard() (or Divide()).
+///
+/// \code
+/// CP::TEventLoopSlice slice;
+/// slice.AddInput(1000);   // Entries 0 to 999.
+/// slice.AddInput(500);    // Entries 1000 to 1499.
+/// slice.SetShard("1/3");  // Entries 500 to 999.
+/// \endcode
+class CP::TEventLoopSlice {
+public:
+    TEventLoopSlice();
+    ~TEventLoopSlice();
+
+    /// Add the next input file with the number of entries in it.  The slice
+    /// is reset to all of the entries.
+    void AddInput(Long64_t entries);
+
+    /// Return the number of input files.
+    int GetInputCount() const {return fOffsets.size();}
+
+    /// Return the number of entries in all of the input files.
+    Long64_t GetTotalEntries() const {return fTotalEntries;}
+
+    /// Return the first entry of an input file counted across all of the
+    /// input files.
+    Long64_t GetInputOffset(int input) const {return fOffsets[input];}
+
+    /// Return the input file with an entry, or -1 if it isn't in any of the
+    /// input files.
+    int FindInput(Long64_t entry) const;
+
+    /// Only keep the entries from "<a>:<b>" (entries a to b-1).  Either end
+    /// can be left out (e.g. "100:" or ":100"), and the range is clipped to
+    /// the entries in the files.  This returns false if the range doesn't
+    /// have a colon.
+    bool SetEntries(const std::string& range);
+
+    /// Only keep the k'th of N equal blocks of the slice given as "<k>/<N>"
+    /// (k is from 0 to N-1).  This returns false if the shard isn't valid.
+    bool SetShard(const std::string& shard);
+
+    /// Only keep the part'th of "parts" consecutive blocks of the slice.
+    /// The blocks differ in size by at most one entry.
+    void Divide(int part, int parts);
+
+    /// Remove entries from the start of the slice.
+    void Skip(Long64_t entries);
+
+    /// Only keep the first "entries" entries of the slice.
+    void Limit(Long64_t entries);
+
+    /// Return the first entry in the slice.
+    Long64_t GetBegin() const {return fBegin;}
+
+    /// Return the entry after the last entry in the slice.
+    Long64_t GetEnd() const {return fEnd;}
+
+    /// Return the number of entries in the slice.
+    Long64_t GetEntries() const {return fEnd - fBegin;}
+
+    /// Find the entries of an input file that are in the slice.  The entries
+    /// are counted from the start of the input file, and run from begin to
+    /// end-1.  This returns false if none of the entries are in the slice.
+    bool GetInputEntries(int input, Long64_t& begin, Long64_t& end) const;
+
+    /// Return a description of the slice that is saved in the output files
+    /// (e.g. "shard 1/3 entries 500:1000 of 1500 in 2 files").
+    std::string GetDescription() const;
+
+private:
+    /// The first entry of each input file.
+    std::vector<Long64_t> fOffsets;
+
+    /// The number of entries in all of the input files.
+    Long64_t fTotalEntries;
+
+    /// The first entry in the slice.
+    Long64_t fBegin;
+
+    /// The entry after the last entry in the slice.
+    Long64_t fEnd;
+
+    /// The shard that was selected (negative if there isn't a shard).
+    int fShard;
+
+    /// The number of shards.
+    int fShards;
+};
+#endif
@@ -0,0 +1,105 @@
+#include <TEventLoopTiming.hxx>
+#include <TCaptLog.hxx>
+#include <TObjString.h>
+#include "TH1F.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+CP::TEventLoopTiming::TEventLoopTiming(): fEnabled(false) {
+    std::fill(fCurrent, fCurrent+kStageCount, 0.0);
+}
+
+CP::TEventLoopTiming::~TEventLoopTiming() {}
+
+void CP::TEventLoopTiming::Enable(bool enable) {
+    if (enable) CaptNamedInfo("TIME","Enabling timing of the event loop");
+    else CaptNamedInfo("TIME","Disabling timing of the event loop");
+    fEnabled = enable;
+}
+
+void CP::TEventLoopTiming::EndEvent() {
+    if (!fEnabled) return;
+    fEventTimes.push_back(std::vector<double>(fCurrent,fCurrent+kStageCount));
+    std::fill(fCurrent, fCurrent+kStageCount, 0.0);
+}
+
+const char* CP::TEventLoopTiming::GetStageName(int stage) {
+    switch (stage) {
+    case kNextEvent: return "NextEvent";
+    case kProcess: return "Process";
+    case kWriteGeometry: return "WriteGeometry";
+    case kWriteEvent: return "WriteEvent";
+    case kHandleCheck: return "HandleCheck";
+    }
+    return "Unknown";
+}
+
+void CP::TEventLoopTiming::Write(CP::TRootOutput* output) {
+    if (!fEnabled) return;
+
+    // Summarize the time spent in each stage.
+    int events = fEventTimes.size();
+    double total[kStageCount];
+    double peak[kStageCount];
+    double sum = 0.0;
+    for (int stage = 0; stage < kStageCount; ++stage) {
+        total[stage] = 0.0;
+        peak[stage] = 0.0;
+        for (std::vector< std::vector<double> >::iterator t
+                 = fEventTimes.begin();
+             t != fEventTimes.end(); ++t) {
+            total[stage] += (*t)[stage];
+            peak[stage] = std::max(peak[stage], (*t)[stage]);
+        }
+        sum += total[stage];
+    }
+
+    std::ostringstream summary;
+    summary << std::setw(14) << std::left << "Stage" << std::right
+            << std::setw(12) << "Total (s)"
+            << std::setw(14) << "Mean (ms)"
+            << std::setw(14) << "Max (ms)"
+            << std::setw(10) << "Percent"
+            << std::endl;
+    for (int stage = 0; stage < kStageCount; ++stage) {
+        summary << std::setw(14) << std::left << GetStageName(stage)
+                << std::right << std::fixed
+                << std::setw(12) << std::setprecision(3) << total[stage]
+                << std::setw(14) << std::setprecision(3)
+                << (events>0 ? 1000.0*total[stage]/events: 0.0)
+                << std::setw(14) << std::setprecision(3) << 1000.0*peak[stage]
+                << std::setw(10) << std::setprecision(1)
+                << (sum>0 ? 100.0*total[stage]/sum: 0.0)
+                << std::endl;
+    }
+
+    if (output && output->IsOpen()) {
+
+        CaptNamedInfo("TIME","Writing event loop timing histograms to file");
+        output->cd();
+
+        // Create a histogram for each stage with the time spent for each
+        // event in milliseconds.
+        for (int stage = 0; stage < kStageCount; ++stage) {
+            std::string name = std::string("timing_") + GetStageName(stage);
+            std::string title = std::string("Time spent in ") 
+                + GetStageName(stage);
+            TH1F hTime(name.c_str(), title.c_str(), events, 0, events);
+            hTime.GetXaxis()->SetTitle("Event");
+            hTime.GetYaxis()->SetTitle("Time (ms)");
+            for (int bin = 1; bin <= events; ++bin) {
+                hTime.SetBinContent(bin, 1000.0*fEventTimes[bin-1][stage]);
+            }
+            hTime.Write();
+        }
+
+        TObjString summaryString(summary.str().c_str());
+        summaryString.Write("timing_summary");
+    }
+
+    CaptNamedLog("TIME","Event loop timing for " << events << " events");
+    std::istringstream lines(summary.str());
+    std::string line;
+    while (std::getline(lines,line)) CaptNamedLog("TIME", line);
+}
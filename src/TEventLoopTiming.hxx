@@ -0,0 +1,89 @@
+#ifndef TEventLoopTiming_hxx_seen
+#define TEventLoopTiming_hxx_seen
+#include <TRootOutput.hxx>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace CP {
+    class TEventLoopTiming;
+};
+
+/// This utility class is used to time each stage of the event loop so that
+/// it is possible to tell if a job is limited by the input, the geometry,
+/// the user code, or the output.  By default, timing is disabled.  Enable
+/// by calling Enable().  The expected usage is to time each stage with a
+/// TEventLoopTiming::TScope object, to call EndEvent() once per event, and
+/// to call Write() once all of the events have been processed.  This class
+/// is used inside the default eventLoop (the "-T" option), so it isn't
+/// generally used outside of this library.
+class CP::TEventLoopTiming {
+public:
+    /// The stages of the event loop that are timed.
+    enum Stage {
+        kNextEvent = 0,
+        kProcess,
+        kWriteGeometry,
+        kWriteEvent,
+        kHandleCheck,
+        kStageCount
+    };
+
+    /// Time a stage from construction until the object goes out of scope.
+    /// This does nothing if the timing is disabled.
+    class TScope {
+    public:
+        TScope(TEventLoopTiming& timing, Stage stage)
+            : fTiming(timing), fStage(stage) {
+            if (fTiming.fEnabled) fStart = std::chrono::steady_clock::now();
+        }
+        ~TScope() {
+            if (!fTiming.fEnabled) return;
+            std::chrono::duration<double> elapsed
+                = std::chrono::steady_clock::now() - fStart;
+            fTiming.fCurrent[fStage] += elapsed.count();
+        }
+    private:
+        TEventLoopTiming& fTiming;
+        Stage fStage;
+        std::chrono::steady_clock::time_point fStart;
+    };
+
+    /// Construct the timing class with timing disabled.
+    TEventLoopTiming();
+    ~TEventLoopTiming();
+
+    /// Enable the timing of the event loop stages.  If this is not called,
+    /// the TScope objects, EndEvent() and Write() have no effect.  This can
+    /// be called with a bool argument to set the enabled flag.
+    void Enable(bool enable = true);
+
+    /// Return true if the timing is enabled.
+    bool IsEnabled() const {return fEnabled;}
+
+    /// Save the time spent in each stage since the last call as the times
+    /// for one event.  Time spent outside of an event (e.g. reading the
+    /// first event of a file) is added to the next event.
+    void EndEvent();
+
+    /// Return the name of a stage.
+    static const char* GetStageName(int stage);
+
+    /// Write histograms of the time spent in each stage for every event to
+    /// the top-level directory of the output file (timing_NextEvent,
+    /// timing_Process, &c), and write a summary table as the
+    /// "timing_summary" string.  The summary is also written to the log.  If
+    /// Enable() has not been called, this function does nothing.
+    void Write(CP::TRootOutput* output);
+
+private:
+    /// Whether to time the event loop stages.  Set using Enable().
+    bool fEnabled;
+
+    /// The time (in seconds) spent in each stage for the current event.
+    double fCurrent[kStageCount];
+
+    /// The time (in seconds) spent in each stage for every event.
+    std::vector< std::vector<double> > fEventTimes;
+};
+#endif
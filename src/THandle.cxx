@@ -1,6 +1,8 @@
 #include <iostream>
 #include <map>
 #include <set>
+#include <atomic>
+#include <mutex>
 
 #include <TROOT.h>
 #include <TClass.h>
@@ -10,19 +12,28 @@
 #include "TCaptLog.hxx"
 
 namespace {
-    int gHandleBaseCount = 0;
+    // The handle count is atomic since events may be created and destroyed
+    // on several threads by a multi-threaded event loop.
+    std::atomic<int> gHandleBaseCount(0);
     int gLastHandleCount = 0;
     std::set<CP::THandleBase*> *gHandleSet = NULL;
+    std::mutex gHandleSetMutex;
 }
 
 ClassImp(CP::THandleBase);
 CP::THandleBase::THandleBase() : fCount(0), fHandleCount(0) {
     ++gHandleBaseCount;
-    if (gHandleSet) gHandleSet->insert(this);
+    if (gHandleSet) {
+        std::lock_guard<std::mutex> lock(gHandleSetMutex);
+        gHandleSet->insert(this);
+    }
 }
 CP::THandleBase::~THandleBase() {
     --gHandleBaseCount;
-    if (gHandleSet) gHandleSet->erase(this);
+    if (gHandleSet) {
+        std::lock_guard<std::mutex> lock(gHandleSetMutex);
+        gHandleSet->erase(this);
+    }
 }
 
 ClassImp(CP::THandleBaseDeletable);
@@ -24,6 +24,7 @@ namespace CP {
     class TDigitManager;
     class TGeomIdManager;
     class TRootInput;
+    class TStreamInput;
     class TGeometryId;
     class TInputManager;
 
@@ -61,6 +62,7 @@ namespace CP {
 ///
 class CP::TManager {
     friend class CP::TRootInput;
+    friend class CP::TStreamInput;
     friend class CP::TGeomIdManager;
 
 public:
@@ -329,8 +331,8 @@ private:
     std::pair<CP::TGeometryId,TGeoMatrix*> Alignment(const CP::TEvent* event);
     
     /// Set the current input file for the data base.  This must be set for
-    /// many of the methods to work correctly.  This is used by TRootInput to
-    /// notify TManager when the input file changes.
+    /// many of the methods to work correctly.  This is used by TRootInput
+    /// (and TStreamInput) to notify TManager when the input file changes.
     void SetCurrentInputFile(TFile* input);
     
     /// Get the current input event file.  This is used by TGeomIdManager to
@@ -0,0 +1,107 @@
+#include "TOutputRollover.hxx"
+#include "TRootOutput.hxx"
+#include "TCaptLog.hxx"
+
+#include <TClass.h>
+#include <TH1.h>
+#include <TGraph2D.h>
+#include <TList.h>
+
+#include <iomanip>
+#include <sstream>
+
+CP::TOutputRollover::TOutputRollover(
+    std::vector<CP::TRootOutput*>& outputFiles,
+    std::vector<std::string>& outputNames,
+    const Opener& open)
+    : fOutputFiles(outputFiles), fOutputNames(outputNames), fOpen(open),
+      fMaxSize(0), fMaxEvents(0), fBaseNames(outputNames),
+      fPieces(outputFiles.size(), 0), fPieceEvents(outputFiles.size(), 0),
+      fFull(outputFiles.size(), false) {}
+
+CP::TOutputRollover::~TOutputRollover() {}
+
+std::string CP::TOutputRollover::GetPieceName(const std::string& name,
+                                              int piece) {
+    std::string base = name;
+    std::string extension;
+    std::size_t dot = name.rfind('.');
+    std::size_t slash = name.rfind('/');
+    if (dot != std::string::npos
+        && (slash == std::string::npos || slash < dot)) {
+        base = name.substr(0,dot);
+        extension = name.substr(dot);
+    }
+    std::ostringstream pieceName;
+    pieceName << base << "-" << std::setw(3) << std::setfill('0')
+              << piece << extension;
+    return pieceName.str();
+}
+
+void CP::TOutputRollover::MoveUserObjects(CP::TRootOutput* from,
+                                          CP::TRootOutput* to) {
+    std::vector<TObject*> objects;
+    TIter next(from->GetList());
+    while (TObject* object = next()) objects.push_back(object);
+    for (std::size_t i = 0; i < objects.size(); ++i) {
+        TObject* object = objects[i];
+        if (TH1* histogram = dynamic_cast<TH1*>(object)) {
+            histogram->SetDirectory(to);
+            continue;
+        }
+        if (TGraph2D* graph = dynamic_cast<TGraph2D*>(object)) {
+            graph->SetDirectory(to);
+            continue;
+        }
+        if (object->IsA()->GetMethodAllAny("SetDirectory")) {
+            // The event tree is closed with the file.
+            if (std::string(object->GetName()) == "captainEventTree") {
+                continue;
+            }
+            CaptError("Cannot move " << object->ClassName()
+                      << " " << object->GetName() << " to "
+                      << to->GetName() << ": It is saved in "
+                      << from->GetName() << " and deleted");
+            continue;
+        }
+        from->GetList()->Remove(object);
+        to->GetList()->Add(object);
+    }
+}
+
+void CP::TOutputRollover::Rollover(int output) {
+    CP::TRootOutput* full = fOutputFiles[output];
+    std::string name = GetPieceName(fBaseNames[output], ++fPieces[output]);
+    CaptLog("Output " << full->GetName() << " is full with "
+            << fPieceEvents[output] << " events: Continue in "
+            << name);
+    CP::TRootOutput* next = fOpen(name);
+    MoveUserObjects(full, next);
+    full->Close();
+    delete full;
+    fOutputFiles[output] = next;
+    fOutputNames[output] = name;
+    fPieceEvents[output] = 0;
+    fFull[output] = false;
+}
+
+void CP::TOutputRollover::BeforeSave(int output) {
+    if (output < 0 || (int) fFull.size() <= output) return;
+    if (fFull[output]) Rollover(output);
+}
+
+void CP::TOutputRollover::EventSaved(int output) {
+    // Events that were only sent to the output stream aren't recorded.
+    if (output < 0 || (int) fFull.size() <= output) return;
+    if (!IsEnabled()) return;
+    CP::TRootOutput* file = fOutputFiles[output];
+    int events = ++fPieceEvents[output];
+    bool full = (0 < fMaxEvents && fMaxEvents <= events);
+    // Checking the size waits for the asynchronous writer, so it is only
+    // checked once for each backlog of events.
+    int backlog = file->GetAsynchronous();
+    if (!full && 0 < fMaxSize && (backlog < 1 || events % backlog == 0)) {
+        full = (fMaxSize <= file->GetFileSize());
+    }
+    if (full) fFull[output] = true;
+}
@@ -0,0 +1,102 @@
+#ifndef TOutputRollover_hxx_seen
+#define TOutputRollover_hxx_seen
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <Rtypes.h>
+
+namespace CP {
+    class TOutputRollover;
+    class TRootOutput;
+};
+
+/// Continue the output files of an event loop in numbered files when they
+/// reach a maximum size or number of events (the eventLoop
+/// "--max-output-size" and "--max-output-events" options).  The number is
+/// added before the extension, so "reco.root" is continued in
+/// "reco-001.root", "reco-002.root", ...  An output is only marked as full
+/// when an event is saved, and is rolled over when the next event is saved
+/// to it, so the last file of an output is never empty.  The event loop
+/// keeps the vectors of output files and names, and they are updated as
+/// the outputs are rolled over.  The new files are opened by a function
+/// given by the event loop (so they get the command line, the slice and
+/// the names of the current input files).
+///
+/// The objects made by the user code (e.g. histograms) are moved from the
+/// full file into the file that continues it (see MoveUserObjects()), so
+/// the user code still has them in Finalize(), and they are saved in the
+/// last file.
+class CP::TOutputRollover {
+public:
+    /// Open an output file with a name.
+    typedef std::function<CP::TRootOutput* (const std::string&)> Opener;
+
+    /// Roll over the output files (and their names) of an event loop.  The
+    /// vectors must stay valid while this exists.
+    TOutputRollover(std::vector<CP::TRootOutput*>& outputFiles,
+                    std::vector<std::string>& outputNames,
+                    const Opener& open);
+    ~TOutputRollover();
+
+    /// Set the size (in bytes) of an output file that is full.  Zero (the
+    /// default) means there isn't a limit.
+    void SetMaxSize(Long64_t bytes) {fMaxSize = bytes;}
+
+    /// Set the number of events in an output file that is full.  Zero (the
+    /// default) means there isn't a limit.
+    void SetMaxEvents(int events) {fMaxEvents = events;}
+
+    /// Return true if the outputs have a size or event limit.
+    bool IsEnabled() const {return fMaxSize > 0 || fMaxEvents > 0;}
+
+    /// Called before an event is saved to an output.  A full output is
+    /// rolled over to the next numbered file.  Indices that aren't output
+    /// files (e.g. the output stream) are ignored.
+    void BeforeSave(int output);
+
+    /// Called after an event is saved to an output.  The output is marked
+    /// as full when it reaches the maximum size or number of events.
+    void EventSaved(int output);
+
+    /// Return the name of a numbered file that continues an output.
+    static std::string GetPieceName(const std::string& name, int piece);
+
+    /// Move the objects made by the user code (e.g. histograms) from an
+    /// output file into the file that continues it.  Histograms and
+    /// TGraph2D objects are moved with SetDirectory(), and objects that
+    /// don't know their directory are moved to the list of the new file.
+    /// Trees (and other objects that keep their directory) can't be moved
+    /// since their data is already in the old file.  They are saved in the
+    /// old file and deleted when it is closed, so the user code must not
+    /// use them after the output is rolled over.
+    static void MoveUserObjects(CP::TRootOutput* from, CP::TRootOutput* to);
+
+private:
+    /// Close a full output and continue it in the next numbered file.
+    void Rollover(int output);
+
+    std::vector<CP::TRootOutput*>& fOutputFiles;
+    std::vector<std::string>& fOutputNames;
+    Opener fOpen;
+
+    /// The maximum size of an output in bytes.
+    Long64_t fMaxSize;
+
+    /// The maximum number of events in an output.
+    int fMaxEvents;
+
+    /// The names of the outputs before they were rolled over.
+    std::vector<std::string> fBaseNames;
+
+    /// The number of the last file opened for each output.
+    std::vector<int> fPieces;
+
+    /// The number of events in the current file of each output.
+    std::vector<int> fPieceEvents;
+
+    /// Flag that an output is full.
+    std::vector<bool> fFull;
+};
+#endif
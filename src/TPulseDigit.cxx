@@ -7,6 +7,11 @@ CP::TPulseDigit::TPulseDigit() {}
 CP::TPulseDigit::TPulseDigit(CP::TChannelId chan, int first, const Vector& adc) 
     : TDigit(chan), fFirstSample(first), fSamples(adc) {}
 
+CP::TPulseDigit::TPulseDigit(CP::TChannelId chan, int first,
+                             const unsigned short* begin,
+                             const unsigned short* end)
+    : TDigit(chan), fFirstSample(first), fSamples(begin,end) {}
+
 CP::TPulseDigit::~TPulseDigit() {}
 
 int CP::TPulseDigit::GetFirstSample() const {
@@ -29,6 +29,13 @@ public:
     /// sample time times the first time bin.
     TPulseDigit(CP::TChannelId chan, int first, const Vector& adcs);
 
+    /// Construct a digit for a particular channel with the sample values
+    /// copied from the range [begin, end).  This fills the digit directly
+    /// from a buffer (e.g. a memory mapped file) without making a temporary
+    /// vector.
+    TPulseDigit(CP::TChannelId chan, int first,
+                const unsigned short* begin, const unsigned short* end);
+
     /// Get the index of the first sample.  This can be negative since some
     /// Samples may give a delta relative to an index saved in the header.
     int GetFirstSample() const;
@@ -0,0 +1,127 @@
+//
+// Implement a class to write raw digit files.
+//
+
+#include <vector>
+
+#include "TRawDigitWriter.hxx"
+#include "TRawMmapInput.hxx"
+#include "TEvent.hxx"
+#include "TEventContext.hxx"
+#include "TDataVector.hxx"
+#include "TDigitContainer.hxx"
+#include "TPulseDigit.hxx"
+#include "TChannelId.hxx"
+#include "TCaptLog.hxx"
+
+namespace {
+    /// Append a little-endian 32 bit word to the buffer.
+    void AddWord(std::string& buffer, unsigned int word) {
+        buffer.push_back(word & 0xFF);
+        buffer.push_back((word >> 8) & 0xFF);
+        buffer.push_back((word >> 16) & 0xFF);
+        buffer.push_back((word >> 24) & 0xFF);
+    }
+
+    /// Append a little-endian 16 bit word to the buffer.
+    void AddShort(std::string& buffer, unsigned short word) {
+        buffer.push_back(word & 0xFF);
+        buffer.push_back((word >> 8) & 0xFF);
+    }
+}
+
+CP::TRawDigitWriter::TRawDigitWriter(const char* name)
+    : fName(name ? name: ""), fEventsWritten(0) {
+    fFile.open(fName.c_str(),
+               std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fFile.is_open()) {
+        CaptError("Cannot open raw digit file " << fName);
+        return;
+    }
+    std::string header(CP::TRawMmapInput::GetMagic(), 8);
+    AddWord(header, CP::TRawMmapInput::kVersion);
+    AddWord(header, 0);
+    fFile.write(header.data(), header.size());
+}
+
+CP::TRawDigitWriter::~TRawDigitWriter() {
+    Close();
+}
+
+int CP::TRawDigitWriter::WriteEvent(const CP::TEvent& event) {
+    if (!IsOpen()) return 0;
+
+    // Collect the digit containers first since the count is written before
+    // the containers.
+    std::vector<CP::THandle<CP::TDigitContainer> > containers;
+    CP::THandle<CP::TDataVector> digits
+        = event.Get<CP::TDataVector>("~/digits");
+    if (digits) {
+        for (CP::TDataVector::iterator d = digits->begin();
+             d != digits->end(); ++d) {
+            CP::THandle<CP::TDigitContainer> container
+                = digits->Get<CP::TDigitContainer>((*d)->GetName());
+            if (container) containers.push_back(container);
+        }
+    }
+
+    const CP::TEventContext& context = event.GetContext();
+    std::string record;
+    AddWord(record, context.GetPartition());
+    AddWord(record, context.GetRun());
+    AddWord(record, context.GetSubRun());
+    AddWord(record, context.GetEvent());
+    AddWord(record, context.GetSpill());
+    AddWord(record, context.GetTimeStamp());
+    AddWord(record, containers.size());
+
+    int written = 0;
+    for (std::size_t c = 0; c < containers.size(); ++c) {
+        std::string name(containers[c]->GetName());
+        if (CP::TRawMmapInput::kNameSize <= name.size()) {
+            CaptWarn("Digit container name " << name << " is truncated");
+            name = name.substr(0, CP::TRawMmapInput::kNameSize-1);
+        }
+        name.resize(CP::TRawMmapInput::kNameSize, '\0');
+        record += name;
+        std::size_t countPosition = record.size();
+        AddWord(record, 0);
+        unsigned int count = 0;
+        for (CP::TDigitContainer::const_iterator d = containers[c]->begin();
+             d != containers[c]->end(); ++d) {
+            const CP::TPulseDigit* pulse
+                = dynamic_cast<const CP::TPulseDigit*>(*d);
+            if (!pulse) continue;
+            AddWord(record, pulse->GetChannelId().AsUInt());
+            AddWord(record, pulse->GetFirstSample());
+            AddWord(record, pulse->GetSampleCount());
+            for (CP::TPulseDigit::iterator s = pulse->begin();
+                 s != pulse->end(); ++s) {
+                AddShort(record, *s);
+            }
+            if (pulse->GetSampleCount() % 2) AddShort(record, 0);
+            ++count;
+        }
+        std::string countWord;
+        AddWord(countWord, count);
+        record.replace(countPosition, 4, countWord);
+        written += count;
+    }
+
+    std::string length;
+    AddWord(length, record.size());
+    fFile.write(length.data(), length.size());
+    fFile.write(record.data(), record.size());
+    if (!fFile.good()) {
+        CaptError("Error writing raw digit file " << fName);
+        return 0;
+    }
+    ++fEventsWritten;
+    return written;
+}
+
+void CP::TRawDigitWriter::Close(void) {
+    if (!fFile.is_open()) return;
+    fFile.close();
+    CaptVerbose("Wrote " << fEventsWritten << " events to " << fName);
+}
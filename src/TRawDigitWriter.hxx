@@ -0,0 +1,51 @@
+#ifndef TRawDigitWriter_hxx_seen
+#define TRawDigitWriter_hxx_seen
+
+#include <fstream>
+#include <string>
+
+namespace CP {
+    class TEvent;
+    class TRawDigitWriter;
+}
+
+/// Write the CP::TPulseDigit objects of events into a raw digit file that can
+/// be read with CP::TRawMmapInput (the layout is documented there).  Each
+/// CP::TDigitContainer under "~/digits" is written as a container of the
+/// record, and digits that aren't CP::TPulseDigit objects are skipped.  This
+/// is mostly used to make raw digit files from existing event files for
+/// testing (see the write-raw-digits application).
+class CP::TRawDigitWriter {
+public:
+    /// Create a new raw digit file.  The file is replaced if it exists.
+    explicit TRawDigitWriter(const char* name);
+
+    virtual ~TRawDigitWriter();
+
+    /// Write the digits of an event as the next record of the file, and
+    /// return the number of digits that were written.
+    int WriteEvent(const CP::TEvent& event);
+
+    /// Flag that the file is open.
+    bool IsOpen(void) const {return fFile.is_open() && fFile.good();}
+
+    /// Close the file.
+    void Close(void);
+
+    /// Return the number of events written to the file.
+    int GetEventsWritten(void) const {return fEventsWritten;}
+
+    /// Return the name of the file.
+    const char* GetFilename(void) const {return fName.c_str();}
+
+private:
+    /// The name of the file.
+    std::string fName;
+
+    /// The output file.
+    std::ofstream fFile;
+
+    /// The number of events written.
+    int fEventsWritten;
+};
+#endif
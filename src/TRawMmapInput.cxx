@@ -0,0 +1,266 @@
+//
+// Implement a class to read memory mapped raw digit files.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TRawMmapInput.hxx"
+#include "TRootInput.hxx"
+#include "TEvent.hxx"
+#include "TEventContext.hxx"
+#include "TDataVector.hxx"
+#include "TDigitContainer.hxx"
+#include "TPulseDigit.hxx"
+#include "TChannelId.hxx"
+#include "TManager.hxx"
+#include "TInputManager.hxx"
+#include "TCaptLog.hxx"
+
+namespace {
+    class TRawMmapInputBuilder : public CP::TVInputBuilder {
+    public:
+        TRawMmapInputBuilder()
+            : CP::TVInputBuilder("rawmmap",
+                                 "Read a memory mapped raw digit file") {}
+        CP::TVInputFile* Open(const char* file) const {
+            return new CP::TRawMmapInput(file);
+        }
+    };
+
+    class TRawMmapInputRegistration {
+    public:
+        TRawMmapInputRegistration() {
+            CP::TManager::Get().Input().Register(new TRawMmapInputBuilder());
+        }
+    };
+    TRawMmapInputRegistration registrationObject;
+
+    /// Read the 32 bit word at the position and move past it.  This
+    /// returns false if the word is past the end.
+    bool ReadWord(const unsigned char* data, std::size_t end,
+                  std::size_t& position, unsigned int& word) {
+        if (end < position + 4) return false;
+        word = data[position]
+            | (data[position+1] << 8)
+            | (data[position+2] << 16)
+            | (static_cast<unsigned int>(data[position+3]) << 24);
+        position += 4;
+        return true;
+    }
+}
+
+CP::TRawMmapInput::TRawMmapInput(const char* name)
+    : fName(name ? name: ""), fDescriptor(-1), fData(NULL), fSize(0),
+      fSequence(-1) {
+    fDescriptor = open(fName.c_str(), O_RDONLY);
+    if (fDescriptor < 0) {
+        CaptError("Cannot open raw digit file " << fName);
+        throw CP::EInputFileMissing();
+    }
+    struct stat status;
+    if (fstat(fDescriptor, &status) != 0 || status.st_size < 16) {
+        CaptError("Raw digit file " << fName << " is too short");
+        CloseFile();
+        throw CP::ERawDigitFormat();
+    }
+    fSize = status.st_size;
+    void* data = mmap(NULL, fSize, PROT_READ, MAP_PRIVATE, fDescriptor, 0);
+    if (data == MAP_FAILED) {
+        CaptError("Cannot map raw digit file " << fName);
+        fSize = 0;
+        CloseFile();
+        throw CP::EInputFileMissing();
+    }
+    fData = static_cast<const unsigned char*>(data);
+    // The events are usually read in order.
+    madvise(data, fSize, MADV_SEQUENTIAL);
+    try {
+        FindRecords();
+    }
+    catch (...) {
+        CloseFile();
+        throw;
+    }
+    CaptVerbose("Raw digit file " << fName << " has "
+                << fRecords.size() << " events");
+}
+
+CP::TRawMmapInput::~TRawMmapInput() {
+    CloseFile();
+}
+
+void CP::TRawMmapInput::FindRecords(void) {
+    if (std::memcmp(fData, GetMagic(), 8) != 0) {
+        CaptError("File " << fName << " is not a raw digit file");
+        throw CP::ERawDigitFormat();
+    }
+    std::size_t position = 8;
+    unsigned int version = 0;
+    unsigned int reserved = 0;
+    ReadWord(fData, fSize, position, version);
+    ReadWord(fData, fSize, position, reserved);
+    if (version != kVersion) {
+        CaptError("Raw digit file " << fName << " has version " << version
+                  << " (expected " << kVersion << ")");
+        throw CP::ERawDigitFormat();
+    }
+    while (position < fSize) {
+        std::size_t start = position;
+        unsigned int recordBytes = 0;
+        if (!ReadWord(fData, fSize, position, recordBytes)
+            || fSize < position + recordBytes) {
+            CaptError("Raw digit file " << fName
+                      << " has a truncated record at byte " << start);
+            throw CP::ERawDigitFormat();
+        }
+        // The words of the next record (and the samples) must stay on 32
+        // bit boundaries.
+        if (recordBytes % 4 != 0) {
+            CaptError("Raw digit file " << fName << " has a record at byte "
+                      << start << " with " << recordBytes
+                      << " bytes (not a multiple of 4)");
+            throw CP::ERawDigitFormat();
+        }
+        fRecords.push_back(start);
+        position += recordBytes;
+    }
+}
+
+CP::TEvent* CP::TRawMmapInput::NextEvent(int skip) {
+    if (skip>0) fSequence += skip;
+    return ReadEvent(++fSequence);
+}
+
+CP::TEvent* CP::TRawMmapInput::PreviousEvent(int skip) {
+    if (skip>0) fSequence -= skip;
+    return ReadEvent(--fSequence);
+}
+
+CP::TEvent* CP::TRawMmapInput::ReadEvent(int n) {
+    fSequence = n;
+    if (fSequence<0) {
+        fSequence = -1;
+        return NULL;
+    }
+    if (!IsOpen() || GetEventsInFile() <= fSequence) {
+        fSequence = GetEventsInFile();
+        return NULL;
+    }
+
+    std::size_t position = fRecords[fSequence];
+    unsigned int recordBytes = 0;
+    ReadWord(fData, fSize, position, recordBytes);
+    const std::size_t end = position + recordBytes;
+
+    // Ask for the pages of the next record while this one is built.
+    if (fSequence+1 < GetEventsInFile()) {
+        std::size_t page = sysconf(_SC_PAGESIZE);
+        std::size_t next = fRecords[fSequence+1] & ~(page-1);
+        madvise(const_cast<unsigned char*>(fData) + next,
+                std::min(fSize - next, 4*page), MADV_WILLNEED);
+    }
+
+    unsigned int header[6];
+    for (int i = 0; i < 6; ++i) {
+        if (!ReadWord(fData, end, position, header[i])) {
+            CaptError("Bad event header in " << fName);
+            fSequence = GetEventsInFile();
+            return NULL;
+        }
+    }
+    CP::TEventContext context(header[0], header[1], header[2], header[3],
+                              header[4], header[5]);
+    std::unique_ptr<CP::TEvent> event(new CP::TEvent(context));
+    CP::THandle<CP::TDataVector> digits
+        = event->Get<CP::TDataVector>("~/digits");
+
+    unsigned int containerCount = 0;
+    bool good = ReadWord(fData, end, position, containerCount);
+    for (unsigned int c = 0; good && c < containerCount; ++c) {
+        if (end < position + kNameSize) {
+            good = false;
+            break;
+        }
+        std::string name(reinterpret_cast<const char*>(fData+position),
+                         kNameSize);
+        name = name.substr(0,name.find('\0'));
+        position += kNameSize;
+        unsigned int digitCount = 0;
+        if (!ReadWord(fData, end, position, digitCount)) {
+            good = false;
+            break;
+        }
+        CP::TDigitContainer* container
+            = new CP::TDigitContainer(name.c_str());
+        digits->AddDatum(container);
+        container->reserve(digitCount);
+        for (unsigned int d = 0; d < digitCount; ++d) {
+            unsigned int channel = 0;
+            unsigned int first = 0;
+            unsigned int sampleCount = 0;
+            if (!ReadWord(fData, end, position, channel)
+                || !ReadWord(fData, end, position, first)
+                || !ReadWord(fData, end, position, sampleCount)
+                || end < position + 2*sampleCount) {
+                good = false;
+                break;
+            }
+            // The samples are little-endian 16 bit words that start on a 32
+            // bit boundary (the records are checked in FindRecords()), so
+            // they can be read through the map and copied into the digit.
+            const unsigned short* samples
+                = reinterpret_cast<const unsigned short*>(fData+position);
+            container->push_back(
+                new CP::TPulseDigit(CP::TChannelId(channel),
+                                    static_cast<int>(first),
+                                    samples, samples + sampleCount));
+            position += 2*sampleCount;
+            if (sampleCount % 2) position += 2;
+        }
+    }
+    if (!good) {
+        CaptError("Bad digit record for event " << fSequence
+                  << " in " << fName);
+        fSequence = GetEventsInFile();
+        return NULL;
+    }
+    return event.release();
+}
+
+int CP::TRawMmapInput::Seek(int entry) {
+    if (entry < 0) entry = 0;
+    if (GetEventsInFile() <= entry) {
+        fSequence = GetEventsInFile();
+        return fSequence;
+    }
+    // NextEvent() reads the entry after the current sequence number.
+    fSequence = entry - 1;
+    return entry;
+}
+
+bool CP::TRawMmapInput::EndOfFile(void) {
+    if (fSequence<0) {
+        fSequence = -1;
+        return true;
+    }
+    if (GetEventsInFile()<=fSequence) {
+        fSequence = GetEventsInFile();
+        return true;
+    }
+    return false;
+}
+
+void CP::TRawMmapInput::CloseFile(void) {
+    if (fData) munmap(const_cast<unsigned char*>(fData), fSize);
+    fData = NULL;
+    fSize = 0;
+    if (fDescriptor >= 0) close(fDescriptor);
+    fDescriptor = -1;
+}
@@ -0,0 +1,137 @@
+#ifndef TRawMmapInput_hxx_seen
+#define TRawMmapInput_hxx_seen
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "ECore.hxx"
+#include "TVInputFile.hxx"
+
+namespace CP {
+    class TEvent;
+    class TRawMmapInput;
+
+    /// A raw digit file doesn't have the expected layout.
+    EXCEPTION(ERawDigitFormat,EInputFile);
+}
+
+/// Read a raw digit file written by the DAQ (or by CP::TRawDigitWriter)
+/// without converting it to ROOT first.  The file is memory mapped, and the
+/// digits are filled as CP::TPulseDigit objects directly from the mapped
+/// pages.  This is registered with TInputManager as the "rawmmap" input, so
+/// it can be used with an event loop as
+///
+/// \code
+/// dump-event.exe -t rawmmap run1234.dat
+/// \endcode
+///
+/// The file is a sequence of little-endian 32 bit words (the samples are 16
+/// bit words).  It starts with a 16 byte header
+///
+/// \code
+/// char   magic[8]       "CPRAWDG1"
+/// uint32 version        1
+/// uint32 reserved       0
+/// \endcode
+///
+/// and is followed by one record for each event
+///
+/// \code
+/// uint32 recordBytes    The number of bytes in the record after this word.
+/// uint32 partition, run, subRun, event, spill, timeStamp
+/// uint32 containerCount
+/// For each container:
+///     char   name[16]   The container name (e.g. "drift" or "pmt"), padded
+///                       with zeros.  It is added to the event as
+///                       "~/digits/<name>".
+///     uint32 digitCount
+///     For each digit:
+///         uint32 channelId    The CP::TChannelId value.
+///         int32  firstSample
+///         uint32 sampleCount
+///         uint16 samples[sampleCount]
+///         uint16 padding      Only when sampleCount is odd.
+/// \endcode
+///
+/// The records are found when the file is opened (only the record lengths
+/// are read), so the events can be read in any order.  The record lengths
+/// must be multiples of 4 bytes.
+class CP::TRawMmapInput : public TVInputFile {
+public:
+    /// Open and map a raw digit file.  This throws CP::EInputFileMissing if
+    /// the file can't be mapped, and CP::ERawDigitFormat if the file doesn't
+    /// have the expected layout.
+    explicit TRawMmapInput(const char* name);
+
+    virtual ~TRawMmapInput();
+
+    /// The first eight bytes of a raw digit file.
+    static const char* GetMagic(void) {return "CPRAWDG1";}
+
+    /// The version of the layout that is read.
+    static const unsigned int kVersion = 1;
+
+    /// The size of the container names in the file.
+    static const std::size_t kNameSize = 16;
+
+    /// Return the first event in the file.
+    virtual TEvent* FirstEvent(void) {return ReadEvent(0);}
+
+    /// Read the next event in the file.
+    virtual TEvent* NextEvent(int skip = 0);
+
+    /// Read the previous event in the file.
+    virtual TEvent* PreviousEvent(int skip = 0);
+
+    /// Read the n'th event (starting from 0) in the file.
+    TEvent* ReadEvent(int n);
+
+    /// Position the file so that the next call to NextEvent() reads the
+    /// entry.
+    virtual int Seek(int entry);
+
+    /// Return the entry of the last event read.
+    virtual int GetPosition(void) const {
+        if (fSequence<0) return -1;
+        return fSequence;
+    }
+
+    /// Return the number of events in the file.
+    virtual int GetEventsInFile(void) {return fRecords.size();}
+
+    /// Flag that the file is mapped.
+    virtual bool IsOpen(void) {return fData != NULL;}
+
+    /// Flag that we are past the beginning or the end of the file.
+    virtual bool EndOfFile(void);
+
+    /// Unmap and close the file.
+    virtual void CloseFile(void);
+
+    /// Return the name of the file.
+    virtual const char* GetFilename() const {return fName.c_str();}
+
+private:
+    /// Find the start of each event record.
+    void FindRecords(void);
+
+    /// The name of the file.
+    std::string fName;
+
+    /// The file descriptor of the mapped file.
+    int fDescriptor;
+
+    /// The mapped file.
+    const unsigned char* fData;
+
+    /// The size of the mapped file.
+    std::size_t fSize;
+
+    /// The offset of each event record in the file.
+    std::vector<std::size_t> fRecords;
+
+    /// The entry of the last event read.
+    int fSequence;
+};
+#endif
@@ -3,11 +3,25 @@
 // 
 
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <TROOT.h>
+#include <TDirectory.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <TTreeCache.h>
+#include <TBranch.h>
+#include <TObjArray.h>
 #include <TFolder.h>
 
 #include "TRootInput.hxx"
+#include "TRootOutput.hxx"
 
 #include "TEvent.hxx"
 #include "TManager.hxx"
@@ -33,9 +47,397 @@ namespace {
     TRootInputRegistration registrationObject;
 }
 
+namespace {
+    /// Add the reads through the cache of a tree to the totals.
+    void AddCacheReads(TFile* file, TTree* tree,
+                       Long64_t& bytesRead, Long64_t& missBytes,
+                       Int_t& readCalls, Int_t& missCalls) {
+        if (!file || !tree) return;
+        TTreeCache* cache
+            = dynamic_cast<TTreeCache*>(file->GetCacheRead(tree));
+        if (!cache) return;
+        bytesRead += cache->GetBytesRead();
+        missBytes += cache->GetNoCacheBytesRead();
+        readCalls += cache->GetReadCalls();
+        missCalls += cache->GetNoCacheReadCalls();
+    }
+
+    /// Split a comma separated list of datum paths.  The paths are relative
+    /// to the event, so a leading "~/" or "/" is removed.
+    std::vector<std::string> SplitDatumPaths(const std::string& paths) {
+        std::vector<std::string> result;
+        std::istringstream list(paths);
+        std::string path;
+        while (std::getline(list,path,',')) {
+            if (path.compare(0,2,"~/") == 0) path.erase(0,2);
+            while (!path.empty() && path[0] == '/') path.erase(0,1);
+            while (!path.empty() && path[path.size()-1] == '/') {
+                path.erase(path.size()-1);
+            }
+            if (!path.empty()) result.push_back(path);
+        }
+        return result;
+    }
+
+    /// Return true if the path is the same as, or inside of, the parent.
+    bool IsInside(const std::string& path, const std::string& parent) {
+        if (path.compare(0,parent.size(),parent) != 0) return false;
+        return (path.size() == parent.size() || path[parent.size()] == '/');
+    }
+
+    /// How a datum is handled when an event is read.
+    enum DatumSelection {
+        kKeepDatum,             // Keep the datum and everything inside it.
+        kDropDatum,             // Remove the datum.
+        kPruneDatum             // Keep the datum, but check inside it.
+    };
+
+    DatumSelection SelectDatum(const std::string& path,
+                               const std::vector<std::string>& included,
+                               const std::vector<std::string>& excluded) {
+        bool prune = false;
+        for (std::size_t i = 0; i < excluded.size(); ++i) {
+            if (IsInside(path, excluded[i])) return kDropDatum;
+            if (IsInside(excluded[i], path)) prune = true;
+        }
+        bool keep = included.empty();
+        for (std::size_t i = 0; i < included.size(); ++i) {
+            if (IsInside(path, included[i])) keep = true;
+            else if (IsInside(included[i], path)) prune = true;
+        }
+        if (keep && !prune) return kKeepDatum;
+        if (prune) return kPruneDatum;
+        return kDropDatum;
+    }
+
+    /// Remove the datums that aren't selected from a data vector.  The path
+    /// is the path of the data vector relative to the event (empty for the
+    /// event).  Temporary datums are not changed.
+    void PruneDatums(CP::TDataVector& data, const std::string& path,
+                     const std::vector<std::string>& included,
+                     const std::vector<std::string>& excluded) {
+        std::vector<CP::TDatum*> dropped;
+        for (CP::TDataVector::iterator d = data.begin();
+             d != data.end(); ++d) {
+            if (data.IsTemporary(*d)) continue;
+            std::string datumPath = (*d)->GetName();
+            if (!path.empty()) datumPath = path + "/" + datumPath;
+            DatumSelection selection
+                = SelectDatum(datumPath, included, excluded);
+            if (selection == kDropDatum) {
+                dropped.push_back(*d);
+                continue;
+            }
+            if (selection != kPruneDatum) continue;
+            CP::TDataVector* vector = dynamic_cast<CP::TDataVector*>(*d);
+            if (vector) PruneDatums(*vector, datumPath, included, excluded);
+        }
+        for (std::size_t i = 0; i < dropped.size(); ++i) {
+            data.erase(dropped[i]);
+            delete dropped[i];
+        }
+    }
+}
+
+/// Read the entries of an event tree into events.  The top-level datums that
+/// were written to separate branches (see CP::TRootOutput::SetSplitDatums())
+/// are put back into the event at the positions they had when it was
+/// written.  Files written without the positions have the split datums added
+/// at the end of the event.  The branch addresses are set when the first
+/// entry is read, and are reset when the reader is deleted, so the reader
+/// must be deleted before the tree.
+class CP::TRootInput::TEntryReader {
+public:
+    TEntryReader(TTree* tree, const std::vector<std::string>& datums)
+        : fTree(tree), fDatums(datums), fEvent(NULL), fAttached(false) {
+        // The objects are allocated here so that the tree doesn't own them.
+        for (std::size_t i = 0; i < fDatums.size(); ++i) {
+            fHolders.push_back(new CP::TDataVector(fDatums[i].c_str()));
+        }
+        // The positions are saved for every datum branch, so find the
+        // element for each datum that is read.
+        if (!fTree->GetBranch(CP::TRootOutput::GetSplitPositionsName())) {
+            return;
+        }
+        std::vector<std::string> branchNames;
+        TObjArray* branches = fTree->GetListOfBranches();
+        for (int i = 0; branches && i < branches->GetEntriesFast(); ++i) {
+            TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+            if (!branch) continue;
+            if (std::string(branch->GetClassName()) != "CP::TDataVector") {
+                continue;
+            }
+            branchNames.push_back(branch->GetName());
+        }
+        fPositions.assign(branchNames.size(), -1);
+        for (std::size_t i = 0; i < fDatums.size(); ++i) {
+            fPositionIndex.push_back(
+                std::find(branchNames.begin(), branchNames.end(), fDatums[i])
+                - branchNames.begin());
+        }
+    }
+
+    ~TEntryReader() {
+        if (fAttached) {
+            fTree->GetBranch("Event")->ResetAddress();
+            for (std::size_t i = 0; i < fDatums.size(); ++i) {
+                fTree->GetBranch(fDatums[i].c_str())->ResetAddress();
+            }
+            if (!fPositions.empty()) {
+                fTree->GetBranch(CP::TRootOutput::GetSplitPositionsName())
+                    ->ResetAddress();
+            }
+        }
+        for (std::size_t i = 0; i < fHolders.size(); ++i) delete fHolders[i];
+    }
+
+    /// Read an entry and return the event, or NULL if the entry can't be
+    /// read.  The caller takes ownership of the event.
+    CP::TEvent* Read(Long64_t entry) {
+        fEvent = new CP::TEvent;
+        if (!fAttached) {
+            // The tree follows changes to the event pointer, so the
+            // addresses only need to be set once.
+            fTree->SetBranchAddress("Event",&fEvent);
+            for (std::size_t i = 0; i < fDatums.size(); ++i) {
+                fTree->SetBranchAddress(fDatums[i].c_str(),&fHolders[i]);
+            }
+            if (!fPositions.empty()) {
+                fTree->SetBranchAddress(
+                    CP::TRootOutput::GetSplitPositionsName(),&fPositions[0]);
+            }
+            fAttached = true;
+        }
+        for (std::size_t i = 0; i < fPositions.size(); ++i) {
+            fPositions[i] = -1;
+        }
+        int nBytes = fTree->GetEntry(entry);
+        CP::TEvent* event = fEvent;
+        // Put the datums back in order of their original positions.  The
+        // datums without a position go at the end.
+        std::vector< std::pair<Long64_t, CP::TDatum*> > split;
+        for (std::size_t i = 0; i < fDatums.size(); ++i) {
+            while (fHolders[i]->size() > 0) {
+                CP::TDatum* datum = (*fHolders[i])[0];
+                fHolders[i]->erase(datum);
+                if (nBytes <= 0) {
+                    delete datum;
+                    continue;
+                }
+                Long64_t position = -1;
+                if (fPositionIndex.size() > i
+                    && fPositionIndex[i] < fPositions.size()) {
+                    position = fPositions[fPositionIndex[i]];
+                }
+                if (position < 0) {
+                    position = (Long64_t) std::numeric_limits<Int_t>::max()
+                        + i;
+                }
+                split.push_back(std::make_pair(position, datum));
+            }
+        }
+        if (nBytes <= 0) {
+            delete event;
+            return NULL;
+        }
+        std::sort(split.begin(), split.end());
+        for (std::size_t i = 0; i < split.size(); ++i) {
+            if (split[i].first < (Long64_t) event->size()) {
+                CP::TDataVector::iterator position = event->begin();
+                std::advance(position, split[i].first);
+                event->insert(position, split[i].second);
+            }
+            else {
+                event->push_back(split[i].second);
+            }
+        }
+        return event;
+    }
+
+private:
+    TTree* fTree;
+    std::vector<std::string> fDatums;
+    CP::TEvent* fEvent;
+    bool fAttached;
+
+    /// The containers attached to the datum branches.
+    std::vector<CP::TDataVector*> fHolders;
+
+    /// The positions of the split datums in the event for the last entry,
+    /// and the element of fPositions for each datum that is read.
+    std::vector<Int_t> fPositions;
+    std::vector<std::size_t> fPositionIndex;
+};
+
+/// Read the entries of the event tree on a background thread and keep them
+/// in a bounded queue.  The entries are read sequentially starting from the
+/// entry requested by the last call to Take().  The thread reads through its
+/// own handle for the file, so the input file (e.g. the geometry read by
+/// CP::TManager::Geometry(), or the context branch) can be used while the
+/// thread is running.  The datum branches that aren't in the list are
+/// turned off, and the tree is read through a cache when the cache size
+/// isn't negative (see CP::TRootInput::SetCacheSize()).
+class CP::TRootInput::TReadAhead {
+public:
+    TReadAhead(const char* fileName, const std::vector<std::string>& datums,
+               int depth,
+               Long64_t cacheSize, int learnEntries)
+        : fFile(NULL), fTree(NULL), fReader(NULL),
+          fDepth(depth), fEntries(0),
+          fNext(0), fRunning(false), fReading(false), fStop(false) {
+        ROOT::EnableThreadSafety();
+        // Opening the file changes the current directory.
+        TDirectory::TContext currentDirectory;
+        fFile = TFile::Open(fileName,"READ");
+        if (!fFile || !fFile->IsOpen()) return;
+        fTree = dynamic_cast<TTree*>(fFile->Get("captainEventTree"));
+        if (!fTree) return;
+        fReader = new TEntryReader(fTree, datums);
+        fEntries = fTree->GetEntries();
+        TObjArray* branches = fTree->GetListOfBranches();
+        for (int i = 0; branches && i < branches->GetEntriesFast(); ++i) {
+            TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+            if (!branch) continue;
+            if (std::string(branch->GetClassName()) != "CP::TDataVector") {
+                continue;
+            }
+            if (std::find(datums.begin(), datums.end(), branch->GetName())
+                != datums.end()) continue;
+            fTree->SetBranchStatus(branch->GetName(), false);
+        }
+        if (cacheSize < 0) return;
+        fTree->SetCacheSize(cacheSize);
+        if (cacheSize > 0) fTree->SetCacheLearnEntries(learnEntries);
+    }
+
+    ~TReadAhead() {
+        Stop();
+        delete fReader;
+        delete fFile;
+    }
+
+    /// Return true if the file was opened for the thread.
+    bool IsOpen() const {return fTree;}
+
+    int GetDepth() const {return fDepth;}
+
+    /// Add the reads through the cache to the totals.  The thread must be
+    /// stopped.
+    void AddCacheReads(Long64_t& bytesRead, Long64_t& missBytes,
+                       Int_t& readCalls, Int_t& missCalls) {
+        ::AddCacheReads(fFile, fTree,
+                        bytesRead, missBytes, readCalls, missCalls);
+    }
+
+    /// Stop the thread and throw away any events that have been read.  The
+    /// next call to Take() starts a new thread.
+    void Stop() {
+        if (!fRunning) return;
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fStop = true;
+        }
+        fSpace.notify_all();
+        fThread.join();
+        fRunning = false;
+        fReading = false;
+        while (!fQueue.empty()) {
+            delete fQueue.front().second;
+            fQueue.pop_front();
+        }
+    }
+
+    /// Return the event for a tree entry, and start reading the following
+    /// entries.  The caller takes ownership of the event.  This returns NULL
+    /// if the entry cannot be read.
+    CP::TEvent* Take(Long64_t entry) {
+        if (entry < 0 || fEntries <= entry) return NULL;
+        std::unique_lock<std::mutex> lock(fMutex);
+        Long64_t head = fQueue.empty() ? fNext: fQueue.front().first;
+        if (!fRunning || entry < head || fNext + fDepth < entry) {
+            // The entry isn't going to be read by the current thread, so
+            // start over from the requested entry.
+            lock.unlock();
+            Stop();
+            Start(entry);
+            lock.lock();
+        }
+        for (;;) {
+            // Throw away entries that were skipped.
+            while (!fQueue.empty() && fQueue.front().first < entry) {
+                delete fQueue.front().second;
+                fQueue.pop_front();
+                fSpace.notify_one();
+            }
+            if (!fQueue.empty()) break;
+            // Check if the thread has run out of entries to read.
+            if (fEntries <= fNext && !fReading) return NULL;
+            fReady.wait(lock);
+        }
+        CP::TEvent* event = fQueue.front().second;
+        fQueue.pop_front();
+        fSpace.notify_one();
+        return event;
+    }
+
+private:
+    /// Start reading at the entry.
+    void Start(Long64_t entry) {
+        fNext = entry;
+        fStop = false;
+        fRunning = true;
+        fThread = std::thread(&TReadAhead::Run, this);
+    }
+
+    void Run() {
+        for (;;) {
+            Long64_t entry;
+            {
+                std::unique_lock<std::mutex> lock(fMutex);
+                while (!fStop 
+                       && (fDepth <= (int) fQueue.size()
+                           || fEntries <= fNext)) {
+                    fSpace.wait(lock);
+                }
+                if (fStop) break;
+                entry = fNext++;
+                fReading = true;
+            }
+            CP::TEvent* event = fReader->Read(entry);
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                fQueue.push_back(std::make_pair(entry,event));
+                fReading = false;
+                // Don't read past an entry that fails.
+                if (!event) fNext = fEntries;
+            }
+            fReady.notify_one();
+        }
+    }
+
+    TFile* fFile;
+    TTree* fTree;
+    TEntryReader* fReader;
+    int fDepth;
+    Long64_t fEntries;
+    Long64_t fNext;
+    bool fRunning;
+    bool fReading;
+    bool fStop;
+    std::thread fThread;
+    std::mutex fMutex;
+    std::condition_variable fSpace;
+    std::condition_variable fReady;
+    std::deque< std::pair<Long64_t, CP::TEvent*> > fQueue;
+};
+
 CP::TRootInput::TRootInput(const char* name, Option_t* option, Int_t compress) 
     : fFile(NULL), fSequence(0), fEventTree(NULL), fEventPointer(0),
-      fEventsRead(0), fAttached(false) {
+      fEventsRead(0), fAttached(false), fEntryReader(NULL),
+      fReadAhead(NULL),
+      fContextsRead(false), fCacheSize(-1), fCacheLearnEntries(10),
+      fCacheBytesRead(0), fCacheMissBytes(0),
+      fCacheReadCalls(0), fCacheMissCalls(0) {
     fFile = new TFile(name, option, "ROOT Input File", compress);
     if (!fFile || !fFile->IsOpen()) {
         throw CP::EInputFileMissing();
@@ -49,7 +451,11 @@ CP::TRootInput::TRootInput(const char* name, Option_t* option, Int_t compress)
 
 CP::TRootInput::TRootInput(TFile* file) 
     : fFile(file), fSequence(0), fEventTree(NULL), fEventPointer(0),
-      fEventsRead(0), fAttached(false) {
+      fEventsRead(0), fAttached(false), fEntryReader(NULL),
+      fReadAhead(NULL),
+      fContextsRead(false), fCacheSize(-1), fCacheLearnEntries(10),
+      fCacheBytesRead(0), fCacheMissBytes(0),
+      fCacheReadCalls(0), fCacheMissCalls(0) {
     if (!fFile || !fFile->IsOpen()) {
         throw CP::ENoInputFile();
     }
@@ -94,6 +500,18 @@ bool CP::TRootInput::IsAttached(void) {
     if (!fEventTree) {
         fEventTree = dynamic_cast<TTree*>(fFile->Get("captainEventTree"));
         if (!fEventTree) throw ENoEvents();
+        // Find the top-level datums that were written to separate
+        // branches.  Files written without split datums don't have any.
+        TObjArray* branches = fEventTree->GetListOfBranches();
+        for (int i = 0; branches && i < branches->GetEntriesFast(); ++i) {
+            TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+            if (!branch) continue;
+            if (std::string(branch->GetClassName()) != "CP::TDataVector") {
+                continue;
+            }
+            fDatumBranches.push_back(branch->GetName());
+        }
+        SelectDatumBranches();
     }
 
     return true;
@@ -148,14 +566,26 @@ CP::TEvent* CP::TRootInput::ReadEvent(Int_t n) {
 
     if (!IsAttached()) return NULL;
 
-    // Set up for a new event structure to be allocated.
-    fEventPointer = new CP::TEvent;
-    fEventTree->SetBranchAddress("Event",&fEventPointer);
+    int nBytes = 0;
+    if (fReadAhead) {
+        // Get the event from the read-ahead thread.
+        fEventPointer = fReadAhead->Take(fSequence);
+        if (fEventPointer) nBytes = 1;
+    }
+    else {
+        // Read the new event.
+        if (!fEntryReader) {
+            fEntryReader = new TEntryReader(fEventTree, fReadDatums);
+        }
+        fEventPointer = fEntryReader->Read(fSequence);
+        if (fEventPointer) nBytes = 1;
+    }
 
-    // Read the new event.
-    int nBytes = fEventTree->GetEntry(fSequence);
     if (nBytes > 0) {
         fEventsRead++;
+        if (!fIncludedDatums.empty() || !fExcludedDatums.empty()) {
+            PruneDatums(*fEventPointer, "", fIncludedDatums, fExcludedDatums);
+        }
         fEventPointer->Register();
     } else {
         fSequence = GetEventsInFile();
@@ -167,7 +597,200 @@ CP::TEvent* CP::TRootInput::ReadEvent(Int_t n) {
     return fEventPointer;
 }
 
+int CP::TRootInput::Seek(int entry) {
+    if (entry < 0) entry = 0;
+    if (GetEventsInFile() <= entry) {
+        fSequence = GetEventsInFile();
+        return fSequence;
+    }
+    // NextEvent() reads the entry after the current sequence number.
+    fSequence = entry - 1;
+    return entry;
+}
+
+CP::TEvent* CP::TRootInput::FindEvent(const CP::TEventContext& context) {
+    if (!IsAttached()) return NULL;
+    Long64_t start = (fSequence < 0) ? 0 : fSequence + 1;
+    Long64_t entry = FindEntry(context,start);
+    if (entry < 0) return TVInputFile::FindEvent(context);
+    if (GetEventsInFile() <= entry) {
+        fSequence = GetEventsInFile();
+        return NULL;
+    }
+    return ReadEvent(entry);
+}
+
+Long64_t CP::TRootInput::FindEntry(const CP::TEventContext& context,
+                                   Long64_t start) {
+    if (!fEventTree->GetBranch("Context")) return -1;
+
+    // Files written by TRootOutput are indexed by run and event number, so
+    // an event that is in the file is found without reading the contexts.
+    if (context.GetRun() != CP::TEventContext::Invalid
+        && context.GetEvent() != CP::TEventContext::Invalid
+        && fEventTree->GetTreeIndex()) {
+        Long64_t entry = fEventTree->GetEntryNumberWithIndex(
+            context.GetRun(), context.GetEvent());
+        if (start <= entry) return entry;
+    }
+
+    // Otherwise, find the first entry after the start that is at or after
+    // the context.  Only the context branch is read.
+    Long64_t entries = fEventTree->GetEntries();
+    CP::TEventContext entryContext;
+    for (Long64_t entry = start; entry < entries; ++entry) {
+        if (!ReadContext(entry, entryContext)) return -1;
+        if (TVInputFile::IsAtOrAfter(entryContext, context)) return entry;
+    }
+    return entries;
+}
+
+bool CP::TRootInput::ReadContext(int entry, CP::TEventContext& context) {
+    if (!IsAttached()) return false;
+    if (!fContextsRead) {
+        fContextsRead = true;
+        if (!ReadContextBranch()) {
+            CaptLog("No context branch in " << GetInputName());
+        }
+    }
+    if (entry < 0 || (int) fContexts.size() <= entry) return false;
+    context = fContexts[entry];
+    return true;
+}
+
+bool CP::TRootInput::ReadContextBranch(void) {
+    fContexts.clear();
+    TBranch* contextBranch = fEventTree->GetBranch("Context");
+    if (!contextBranch) return false;
+
+    Long64_t entries = fEventTree->GetEntries();
+    CP::TEventContext entryContext;
+    CP::TEventContext* contextPointer = &entryContext;
+    contextBranch->SetAddress(&contextPointer);
+    fContexts.reserve(entries);
+    for (Long64_t entry = 0; entry < entries; ++entry) {
+        if (contextBranch->GetEntry(entry) <= 0) break;
+        fContexts.push_back(entryContext);
+    }
+    contextBranch->ResetAddress();
+    ResetCache();
+    CaptVerbose("Read " << fContexts.size() << " event contexts from "
+                << GetInputName());
+    return true;
+}
+
+void CP::TRootInput::SetReadAhead(int depth) {
+    DeleteReadAhead();
+    if (depth < 1) return;
+    if (!IsAttached()) return;
+    CaptInfo("Read " << depth << " events ahead from " << GetInputName());
+    fReadAhead = new TReadAhead(GetInputName(),fReadDatums,depth,
+                                fCacheSize,fCacheLearnEntries);
+    if (fReadAhead->IsOpen()) return;
+    CaptError("Cannot open " << GetInputName() << " to read ahead");
+    DeleteReadAhead();
+}
+
+void CP::TRootInput::DeleteReadAhead(void) {
+    if (!fReadAhead) return;
+    fReadAhead->Stop();
+    fReadAhead->AddCacheReads(fCacheBytesRead, fCacheMissBytes,
+                              fCacheReadCalls, fCacheMissCalls);
+    delete fReadAhead;
+    fReadAhead = NULL;
+}
+
+void CP::TRootInput::SetIncludedDatums(const std::string& paths) {
+    fIncludedDatums = SplitDatumPaths(paths);
+    SelectDatumBranches();
+}
+
+void CP::TRootInput::SetExcludedDatums(const std::string& paths) {
+    fExcludedDatums = SplitDatumPaths(paths);
+    SelectDatumBranches();
+}
+
+void CP::TRootInput::SelectDatumBranches(void) {
+    if (!fEventTree) return;
+    // The read-ahead thread has the list of branches, so it is started
+    // again with the new list.
+    int readAhead = GetReadAhead();
+    DeleteReadAhead();
+    delete fEntryReader;
+    fEntryReader = NULL;
+    fReadDatums.clear();
+    for (std::size_t i = 0; i < fDatumBranches.size(); ++i) {
+        const std::string& name = fDatumBranches[i];
+        bool read = (SelectDatum(name, fIncludedDatums, fExcludedDatums)
+                     != kDropDatum);
+        fEventTree->SetBranchStatus(name.c_str(), read);
+        if (read) fReadDatums.push_back(name);
+        else CaptInfo("Datum branch " << name << " is not read");
+    }
+    ResetCache();
+    SetReadAhead(readAhead);
+}
+
+void CP::TRootInput::SetCacheSize(Long64_t bytes, int learnEntries) {
+    fCacheSize = bytes;
+    if (learnEntries > 0) fCacheLearnEntries = learnEntries;
+    if (!IsAttached()) return;
+    if (fCacheSize > 0) {
+        CaptInfo("Read " << GetInputName() << " with a " << fCacheSize
+                 << " byte cache");
+    }
+    ResetCache();
+    // The read-ahead thread has its own cache, so it is started again with
+    // the new size.
+    SetReadAhead(GetReadAhead());
+}
+
+void CP::TRootInput::ResetCache(void) {
+    if (!fEventTree || fCacheSize < 0) return;
+    AddCacheReads(fFile, fEventTree, fCacheBytesRead, fCacheMissBytes,
+                  fCacheReadCalls, fCacheMissCalls);
+    fEventTree->SetCacheSize(0);
+    if (fCacheSize == 0) return;
+    fEventTree->SetCacheSize(fCacheSize);
+    fEventTree->SetCacheLearnEntries(fCacheLearnEntries);
+}
+
+std::string CP::TRootInput::GetCacheStatistics(void) {
+    if (!fEventTree || fCacheSize == 0) return "";
+    if (fReadAhead) fReadAhead->Stop();
+    Long64_t bytesRead = fCacheBytesRead;
+    Long64_t missBytes = fCacheMissBytes;
+    Int_t readCalls = fCacheReadCalls;
+    Int_t missCalls = fCacheMissCalls;
+    AddCacheReads(fFile, fEventTree, bytesRead, missBytes,
+                  readCalls, missCalls);
+    if (fReadAhead) {
+        fReadAhead->AddCacheReads(bytesRead, missBytes, readCalls, missCalls);
+    }
+    if (readCalls == 0 && missCalls == 0) return "";
+    const double megabyte = 1024.0*1024.0;
+    double hits = 100.0;
+    if (bytesRead + missBytes > 0) {
+        hits = 100.0*bytesRead/(bytesRead + missBytes);
+    }
+    std::ostringstream summary;
+    summary << readCalls << " cache reads (" << bytesRead/megabyte << " MB), "
+            << missCalls << " reads missed the cache ("
+            << missBytes/megabyte << " MB), "
+            << hits << "% of the bytes from the cache";
+    return summary.str();
+}
+
+int CP::TRootInput::GetReadAhead(void) const {
+    if (!fReadAhead) return 0;
+    return fReadAhead->GetDepth();
+}
+
 void CP::TRootInput::Close(Option_t* opt) {
+    // Stop reading before the file is closed.
+    DeleteReadAhead();
+    delete fEntryReader;
+    fEntryReader = NULL;
     TFile* current = CP::TManager::Get().CurrentInputFile();
     if (fFile == current) CP::TManager::Get().SetCurrentInputFile(NULL);
     fFile->Close(opt);
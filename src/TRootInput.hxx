@@ -1,10 +1,14 @@
 #ifndef TRootInput_hxx_seek
 #define TRootInput_hxx_seek
 
+#include <vector>
+#include <string>
+
 #include <TFile.h>
 
 #include "ECore.hxx"
 #include "TVInputFile.hxx"
+#include "TEventContext.hxx"
 
 class TTree;
 
@@ -20,7 +24,9 @@ namespace CP {
 /// to see if the geometry is saved in the input file and reads it if
 /// it can.  This will only read files that were written using the
 /// TRootOutput class.  This will work with any file name, but the preferred
-/// file extension is [name].root.
+/// file extension is [name].root.  Top-level datums that were written to
+/// separate branches (see CP::TRootOutput::SetSplitDatums()) are put back
+/// into the event when it is read.
 class CP::TRootInput : public TVInputFile {
 public:
     /// Open an input file. 
@@ -76,6 +82,28 @@ public:
     /// NULL.
     virtual TEvent* ReadEvent(Int_t n);
 
+    /// Position the file so that the next call to NextEvent() reads the
+    /// entry.  This only changes the entry number, so no events are read
+    /// (see TVInputFile::Seek()).
+    virtual int Seek(int entry);
+
+    /// Read the first event after the current position that is at or after
+    /// the run and event number in the context (see
+    /// TVInputFile::FindEvent()).  Files written by TRootOutput have an
+    /// index on the run and event number in the "Context" branch of the
+    /// event tree, so an event that is in the file is read without reading
+    /// the intervening events.  Otherwise, only the "Context" branch is
+    /// searched (see ReadContext()).  Files without the branch are searched
+    /// by reading each event.
+    virtual TEvent* FindEvent(const CP::TEventContext& context);
+
+    /// Fill the context of the event at an entry from the "Context" branch
+    /// of the event tree without reading the event (see
+    /// TVInputFile::ReadContext()).  The contexts for all of the entries
+    /// are read the first time this is called.  Files written before the
+    /// branch was added return false.
+    virtual bool ReadContext(int entry, CP::TEventContext& context);
+
     /// Make sure that the file is closed.  This method is specific to
     /// TRootInput.
     virtual void Close(Option_t* opt = "");
@@ -96,7 +124,90 @@ public:
     /// Return the file name to provide the base abstract input name class.
     virtual const char* GetInputName(void) const;
 
+    /// Read events on a background thread.  When the depth is greater than
+    /// zero, up to "depth" entries following the last event read are read
+    /// and decompressed on a background thread so that NextEvent() can
+    /// return an event that is already built.  Random access (e.g.
+    /// PreviousEvent(), or skipping with NextEvent(skip)) is still supported,
+    /// but discards the events that have been read ahead.  The thread reads
+    /// through a second handle for the file, so the file can still be used
+    /// (e.g. for the geometry) while events are read ahead.  A depth of zero
+    /// turns off the read-ahead thread.
+    void SetReadAhead(int depth);
+
+    /// Get the number of events that are read ahead.  If this is zero, the
+    /// events are read when they are requested.
+    int GetReadAhead(void) const;
+
+    /// Only keep the datums with these paths when an event is read.  The
+    /// paths are a comma separated list relative to the event (e.g.
+    /// "hits,fits", or "truth/G4Trajectories").  The datums that contain a
+    /// selected datum are kept, but only with the selected part.  An empty
+    /// list keeps all of the datums (the default).  Datums that are not
+    /// kept are missing from the event (i.e. TDatum::Get() returns an empty
+    /// handle).  When the top-level datum was written in a separate branch
+    /// (see CP::TRootOutput::SetSplitDatums()), the branch isn't read at
+    /// all.  Otherwise the datum is read with the event and then deleted.
+    void SetIncludedDatums(const std::string& paths);
+
+    /// Don't keep the datums with these paths when an event is read (see
+    /// SetIncludedDatums()).  An excluded path overrides an included path.
+    void SetExcludedDatums(const std::string& paths);
+
+    /// Return true if the file has top-level datums in separate branches
+    /// (see CP::TRootOutput::SetSplitDatums()).  Without them, the datum
+    /// selection doesn't save any reading, since the whole event is read
+    /// before the datums are removed.
+    bool HasDatumBranches(void) const {return !fDatumBranches.empty();}
+
+    /// Read the event tree through a TTreeCache of "bytes" bytes so that
+    /// the baskets for many entries are fetched with a few large reads.
+    /// The cache learns which branches are used from the first
+    /// "learnEntries" entries that are read, so branches that aren't read
+    /// (see SetIncludedDatums()) are not fetched.  The cache is restarted
+    /// (and learns again) when the datum selection changes, and after the
+    /// context branch is scanned (see ReadContext()).  A size of zero turns off the cache,
+    /// and a negative size leaves the ROOT default.
+    void SetCacheSize(Long64_t bytes, int learnEntries = 10);
+
+    /// Return the size of the tree cache (see SetCacheSize()).
+    Long64_t GetCacheSize(void) const {return fCacheSize;}
+
+    /// Return a one line summary of the reads through the tree cache, or an
+    /// empty string if the cache isn't used.  This stops the read-ahead
+    /// thread, so it should be used after the last event is read.
+    std::string GetCacheStatistics(void);
+
 private:
+    /// Read events from the tree on a background thread.
+    class TReadAhead;
+
+    /// Read the entries of the event tree and put the split datums back
+    /// into the events.
+    class TEntryReader;
+
+    /// Find the first entry after the "start" entry that is at or after the
+    /// context, using only the tree index and the "Context" branch.  This
+    /// returns the number of entries if there isn't a matching entry, and -1
+    /// if the event tree doesn't have the branch.
+    Long64_t FindEntry(const CP::TEventContext& context, Long64_t start);
+
+    /// Stop the read-ahead thread (if any), save the reads through its
+    /// cache, and delete it.
+    void DeleteReadAhead(void);
+
+    /// Choose the datum branches that need to be read for the included and
+    /// excluded datums, and turn off the other datum branches.
+    void SelectDatumBranches(void);
+
+    /// Read the "Context" branch for all of the entries in the event tree.
+    /// This returns false if the tree doesn't have the branch.
+    bool ReadContextBranch(void);
+
+    /// Make a new tree cache so that it learns the branches again.  The
+    /// statistics of the old cache are saved.
+    void ResetCache(void);
+
     TFile* fFile;               // The file to get events from.
     Int_t fSequence;            // The sequence number of the last event read.
 
@@ -105,6 +216,33 @@ private:
     
     Int_t fEventsRead;          //! count of events read from file
     bool fAttached;             //! are we prepared to read from the file?
+    TEntryReader* fEntryReader; //! the reader for the event tree.
+    TReadAhead* fReadAhead;     //! the events read on a background thread.
+
+    /// The contexts of the entries from the "Context" branch.
+    std::vector<CP::TEventContext> fContexts; //!
+    bool fContextsRead;         //! has the context branch been read?
+
+    /// The names of the branches with top-level datums.
+    std::vector<std::string> fDatumBranches; //!
+
+    /// The names of the datum branches that are read.
+    std::vector<std::string> fReadDatums; //!
+
+    /// The paths of the datums that are kept when an event is read.
+    std::vector<std::string> fIncludedDatums; //!
+
+    /// The paths of the datums that are removed when an event is read.
+    std::vector<std::string> fExcludedDatums; //!
+
+    Long64_t fCacheSize;        //! the size of the tree cache.
+    int fCacheLearnEntries;     //! the entries used to learn the branches.
+
+    /// The reads through the tree caches that have been replaced.
+    Long64_t fCacheBytesRead;   //! bytes read through the cache.
+    Long64_t fCacheMissBytes;   //! bytes that weren't in the cache.
+    Int_t fCacheReadCalls;      //! reads done by the cache.
+    Int_t fCacheMissCalls;      //! reads that weren't in the cache.
 
 #ifdef PRIVATE_COPY
 private:
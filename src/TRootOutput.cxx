@@ -5,8 +5,23 @@
 // native format.
 //
 
+#include <memory>
+#include <deque>
+#include <set>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <TROOT.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+#include <TBufferFile.h>
+#include <TExMap.h>
 #include <TGeoManager.h>
 #include <TKey.h>
 
@@ -17,18 +32,197 @@
 
 ClassImp(CP::TRootOutput);
 
+namespace {
+    /// Set the compression of the branches (and their sub-branches) so that
+    /// branches made before the compression was changed use it for the
+    /// baskets that are still to be written.
+    void SetBranchCompression(TObjArray* branches, int settings) {
+        for (int i = 0; branches && i < branches->GetEntriesFast(); ++i) {
+            TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+            if (!branch) continue;
+            branch->SetCompressionSettings(settings);
+            SetBranchCompression(branch->GetListOfBranches(), settings);
+        }
+    }
+
+    /// A buffer that lists the objects that were written into it.  ROOT
+    /// writes an object once for each buffer, and later references to it
+    /// (e.g. by a THandle or a pointer) are written as an offset.  Objects
+    /// that are written into the buffers of two different branches become
+    /// separate copies when they are read.
+    class TObjectListBuffer : public TBufferFile {
+    public:
+        TObjectListBuffer() : TBufferFile(TBuffer::kWrite) {}
+
+        /// Add the objects that have been written to a set.
+        void GetObjects(std::set<Long64_t>& objects) {
+            // The classes written to the buffer are in the same map, and
+            // are flagged in the offset (see TBufferFile.cxx).
+            const Long64_t classMask = 0x80000000;
+            if (!fMap) return;
+            TExMapIter next(fMap);
+            ULong64_t hash;
+            Long64_t key;
+            Long64_t value;
+            while (next.Next(hash,key,value)) {
+                if (value & classMask) continue;
+                objects.insert(key);
+            }
+        }
+    };
+
+    /// Return the objects that are written for an object.
+    std::set<Long64_t> WrittenObjects(const TObject* object) {
+        TObjectListBuffer buffer;
+        buffer.WriteObject(object);
+        std::set<Long64_t> objects;
+        buffer.GetObjects(objects);
+        return objects;
+    }
+
+    /// Return true if two sets of objects have an object in common.
+    bool SharesObjects(const std::set<Long64_t>& a,
+                       const std::set<Long64_t>& b) {
+        std::set<Long64_t>::const_iterator i = a.begin();
+        std::set<Long64_t>::const_iterator j = b.begin();
+        while (i != a.end() && j != b.end()) {
+            if (*i < *j) ++i;
+            else if (*j < *i) ++j;
+            else return true;
+        }
+        return false;
+    }
+}
+
+/// Fill the event tree on a background thread.  The events are taken from a
+/// bounded queue, and written to the tree.  While there are events in the
+/// queue (or being written), the writer thread is the only code touching the
+/// event tree and the file.  The written events are handed back to be
+/// deleted by the calling thread (see Release()) since deleting an event
+/// changes the event folder and the handle registry, which are not thread
+/// safe.
+class CP::TRootOutput::TWriter {
+public:
+    TWriter(CP::TRootOutput& output, int backlog)
+        : fOutput(output), fBacklog(backlog),
+          fBusy(false), fStop(false), fFailed(false) {
+        ROOT::EnableThreadSafety();
+        fThread = std::thread(&TWriter::Run, this);
+    }
+
+    /// Write the events that are still in the queue and stop the thread.
+    ~TWriter() {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fStop = true;
+        }
+        fWork.notify_all();
+        fThread.join();
+        Release();
+    }
+
+    int GetBacklog() const {return fBacklog;}
+
+    /// Add an event to the queue, waiting while the queue is full.
+    void Push(CP::TEvent* event) {
+        {
+            std::unique_lock<std::mutex> lock(fMutex);
+            while ((int) fQueue.size() >= fBacklog) fSpace.wait(lock);
+            fQueue.push_back(event);
+            fWork.notify_one();
+        }
+        Release();
+    }
+
+    /// Wait until the queue is empty and the thread is idle.
+    void Drain() {
+        {
+            std::unique_lock<std::mutex> lock(fMutex);
+            while (!fQueue.empty() || fBusy) fIdle.wait(lock);
+        }
+        Release();
+    }
+
+    /// Delete the events that have been written.  This must be called by
+    /// the thread that adopts the events.
+    void Release() {
+        std::deque<CP::TEvent*> written;
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            written.swap(fWritten);
+        }
+        for (std::deque<CP::TEvent*>::iterator e = written.begin();
+             e != written.end(); ++e) {
+            delete (*e);
+        }
+    }
+
+    /// Return true if there was an error writing an event, and reset the
+    /// error.
+    bool TakeFailure() {
+        std::lock_guard<std::mutex> lock(fMutex);
+        bool failed = fFailed;
+        fFailed = false;
+        return failed;
+    }
+
+private:
+    void Run() {
+        for (;;) {
+            CP::TEvent* event;
+            {
+                std::unique_lock<std::mutex> lock(fMutex);
+                while (!fStop && fQueue.empty()) fWork.wait(lock);
+                if (fQueue.empty()) break;
+                event = fQueue.front();
+                fQueue.pop_front();
+                fBusy = true;
+            }
+            fSpace.notify_one();
+            bool written = fOutput.FillEvent(*event);
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                fWritten.push_back(event);
+                if (!written) fFailed = true;
+                fBusy = false;
+            }
+            fIdle.notify_all();
+        }
+    }
+
+    CP::TRootOutput& fOutput;
+    int fBacklog;
+    std::deque<CP::TEvent*> fQueue;
+    std::deque<CP::TEvent*> fWritten;
+    bool fBusy;
+    bool fStop;
+    bool fFailed;
+    std::mutex fMutex;
+    std::condition_variable fSpace;
+    std::condition_variable fWork;
+    std::condition_variable fIdle;
+    std::thread fThread;
+};
+
 CP::TRootOutput::TRootOutput(const char *fileName,
                                Option_t* opt, 
                                int compress) 
     : TFile(fileName, opt, "ROOT Output File", compress),
-      fEventTree(NULL), fEventPointer(NULL), fAttached(false), 
-      fEventsWritten(0), fGeometry(NULL) {
+      fEventTree(NULL), fEventPointer(NULL), fContextPointer(NULL),
+      fAttached(false), 
+      fEventsWritten(0), fGeometry(NULL), fWriter(NULL), fBasketSize(128000) {
     CaptVerbose("Open output file " << fileName);
     IsAttached();
 }
 
 CP::TRootOutput::~TRootOutput(void) {
-    if (IsOpen()) Close();
+    if (!IsOpen()) return;
+    try {
+        Close();
+    }
+    catch (CP::ERootOutputWriteFailed&) {
+        CaptError("Output file " << GetName() << " closed with errors");
+    }
 }
 
 bool CP::TRootOutput::IsAttached(void) {
@@ -48,40 +242,377 @@ bool CP::TRootOutput::IsAttached(void) {
     // Make sure the object is attached
     fEventPointer = NULL;
     if (!fEventTree) {
+        // A file opened in UPDATE mode may already have events (e.g. when
+        // an event loop is resumed), so append to the existing tree.
+        fEventTree = dynamic_cast<TTree*>(Get("captainEventTree"));
+        if (fEventTree) {
+            CaptTrace("Attach to the existing tree");
+            AttachEventTree();
+            return fAttached;
+        }
         CaptTrace("Create a new tree");
         fEventTree = new TTree("captainEventTree", "Tree of CAPTAIN Events");
     }
     CaptTrace("Add the branch pointer");
-    fEventTree->Branch("Event","CP::TEvent",&fEventPointer,128000,0);
+    fEventTree->Branch("Event","CP::TEvent",&fEventPointer,fBasketSize,0);
+    // Save the context in a separate branch so it can be read (and
+    // indexed) without reading the full event.
+    fEventTree->Branch("Context","CP::TEventContext",&fContextPointer);
     fEventPointer = NULL;       // Make sure it's empty.
+    fContextPointer = NULL;
     fAttached = true;
 
     CaptTrace("Attached");
     return fAttached;
 }
 
-int CP::TRootOutput::GetEventsWritten(void) {return fEventsWritten;}
+void CP::TRootOutput::AttachEventTree(void) {
+    fEventTree->SetBranchAddress("Event",&fEventPointer);
+    if (fEventTree->GetBranch("Context")) {
+        fEventTree->SetBranchAddress("Context",&fContextPointer);
+    }
+    // Continue writing the datums that were split into separate branches.
+    TObjArray* branches = fEventTree->GetListOfBranches();
+    for (int i = 0; branches && i < branches->GetEntriesFast(); ++i) {
+        TBranch* branch = dynamic_cast<TBranch*>(branches->At(i));
+        if (!branch) continue;
+        if (std::string(branch->GetClassName()) != "CP::TDataVector") {
+            continue;
+        }
+        fSplitDatums.push_back(branch->GetName());
+    }
+    for (std::size_t i = 0; i < fSplitDatums.size(); ++i) {
+        fSplitHolders.push_back(new CP::TDataVector(fSplitDatums[i].c_str()));
+    }
+    for (std::size_t i = 0; i < fSplitDatums.size(); ++i) {
+        fEventTree->SetBranchAddress(fSplitDatums[i].c_str(),
+                                     &fSplitHolders[i]);
+    }
+    if (fEventTree->GetBranch(GetSplitPositionsName())) {
+        fSplitPositions.assign(fSplitDatums.size(), -1);
+        fEventTree->SetBranchAddress(GetSplitPositionsName(),
+                                     &fSplitPositions[0]);
+    }
+    fEventsWritten = fEventTree->GetEntries();
+    fEventPointer = NULL;
+    fContextPointer = NULL;
+    fAttached = true;
+}
+
+void CP::TRootOutput::AdoptEventTree(TTree* tree) {
+    if (!tree || tree == fEventTree) return;
+    Synchronize();
+    if (fEventsWritten > 0) {
+        CaptError("Cannot replace the event tree of " << GetName()
+                  << " after events are written");
+        throw CP::ERootOutputHasEvents();
+    }
+    // Deleting the tree removes it from the file.
+    delete fEventTree;
+    fEventTree = NULL;
+    for (std::size_t i = 0; i < fSplitHolders.size(); ++i) {
+        delete fSplitHolders[i];
+    }
+    fSplitHolders.clear();
+    fSplitDatums.clear();
+    fSplitPositions.clear();
+    fEventTree = tree;
+    fEventTree->SetDirectory(this);
+    AttachEventTree();
+}
+
+int CP::TRootOutput::GetEventsWritten(void) {
+    Synchronize();
+    return fEventsWritten;
+}
+
+Long64_t CP::TRootOutput::GetFileSize(void) {
+    Synchronize();
+    return GetEND();
+}
 
 void CP::TRootOutput::WriteEvent(CP::TEvent& event) {
     if (!IsAttached()) return;
-    // Copy the pointer into the location attached to the file.
-    fEventPointer = &event;
-    // Put the event into the tree;
-    if (fEventTree->Fill()<0) {
+    Synchronize();
+    if (!FillEvent(event)) {
         CaptError("Error while writing an event");
         throw CP::ERootOutputWriteFailed();
     }
+}
+
+void CP::TRootOutput::AdoptEvent(CP::TEvent* event) {
+    if (!event) return;
+    if (!fWriter) {
+        std::unique_ptr<CP::TEvent> owned(event);
+        WriteEvent(*owned);
+        return;
+    }
+    CheckWriter();
+    fWriter->Push(event);
+}
+
+void CP::TRootOutput::SetSplitDatums(const std::string& names) {
+    if (!IsAttached()) return;
+    Synchronize();
+    if (fEventTree->GetEntries() > 0) {
+        CaptError("Datums cannot be split after events are written to "
+                  << GetName());
+        return;
+    }
+    std::vector<std::string> added;
+    std::istringstream list(names);
+    std::string name;
+    while (std::getline(list,name,',')) {
+        if (name.empty()) continue;
+        if (fEventTree->GetBranch(name.c_str())) {
+            CaptError("Cannot split datum " << name
+                      << " since the branch already exists");
+            continue;
+        }
+        if (std::find(added.begin(),added.end(),name) != added.end()) {
+            continue;
+        }
+        added.push_back(name);
+    }
+    if (added.empty()) return;
+    if (!fSplitHolders.empty()) {
+        CaptError("Datums are already split in " << GetName());
+        return;
+    }
+    // The branches hold the address of the vector elements, so the vector
+    // must not change size after the branches are made.
+    fSplitDatums = added;
+    for (std::size_t i = 0; i < fSplitDatums.size(); ++i) {
+        fSplitHolders.push_back(new CP::TDataVector(fSplitDatums[i].c_str()));
+    }
+    cd();
+    for (std::size_t i = 0; i < fSplitDatums.size(); ++i) {
+        CaptInfo("Write datum " << fSplitDatums[i] << " in a separate branch");
+        fEventTree->Branch(fSplitDatums[i].c_str(),"CP::TDataVector",
+                           &fSplitHolders[i],fBasketSize,0);
+    }
+    // The positions are a fixed length array with an element for each
+    // split datum.
+    fSplitPositions.assign(fSplitDatums.size(), -1);
+    std::ostringstream leaves;
+    leaves << GetSplitPositionsName() << "[" << fSplitPositions.size()
+           << "]/I";
+    fEventTree->Branch(GetSplitPositionsName(),&fSplitPositions[0],
+                       leaves.str().c_str(),fBasketSize);
+}
+
+int CP::TRootOutput::GetCompressionAlgorithm(const std::string& algorithm) {
+    std::string name(algorithm);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   (int(*)(int)) std::tolower);
+    // The values of ROOT::RCompressionSetting::EAlgorithm.
+    if (name == "zlib") return 1;
+    if (name == "lzma") return 2;
+    if (name == "lz4") return 4;
+    if (name == "zstd") return 5;
+    return -1;
+}
+
+void CP::TRootOutput::SetCompression(const std::string& algorithm,
+                                     int level) {
+    int number = GetCompressionAlgorithm(algorithm);
+    if (number < 0) {
+        CaptError("Unknown compression algorithm " << algorithm);
+        throw CP::ERootOutputBadCompression();
+    }
+    if (level < 0) level = 0;
+    if (level > 9) level = 9;
+    if (!IsAttached()) return;
+    Synchronize();
+    CaptInfo("Compress " << GetName() << " with " << algorithm
+             << " at level " << level);
+    SetCompressionSettings(100*number + level);
+    SetBranchCompression(fEventTree->GetListOfBranches(),
+                         GetCompressionSettings());
+}
+
+void CP::TRootOutput::SetBasketSize(int bytes) {
+    if (bytes < 1) return;
+    fBasketSize = bytes;
+    if (!IsAttached()) return;
+    Synchronize();
+    fEventTree->SetBasketSize("*",fBasketSize);
+}
+
+void CP::TRootOutput::SetAutoFlush(Long64_t entries) {
+    if (!IsAttached()) return;
+    Synchronize();
+    fEventTree->SetAutoFlush(entries);
+}
+
+bool CP::TRootOutput::FillEvent(CP::TEvent& event) {
+    // Move the split datums out of the event and into the containers for
+    // their branches.  The position of each datum in the event is saved so
+    // that the event can be put back together after it is written.
+    std::vector< std::pair<int,std::size_t> > moved;
+    std::vector<CP::TDatum*> datums(fSplitDatums.size(), NULL);
+    for (std::size_t i = 0; i < fSplitDatums.size(); ++i) {
+        int index = 0;
+        for (CP::TDataVector::iterator d = event.begin();
+             d != event.end(); ++d, ++index) {
+            if (fSplitDatums[i] != (*d)->GetName()) continue;
+            if (event.IsTemporary(*d)) break;
+            datums[i] = *d;
+            moved.push_back(std::make_pair(index,i));
+            break;
+        }
+    }
+    std::sort(moved.begin(), moved.end());
+    for (std::size_t i = 0; i < datums.size(); ++i) {
+        if (!datums[i]) continue;
+        event.erase(datums[i]);
+        fSplitHolders[i]->push_back(datums[i]);
+    }
+    if (!moved.empty()) KeepSharedDatums(event, datums, moved);
+    for (std::size_t i = 0; i < fSplitPositions.size(); ++i) {
+        fSplitPositions[i] = -1;
+    }
+    for (std::size_t m = 0; m < moved.size(); ++m) {
+        if (fSplitPositions.empty()) break;
+        fSplitPositions[moved[m].second] = moved[m].first;
+    }
+
+    // Copy the pointer into the location attached to the file.
+    fEventPointer = &event;
+    fContextPointer = const_cast<CP::TEventContext*>(&event.GetContext());
+    // Put the event into the tree;
+    int status = fEventTree->Fill();
     // Empty out the fEventPointer so that it can't be written twice.
     fEventPointer = NULL;
+    fContextPointer = NULL;
+
+    // Put the split datums back into the event in their original order.
+    for (std::size_t m = 0; m < moved.size(); ++m) {
+        CP::TDatum* datum = datums[moved[m].second];
+        fSplitHolders[moved[m].second]->erase(datum);
+        CP::TDataVector::iterator position = event.begin();
+        std::advance(position, moved[m].first);
+        if (position != event.end() && !event.IsTemporary(*position)) {
+            event.insert(position, datum);
+        }
+        else {
+            event.push_back(datum);
+        }
+    }
+
+    if (status < 0) return false;
+    ++fEventsWritten;
+    return true;
+}
+
+void CP::TRootOutput::KeepSharedDatums(
+    CP::TEvent& event,
+    std::vector<CP::TDatum*>& datums,
+    std::vector< std::pair<int,std::size_t> >& moved) {
+    // Find the objects written with each branch.
+    std::set<Long64_t> eventObjects = WrittenObjects(&event);
+    std::vector< std::set<Long64_t> > splitObjects(moved.size());
+    for (std::size_t m = 0; m < moved.size(); ++m) {
+        splitObjects[m] = WrittenObjects(fSplitHolders[moved[m].second]);
+    }
+
+    // A datum that shares an object with another branch stays in the
+    // "Event" branch, and then the objects it shares have to be checked
+    // against the datums that are still split.
+    std::vector<bool> kept(moved.size(), false);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (std::size_t m = 0; m < moved.size(); ++m) {
+            if (kept[m]) continue;
+            bool shared = SharesObjects(splitObjects[m], eventObjects);
+            for (std::size_t n = 0; !shared && n < moved.size(); ++n) {
+                if (n == m || kept[n]) continue;
+                shared = SharesObjects(splitObjects[m], splitObjects[n]);
+            }
+            if (!shared) continue;
+            CaptWarn("Datum " << fSplitDatums[moved[m].second]
+                     << " shares objects with other datums and is not"
+                     << " split from event " << event.GetContext());
+            kept[m] = true;
+            eventObjects.insert(splitObjects[m].begin(),
+                                splitObjects[m].end());
+            changed = true;
+        }
+    }
+
+    // Put the shared datums back into the event.  The datums that are still
+    // split are missing from the event, so the position is moved back by
+    // the number of split datums in front of it.
+    std::vector< std::pair<int,std::size_t> > split;
+    for (std::size_t m = 0; m < moved.size(); ++m) {
+        if (!kept[m]) {
+            split.push_back(moved[m]);
+            continue;
+        }
+        std::size_t i = moved[m].second;
+        fSplitHolders[i]->erase(datums[i]);
+        CP::TDataVector::iterator position = event.begin();
+        std::advance(position, moved[m].first - split.size());
+        if (position != event.end() && !event.IsTemporary(*position)) {
+            event.insert(position, datums[i]);
+        }
+        else {
+            event.push_back(datums[i]);
+        }
+        datums[i] = NULL;
+    }
+    moved.swap(split);
+}
+
+void CP::TRootOutput::SetAsynchronous(int backlog) {
+    if (fWriter && fWriter->GetBacklog() == backlog) return;
+    if (fWriter) {
+        fWriter->Drain();
+        bool failed = fWriter->TakeFailure();
+        delete fWriter;
+        fWriter = NULL;
+        if (failed) {
+            CaptError("Error while writing an event");
+            throw CP::ERootOutputWriteFailed();
+        }
+    }
+    if (backlog < 1) return;
+    if (!IsAttached()) return;
+    CaptInfo("Write " << GetName() << " with a backlog of " << backlog);
+    fWriter = new TWriter(*this, backlog);
+}
+
+int CP::TRootOutput::GetAsynchronous(void) const {
+    if (!fWriter) return 0;
+    return fWriter->GetBacklog();
+}
+
+void CP::TRootOutput::Synchronize(void) {
+    if (!fWriter) return;
+    fWriter->Drain();
+    CheckWriter();
+}
+
+void CP::TRootOutput::CheckWriter(void) {
+    if (!fWriter || !fWriter->TakeFailure()) return;
+    CaptError("Error while writing an event");
+    throw CP::ERootOutputWriteFailed();
 }
 
 // Save a geometry to the output file.
 void CP::TRootOutput::WriteGeometry(TGeoManager* geom) {
     if (!IsAttached()) return;
     if (!geom) return;
+    // This is called for every event that is saved, so check for the
+    // geometry that is already saved before waiting for the asynchronous
+    // writer.
+    if (geom == fGeometry && fGeometryName == geom->GetName()) return;
+    Synchronize();
+    fGeometry = geom;
+    fGeometryName = geom->GetName();
     TKey *key = FindKey(geom->GetName());
     if (key) return;
-    fGeometry = geom;
     if (geom->Write()<1) {
         CaptError("Error while writing geometry");
         throw CP::ERootOutputWriteFailed();
@@ -96,15 +627,65 @@ bool CP::TRootOutput::GeometryWritten(void) {
     
 void CP::TRootOutput::Commit(void) {
     if (!IsAttached()) return;
+    Synchronize();
     fEventTree->AutoSave();
     Flush();
 }
 
 void CP::TRootOutput::Close(Option_t* opt) {
+    // Stop the writer after it has finished the backlog, but hold any error
+    // until the file has been closed.
+    bool failed = false;
+    if (fWriter) {
+        fWriter->Drain();
+        failed = fWriter->TakeFailure();
+        delete fWriter;
+        fWriter = NULL;
+    }
+    // Index the events by run and event number.  The index is saved with
+    // the tree.
+    if (IsOpen() && fEventTree && fEventTree->GetEntries() > 0
+        && fEventTree->GetBranch("Context")) {
+        cd();
+        fEventTree->BuildIndex(GetIndexMajorName(),GetIndexMinorName());
+    }
     Write();
     if (CP::TCaptLog::LogLevel <= CP::TCaptLog::GetLogLevel()) {
         TFile::ls();
     }
     TFile::Close(opt);
+    // The tree was deleted when the file was closed.
+    fEventTree = NULL;
+    fAttached = false;
+    for (std::size_t i = 0; i < fSplitHolders.size(); ++i) {
+        delete fSplitHolders[i];
+    }
+    fSplitHolders.clear();
+    fSplitDatums.clear();
+    fSplitPositions.clear();
+    if (failed) {
+        CaptError("Error while writing an event");
+        throw CP::ERootOutputWriteFailed();
+    }
+}
+
+Int_t CP::TRootOutput::WriteTObject(const TObject* obj, const char* name,
+                                    Option_t* option, Int_t bufsize) {
+    Synchronize();
+    return TFile::WriteTObject(obj,name,option,bufsize);
+}
+
+Int_t CP::TRootOutput::WriteObjectAny(const void* obj, const char* className,
+                                      const char* name, Option_t* option,
+                                      Int_t bufsize) {
+    Synchronize();
+    return TFile::WriteObjectAny(obj,className,name,option,bufsize);
+}
+
+Int_t CP::TRootOutput::WriteObjectAny(const void* obj, const TClass* cl,
+                                      const char* name, Option_t* option,
+                                      Int_t bufsize) {
+    Synchronize();
+    return TFile::WriteObjectAny(obj,cl,name,option,bufsize);
 }
 
@@ -2,16 +2,23 @@
 #ifndef TRootOutput_hxx_seen
 #define TRootOutput_hxx_seen
 
+#include <string>
+#include <vector>
+
 #include <TROOT.h>
 #include <TFile.h>
 
 #include <ECore.hxx>
 
 class TTree;
+class TClass;
 class TGeoManager;
 
 namespace CP {
     class TEvent;
+    class TEventContext;
+    class TDataVector;
+    class TDatum;
     class TRootOutput;
 
     /// Base class for output errors.
@@ -19,14 +26,31 @@ namespace CP {
 
     /// An error occurred during WriteEvent.
     EXCEPTION(ERootOutputWriteFailed, ERootOutput);
+
+    /// An unknown compression algorithm was requested.
+    EXCEPTION(ERootOutputBadCompression, ERootOutput);
+
+    /// The event tree was replaced after events were written.
+    EXCEPTION(ERootOutputHasEvents, ERootOutput);
 }
 
 /// Attach to a file so that the events can be written.  This can also write
 /// the geometry to the output file.  This will work with any file name, but
-/// the preferred file extension is [name].root.
+/// the preferred file extension is [name].root.  The event tree has the
+/// "Event" branch with the full event, and the "Context" branch with a copy
+/// of the event context.  The context can be read without reading the full
+/// event (see CP::TRootInput::ReadContext()).  The tree is indexed by the run
+/// and event numbers in the context when the file is closed so that events
+/// can be found without reading the file (see CP::TRootInput::FindEvent()).
+/// The top-level datums of the event (e.g. "digits", "hits", "truth" and
+/// "fits") can also be written to separate branches (see SetSplitDatums())
+/// so that they can be read independently.  The position of each split datum
+/// in the event is saved in the "SplitPositions" branch so the event is read
+/// back in the original order.
 class CP::TRootOutput : public TFile {
 public:
-    /// Open a new output file.
+    /// Open a new output file.  If an existing file is opened in "UPDATE"
+    /// mode, the events are added to the end of the event tree in the file.
     TRootOutput(const char* name,
                 Option_t* opt="CREATE",
                 Int_t compress = 1);
@@ -39,12 +63,118 @@ public:
     /// Return true if the file is attached and ready for writting.
     virtual bool IsAttached(void);
 
-    /// Return the number of events written to the output file.
+    /// Return the number of events written to the output file.  This waits
+    /// for the asynchronous writer to finish the backlog.
     virtual int GetEventsWritten(void);
+
+    /// Return the number of bytes that have been written to the output file.
+    /// The baskets that are still in memory are not counted, so this can be
+    /// short by up to the auto flush size (see SetAutoFlush()).  This waits
+    /// for the asynchronous writer to finish the backlog.
+    virtual Long64_t GetFileSize(void);
     
-    /// Write an event to the current output file. 
+    /// Write an event to the current output file.  If the file is writing
+    /// asynchronously, this waits for the events in the backlog to be
+    /// written, and then writes the event on the calling thread (the caller
+    /// keeps ownership of the event, so it can't be handed to the writer).
+    /// Use AdoptEvent() to get the benefit of the asynchronous writer.
     virtual void WriteEvent(TEvent& event);
+
+    /// Write an event to the current output file and take ownership of it.
+    /// The event is deleted after it has been written.  If the file is
+    /// writing asynchronously, the event is added to the backlog and is
+    /// serialized and compressed on the writer thread.  This blocks while
+    /// the backlog is full.  The caller must not touch the event after it
+    /// has been adopted.  The writer thread only reads the event.  It's
+    /// deleted on the calling thread by a later AdoptEvent(), Synchronize()
+    /// or Close() since the event folder and the handle registry are not
+    /// thread safe.
+    virtual void AdoptEvent(TEvent* event);
+
+    /// Write the events on a dedicated writer thread so that the basket
+    /// compression doesn't block the caller.  The backlog is the maximum
+    /// number of events waiting to be written.  A backlog of zero (the
+    /// default) writes the events on the calling thread.  An error writing
+    /// an event on the writer thread is reported by throwing
+    /// ERootOutputWriteFailed from the next call to AdoptEvent(),
+    /// WriteEvent(), Synchronize(), Commit(), or Close().
+    void SetAsynchronous(int backlog);
+
+    /// Return the maximum backlog for the asynchronous writer, or zero if
+    /// events are written on the calling thread.
+    int GetAsynchronous(void) const;
+
+    /// Write the top-level datums with these names (a comma separated list,
+    /// e.g. "digits,hits,truth,fits") into separate branches of the event
+    /// tree instead of the "Event" branch.  Each datum branch holds a
+    /// CP::TDataVector with the datum (or nothing when the event doesn't
+    /// have it), and CP::TRootInput puts the event back together when it
+    /// is read.  A datum that shares objects with the rest of the event
+    /// (e.g. fits with handles to the hits) is kept in the "Event" branch
+    /// for that event with a warning, since the objects would be separate
+    /// copies after the event is read.  This must be called before the
+    /// first event is written.  Datums that are not in the list stay in the
+    /// "Event" branch.
+    void SetSplitDatums(const std::string& names);
+
+    /// Return the names of the top-level datums that are written to
+    /// separate branches.
+    const std::vector<std::string>& GetSplitDatums(void) const {
+        return fSplitDatums;
+    }
+
+    /// Set the compression of the output file.  The algorithm is "zlib",
+    /// "lzma", "lz4" or "zstd" (case doesn't matter), and the level is from
+    /// 0 (no compression) to 9.  The compression is used for the baskets
+    /// written after the call, so it should be set before the first event
+    /// is written.  An unknown algorithm throws ERootOutputBadCompression.
+    void SetCompression(const std::string& algorithm, int level);
+
+    /// Return the expressions for the run and event numbers used to index
+    /// the event tree (see TTree::BuildIndex()).
+    /// @{
+    static const char* GetIndexMajorName(void) {return "Context.fRun";}
+    static const char* GetIndexMinorName(void) {return "Context.fEvent";}
+    /// @}
+
+    /// Return the name of the branch with the position of each split datum
+    /// in the event when it was written (-1 when the event doesn't have the
+    /// datum).  The positions are in the order of the datum branches, and
+    /// are used by CP::TRootInput to put the event back together in the
+    /// original order.
+    static const char* GetSplitPositionsName(void) {return "SplitPositions";}
+
+    /// Return the ROOT number of a compression algorithm (e.g. "zstd"), or
+    /// -1 if the algorithm isn't known.
+    static int GetCompressionAlgorithm(const std::string& algorithm);
+
+    /// Set the basket size (in bytes) for the branches of the event tree.
+    /// The default is 128000 bytes.  Larger baskets compress better, but
+    /// use more memory while reading and writing.
+    void SetBasketSize(int bytes);
+
+    /// Return the basket size for the branches of the event tree.
+    int GetBasketSize(void) const {return fBasketSize;}
+
+    /// Set how often the baskets of the event tree are flushed to the file
+    /// (see TTree::SetAutoFlush()).  A positive value is a number of
+    /// events, a negative value is a number of bytes, and zero turns off
+    /// the automatic flushing.
+    void SetAutoFlush(Long64_t entries);
+
+    /// Wait until all of the events in the backlog have been written to the
+    /// output tree.  This doesn't flush the file (see Commit()).
+    virtual void Synchronize(void);
     
+    /// Replace the event tree of the file with a tree that was filled some
+    /// other way (e.g. by fast cloning the trees of other files, see
+    /// CP::TEventFileMerger).  The tree must be a "captainEventTree" made
+    /// for this file.  The empty tree made by the file is deleted, so the
+    /// file is saved with only one event tree, and later events are added
+    /// to the adopted tree.  This throws ERootOutputHasEvents if events
+    /// have already been written to the file.
+    void AdoptEventTree(TTree* tree);
+
     /// Write the geometry data base to the output file.
     virtual void WriteGeometry(TGeoManager* geom);
 
@@ -58,18 +188,76 @@ public:
     
     /// Close the ROOT output file.  No default parameter since there
     /// must be a Close(void) function to satisfy the TRootOutput
-    /// abstract class which defines a pure virtual Close(void).
+    /// abstract class which defines a pure virtual Close(void).  If the
+    /// asynchronous writer failed to write an event that hasn't been
+    /// reported yet, the file is closed and then ERootOutputWriteFailed is
+    /// thrown, so a caller using SetAsynchronous() should catch it.  The
+    /// destructor reports the error without throwing.
     virtual void Close(Option_t* opt = "");
+
+    /// Write an object to the file.  This waits for the asynchronous writer
+    /// since the file can only be written by one thread at a time.
+    virtual Int_t WriteTObject(const TObject* obj, const char* name = 0,
+                               Option_t* option = "", Int_t bufsize = 0);
+
+    /// Write an object to the file.  This waits for the asynchronous writer.
+    virtual Int_t WriteObjectAny(const void* obj, const char* className,
+                                 const char* name, Option_t* option = "",
+                                 Int_t bufsize = 0);
+
+    /// Write an object to the file.  This waits for the asynchronous writer.
+    virtual Int_t WriteObjectAny(const void* obj, const TClass* cl,
+                                 const char* name, Option_t* option = "",
+                                 Int_t bufsize = 0);
     
 private:
     TRootOutput(const TRootOutput& aFile);
+
+    /// The thread that fills the event tree for asynchronous output.
+    class TWriter;
+
+    /// Fill the event tree with an event.  This returns false if there was
+    /// an error.
+    bool FillEvent(TEvent& event);
+
+    /// Put the split datums that share objects with the rest of the event
+    /// back into the event, and remove them from the moved datums (the
+    /// position in the event and the index of the split datum, sorted by
+    /// position).
+    void KeepSharedDatums(TEvent& event,
+                          std::vector<CP::TDatum*>& datums,
+                          std::vector< std::pair<int,std::size_t> >& moved);
+
+    /// Report a failure of the asynchronous writer (if any) by throwing
+    /// ERootOutputWriteFailed.
+    void CheckWriter(void);
+
+    /// Set the branch addresses of an event tree that already exists (e.g.
+    /// in a file opened in "UPDATE" mode), so that events are added to it.
+    void AttachEventTree(void);
     
     TTree *fEventTree;          // The tree with events. 
     TEvent *fEventPointer; // A memory location for the event pointer.
+    TEventContext *fContextPointer; // The context of the event being written.
     
     bool fAttached;             // True if the file is ready for writing.
     int fEventsWritten;         // Number of events written to file.
     TGeoManager* fGeometry;     // The geometry saved in the output file.
+    std::string fGeometryName;  //! The name of the saved geometry.
+    TWriter* fWriter;           //! The asynchronous writer (if any).
+    int fBasketSize;            //! The basket size for new branches.
+
+    /// The names of the top-level datums written to separate branches.
+    std::vector<std::string> fSplitDatums; //!
+
+    /// The containers attached to the datum branches (one for each name in
+    /// fSplitDatums).
+    std::vector<CP::TDataVector*> fSplitHolders; //!
+
+    /// The positions of the split datums in the event being written (one
+    /// for each name in fSplitDatums).  This is empty for a file written
+    /// without the positions.
+    std::vector<Int_t> fSplitPositions; //!
 
     ClassDef(TRootOutput,0);
 };
@@ -181,8 +181,12 @@ CP::TRuntimeParameters::TryLoadingParametersFile(std::string parameterName) {
     std::transform(packageROOT.begin(), packageROOT.end(),packageROOT.begin(),
                    (int(*)(int)) std::toupper);
     
-    std::string dirName =  std::getenv(packageROOT.c_str()) 
-        + std::string("/parameters/");
+    const char* packageDir = std::getenv(packageROOT.c_str());
+    if (!packageDir) {
+        CaptInfo("Package directory " << packageROOT << " is not set");
+        return false;
+    }
+    std::string dirName =  packageDir + std::string("/parameters/");
 
     // Now try reading in this file.  Last input variable is set to true,
     // indicating that we don't want to throw exception if a file is not found.
@@ -0,0 +1,209 @@
+//
+// Implement a class to read events from a pipe or FIFO.
+//
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <TBufferFile.h>
+#include <TMemFile.h>
+#include <TDirectory.h>
+
+#include "TStreamInput.hxx"
+#include "TStreamOutput.hxx"
+#include "TRootInput.hxx"
+#include "TEvent.hxx"
+#include "TManager.hxx"
+#include "TInputManager.hxx"
+#include "TCaptLog.hxx"
+
+namespace {
+    class TStreamInputBuilder : public CP::TVInputBuilder {
+    public:
+        TStreamInputBuilder()
+            : CP::TVInputBuilder("stream",
+                                 "Read events from a pipe, a FIFO,"
+                                 " or standard input (\"-\")") {}
+        CP::TVInputFile* Open(const char* file) const {
+            return new CP::TStreamInput(file);
+        }
+    };
+
+    class TStreamInputRegistration {
+    public:
+        TStreamInputRegistration() {
+            CP::TManager::Get().Input().Register(new TStreamInputBuilder());
+        }
+    };
+    TStreamInputRegistration registrationObject;
+
+    /// Return the little-endian 32 bit word at the start of the data.
+    unsigned int GetWord(const char* data) {
+        const unsigned char* bytes
+            = reinterpret_cast<const unsigned char*>(data);
+        return bytes[0]
+            | (bytes[1] << 8)
+            | (bytes[2] << 16)
+            | (static_cast<unsigned int>(bytes[3]) << 24);
+    }
+}
+
+CP::TStreamInput::TStreamInput(const char* name)
+    : fName(name ? name: ""), fDescriptor(-1), fGeometryFile(NULL),
+      fSequence(-1), fEndOfFile(false) {
+    struct stat status;
+    if (fName.empty()
+        || (fName != "-" && stat(fName.c_str(), &status) != 0)) {
+        CaptError("Input stream " << fName << " does not exist");
+        fName = "";
+        throw CP::EInputFileMissing();
+    }
+}
+
+CP::TStreamInput::~TStreamInput() {
+    CloseFile();
+}
+
+bool CP::TStreamInput::ReadBytes(char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t count = read(fDescriptor, data, size);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            CaptError("Error reading input stream " << fName
+                      << ": " << std::strerror(errno));
+            return false;
+        }
+        if (count == 0) return false;
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool CP::TStreamInput::OpenStream(void) {
+    if (fDescriptor >= 0) return true;
+    if (fEndOfFile) return false;
+    if (fName == "-") fDescriptor = dup(STDIN_FILENO);
+    else fDescriptor = open(fName.c_str(), O_RDONLY);
+    if (fDescriptor < 0) {
+        CaptError("Cannot open input stream " << fName
+                  << ": " << std::strerror(errno));
+        throw CP::EInputFileMissing();
+    }
+    char header[16];
+    if (!ReadBytes(header, sizeof(header))) {
+        CaptWarn("Input stream " << fName << " is empty");
+        fEndOfFile = true;
+        fSequence = 0;
+        return false;
+    }
+    if (std::memcmp(header, CP::TStreamOutput::GetMagic(), 8) != 0) {
+        CaptError("Input " << fName << " is not an event stream");
+        throw CP::EStreamFormat();
+    }
+    unsigned int version = GetWord(header+8);
+    if (version != CP::TStreamOutput::kVersion) {
+        CaptError("Input stream " << fName << " has version " << version
+                  << " (expected " << CP::TStreamOutput::kVersion << ")");
+        throw CP::EStreamFormat();
+    }
+    return true;
+}
+
+unsigned int CP::TStreamInput::ReadRecord(void) {
+    char header[8];
+    fBuffer.clear();
+    if (!ReadBytes(header, sizeof(header))) {
+        CaptWarn("Input stream " << fName << " ended without an end record");
+        return CP::TStreamOutput::kEndRecord;
+    }
+    unsigned int type = GetWord(header);
+    std::size_t size = GetWord(header+4);
+    fBuffer.resize(size);
+    if (size > 0 && !ReadBytes(&fBuffer[0], size)) {
+        CaptError("Input stream " << fName << " has a truncated record");
+        fBuffer.clear();
+        return CP::TStreamOutput::kEndRecord;
+    }
+    return type;
+}
+
+void CP::TStreamInput::ReadGeometry(void) {
+    TDirectory* oldDirectory = gDirectory;
+    TFile* file = new TMemFile("stream-geometry.root",
+                               &fBuffer[0], fBuffer.size(), "READ");
+    if (oldDirectory) oldDirectory->cd();
+    if (!file->IsOpen() || file->IsZombie()) {
+        CaptError("Bad geometry record in input stream " << fName);
+        delete file;
+        return;
+    }
+    if (CP::TManager::Get().CurrentInputFile() == fGeometryFile) {
+        CP::TManager::Get().SetCurrentInputFile(NULL);
+    }
+    delete fGeometryFile;
+    fGeometryFile = file;
+    CP::TManager::Get().SetCurrentInputFile(fGeometryFile);
+    CaptVerbose("Geometry read from input stream " << fName);
+}
+
+CP::TEvent* CP::TStreamInput::FirstEvent(void) {
+    if (fSequence >= 0) {
+        CaptError("Input stream " << fName << " cannot be rewound");
+        throw CP::EStreamFormat();
+    }
+    return NextEvent();
+}
+
+CP::TEvent* CP::TStreamInput::NextEvent(int skip) {
+    if (fEndOfFile || !OpenStream()) return NULL;
+    for (;;) {
+        unsigned int type = ReadRecord();
+        if (type == CP::TStreamOutput::kEndRecord) {
+            // The position at the end is the number of events read.
+            fEndOfFile = true;
+            ++fSequence;
+            return NULL;
+        }
+        if (type == CP::TStreamOutput::kGeometryRecord) {
+            ReadGeometry();
+            continue;
+        }
+        if (type != CP::TStreamOutput::kEventRecord) {
+            CaptWarn("Skip record of type " << type
+                     << " in input stream " << fName);
+            continue;
+        }
+        ++fSequence;
+        if (skip-- > 0) continue;
+        TBufferFile buffer(TBuffer::kRead, fBuffer.size(),
+                           &fBuffer[0], kFALSE);
+        CP::TEvent* event = static_cast<CP::TEvent*>(
+            buffer.ReadObjectAny(CP::TEvent::Class()));
+        if (!event) {
+            CaptError("Bad event record in input stream " << fName);
+            continue;
+        }
+        // Like TRootInput, make sure the geometry is found in this input.
+        if (fGeometryFile) {
+            CP::TManager::Get().SetCurrentInputFile(fGeometryFile);
+        }
+        return event;
+    }
+}
+
+void CP::TStreamInput::CloseFile(void) {
+    if (fDescriptor >= 0) close(fDescriptor);
+    fDescriptor = -1;
+    if (fGeometryFile) {
+        if (CP::TManager::Get().CurrentInputFile() == fGeometryFile) {
+            CP::TManager::Get().SetCurrentInputFile(NULL);
+        }
+        delete fGeometryFile;
+        fGeometryFile = NULL;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef TStreamInput_hxx_seen
+#define TStreamInput_hxx_seen
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "ECore.hxx"
+#include "TVInputFile.hxx"
+
+class TFile;
+
+namespace CP {
+    class TEvent;
+    class TStreamInput;
+
+    /// The input stream doesn't have the expected layout.
+    EXCEPTION(EStreamFormat,EInputFile);
+}
+
+/// Read the events written by CP::TStreamOutput from a pipe, a FIFO, or
+/// standard input (the name "-").  This is registered with TInputManager as
+/// the "stream" input, so event loop stages can be run as a shell pipeline
+/// without writing intermediate files.
+///
+/// \code
+/// convert.exe --stream-output - raw.dat | recon.exe -t stream -o out.root -
+/// \endcode
+///
+/// See CP::TStreamOutput for the layout of the stream.  The stream isn't
+/// opened until the first event is read, so the input can be counted (the
+/// count is unknown) without taking any data from the pipe.  When a geometry
+/// record is read, it becomes the current input file of CP::TManager so that
+/// the geometry for the following events is found the same way as for a ROOT
+/// input file.  The stream can only be read forward, so FirstEvent() can
+/// only be called before any other event has been read, and
+/// PreviousEvent() always returns NULL.
+class CP::TStreamInput : public TVInputFile {
+public:
+    /// Prepare to read a stream.  This throws CP::EInputFileMissing if the
+    /// name isn't "-" and doesn't exist.
+    explicit TStreamInput(const char* name);
+
+    virtual ~TStreamInput();
+
+    /// Return the first event in the stream.  This throws CP::EStreamFormat
+    /// if events have already been read.
+    virtual TEvent* FirstEvent(void);
+
+    /// Read the next event in the stream after skipping "skip" events.
+    virtual TEvent* NextEvent(int skip = 0);
+
+    /// Return the entry of the last event read.
+    virtual int GetPosition(void) const {return fSequence;}
+
+    /// Flag that the stream can be read.
+    virtual bool IsOpen(void) {return !fName.empty();}
+
+    /// Flag that the end of the stream has been reached.
+    virtual bool EndOfFile(void) {return fEndOfFile;}
+
+    /// Close the stream.
+    virtual void CloseFile(void);
+
+    /// Return the name of the stream.
+    virtual const char* GetFilename() const {return fName.c_str();}
+
+private:
+    /// Open the stream and check the header.  This returns false at the end
+    /// of the stream.
+    bool OpenStream(void);
+
+    /// Read the next record into fBuffer and return its type.  This returns
+    /// the end record type at the end of the stream.
+    unsigned int ReadRecord(void);
+
+    /// Read a block of bytes.  This returns false if the stream ends first.
+    bool ReadBytes(char* data, std::size_t size);
+
+    /// Make the geometry in fBuffer the current input file of TManager.
+    void ReadGeometry(void);
+
+    /// The name of the stream.
+    std::string fName;
+
+    /// The file descriptor of the stream.
+    int fDescriptor;
+
+    /// The data of the last record read.
+    std::vector<char> fBuffer;
+
+    /// The ROOT file (in memory) with the geometry from the stream.
+    TFile* fGeometryFile;
+
+    /// The entry of the last event read.
+    int fSequence;
+
+    /// Flag that the end of the stream has been reached.
+    bool fEndOfFile;
+};
+#endif
@@ -0,0 +1,167 @@
+//
+// Implement a class to write events to a pipe or FIFO.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <TBufferFile.h>
+#include <TMemFile.h>
+#include <TGeoManager.h>
+#include <TDirectory.h>
+
+#include "TStreamOutput.hxx"
+#include "TEvent.hxx"
+#include "TCaptLog.hxx"
+
+namespace {
+    /// Append a little-endian 32 bit word to the buffer.
+    void AddWord(std::string& buffer, unsigned int word) {
+        buffer.push_back(word & 0xFF);
+        buffer.push_back((word >> 8) & 0xFF);
+        buffer.push_back((word >> 16) & 0xFF);
+        buffer.push_back((word >> 24) & 0xFF);
+    }
+}
+
+CP::TStreamOutput::TStreamOutput(const char* name)
+    : fName(name ? name: ""), fDescriptor(-1), fEventsWritten(0),
+      fPipeIgnored(false) {
+    // A reader that closes the pipe would otherwise kill the process with
+    // SIGPIPE.  With the signal ignored, the write fails with EPIPE.
+    struct sigaction ignore;
+    std::memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    fPipeIgnored = (sigaction(SIGPIPE, &ignore, &fOldPipeAction) == 0);
+    if (fName == "-") {
+        // The events take over standard output, so anything else that is
+        // printed (e.g. the log) is sent to standard error.
+        std::cout.flush();
+        std::fflush(stdout);
+        fDescriptor = dup(STDOUT_FILENO);
+        if (fDescriptor >= 0) dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    else {
+        fDescriptor = open(fName.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                           0666);
+    }
+    if (fDescriptor < 0) {
+        CaptError("Cannot open output stream " << fName
+                  << ": " << std::strerror(errno));
+        RestorePipeSignal();
+        throw CP::EStreamOutput();
+    }
+    std::string header(GetMagic(), 8);
+    AddWord(header, kVersion);
+    AddWord(header, 0);
+    if (!WriteBytes(header.data(), header.size())) {
+        CaptError("Cannot write the header of output stream " << fName);
+        close(fDescriptor);
+        fDescriptor = -1;
+        RestorePipeSignal();
+        throw CP::EStreamOutput();
+    }
+}
+
+CP::TStreamOutput::~TStreamOutput() {
+    Close();
+    RestorePipeSignal();
+}
+
+void CP::TStreamOutput::RestorePipeSignal(void) {
+    if (!fPipeIgnored) return;
+    sigaction(SIGPIPE, &fOldPipeAction, NULL);
+    fPipeIgnored = false;
+}
+
+bool CP::TStreamOutput::WriteBytes(const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fDescriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+void CP::TStreamOutput::WriteRecord(unsigned int type,
+                                    const char* data, std::size_t size) {
+    if (!IsOpen()) throw CP::EStreamOutputWriteFailed();
+    std::string header;
+    AddWord(header, type);
+    AddWord(header, size);
+    if (!WriteBytes(header.data(), header.size())
+        || !WriteBytes(data, size)) {
+        if (errno == EPIPE) {
+            CaptError("Output stream " << fName << " closed by the reader");
+        }
+        else {
+            CaptError("Error writing to output stream " << fName
+                      << ": " << std::strerror(errno));
+        }
+        // A partial record was sent, so nothing else can be written.
+        close(fDescriptor);
+        fDescriptor = -1;
+        throw CP::EStreamOutputWriteFailed();
+    }
+}
+
+void CP::TStreamOutput::WriteGeometry(TGeoManager* geom) {
+    if (!IsOpen()) return;
+    if (!geom) return;
+    if (fGeometryName == geom->GetName()) return;
+
+    // Write the geometry into a ROOT file in memory so that the reader can
+    // load it the same way as from an input file.
+    TDirectory* oldDirectory = gDirectory;
+    std::string buffer;
+    {
+        TMemFile file("stream-geometry.root","RECREATE");
+        file.cd();
+        if (geom->Write() < 1) {
+            CaptError("Error while writing geometry to stream");
+            if (oldDirectory) oldDirectory->cd();
+            throw CP::EStreamOutputWriteFailed();
+        }
+        file.Write();
+        buffer.resize(file.GetSize());
+        file.CopyTo(&buffer[0], buffer.size());
+        file.Close();
+    }
+    if (oldDirectory) oldDirectory->cd();
+
+    WriteRecord(kGeometryRecord, buffer.data(), buffer.size());
+    fGeometryName = geom->GetName();
+    CaptLog("** Geometry " << geom->GetName() << " written to stream "
+            << fName);
+}
+
+void CP::TStreamOutput::WriteEvent(CP::TEvent& event) {
+    TBufferFile buffer(TBuffer::kWrite);
+    buffer.WriteObject(&event);
+    WriteRecord(kEventRecord, buffer.Buffer(), buffer.Length());
+    ++fEventsWritten;
+}
+
+void CP::TStreamOutput::Close(void) {
+    if (!IsOpen()) return;
+    std::string end;
+    AddWord(end, kEndRecord);
+    AddWord(end, 0);
+    if (!WriteBytes(end.data(), end.size())) {
+        CaptError("Cannot write the end of output stream " << fName);
+    }
+    close(fDescriptor);
+    fDescriptor = -1;
+    CaptVerbose("Wrote " << fEventsWritten << " events to stream " << fName);
+}
@@ -0,0 +1,131 @@
+#ifndef TStreamOutput_hxx_seen
+#define TStreamOutput_hxx_seen
+
+#include <string>
+#include <cstddef>
+
+#include <signal.h>
+
+#include <ECore.hxx>
+
+class TGeoManager;
+
+namespace CP {
+    class TEvent;
+    class TStreamOutput;
+
+    /// Base class for stream output errors.
+    EXCEPTION(EStreamOutput, ECore);
+
+    /// An error occurred while writing to the stream.
+    EXCEPTION(EStreamOutputWriteFailed, EStreamOutput);
+}
+
+/// Write events as a stream of serialized records to a pipe, a FIFO, or
+/// standard output (the name "-").  The stream is read with CP::TStreamInput
+/// (the "stream" input type), so event loop stages can be run as a shell
+/// pipeline without writing intermediate files.  For example,
+///
+/// \code
+/// convert.exe --stream-output - raw.dat | recon.exe -t stream -o out.root -
+/// \endcode
+///
+/// Unlike CP::TRootOutput, the stream doesn't need to be seekable.  The
+/// stream starts with a 16 byte header
+///
+/// \code
+/// char   magic[8]       "CPSTREAM"
+/// uint32 version        1
+/// uint32 reserved       0
+/// \endcode
+///
+/// and is followed by records that are each a little-endian uint32 record
+/// type, a uint32 length, and the length bytes of the record.  A geometry
+/// record holds a ROOT file (made in memory) with the geometry, and is sent
+/// before the first event that uses the geometry (usually once at the start
+/// of the stream).  An event record holds a CP::TEvent serialized with
+/// TBufferFile.  The stream ends with an end record that has no data, so a
+/// reader can tell a complete stream from one that was cut short.  The
+/// events are serialized without the streamer information that is saved in
+/// a ROOT file, so the writer and reader must be built with the same version
+/// of the event classes.
+class CP::TStreamOutput {
+public:
+    /// The record types in the stream.
+    enum ERecordType {
+        kEndRecord = 0,
+        kGeometryRecord = 1,
+        kEventRecord = 2
+    };
+
+    /// Open a stream.  The name "-" writes to standard output (and anything
+    /// else printed to standard output is then sent to standard error).  Any
+    /// other name is opened (and created if it doesn't exist) for writing,
+    /// so it can be a FIFO made with mkfifo.  This throws EStreamOutput if
+    /// the stream can't be opened.  SIGPIPE is ignored while the stream
+    /// exists so that a reader closing the pipe is reported as a write
+    /// error instead of killing the process.
+    explicit TStreamOutput(const char* name);
+
+    /// Close the stream and restore the SIGPIPE handler.
+    virtual ~TStreamOutput();
+
+    /// The first eight bytes of a stream.
+    static const char* GetMagic(void) {return "CPSTREAM";}
+
+    /// The version of the stream layout.
+    static const unsigned int kVersion = 1;
+
+    /// Flag that the stream is open.
+    bool IsOpen(void) const {return fDescriptor >= 0;}
+
+    /// Send the geometry if it hasn't already been sent.  This throws
+    /// EStreamOutputWriteFailed if the geometry can't be written.
+    void WriteGeometry(TGeoManager* geom);
+
+    /// Return true if a geometry has been sent.
+    bool GeometryWritten(void) const {return !fGeometryName.empty();}
+
+    /// Send an event.  This throws EStreamOutputWriteFailed if the event
+    /// can't be written (e.g. the reader has closed the pipe).  The stream
+    /// is closed after a failed write.
+    void WriteEvent(CP::TEvent& event);
+
+    /// Return the number of events sent.
+    int GetEventsWritten(void) const {return fEventsWritten;}
+
+    /// Send the end record and close the stream.
+    void Close(void);
+
+    /// Return the name of the stream.
+    const char* GetFilename(void) const {return fName.c_str();}
+
+private:
+    /// Write a record.  This throws EStreamOutputWriteFailed on error.
+    void WriteRecord(unsigned int type, const char* data, std::size_t size);
+
+    /// Write a block of bytes.  This returns false on error.
+    bool WriteBytes(const char* data, std::size_t size);
+
+    /// Put back the SIGPIPE handler that was replaced by the constructor.
+    void RestorePipeSignal(void);
+
+    /// The name of the stream.
+    std::string fName;
+
+    /// The file descriptor of the stream.
+    int fDescriptor;
+
+    /// The name of the last geometry sent.
+    std::string fGeometryName;
+
+    /// The number of events sent.
+    int fEventsWritten;
+
+    /// The SIGPIPE handler before the stream was opened.
+    struct sigaction fOldPipeAction;
+
+    /// True if the SIGPIPE handler has been replaced.
+    bool fPipeIgnored;
+};
+#endif
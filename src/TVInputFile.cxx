@@ -5,7 +5,42 @@
 CP::TEvent* CP::TVInputFile::FirstEvent() {throw CP::ECore();}
 CP::TEvent* CP::TVInputFile::NextEvent(int skip) {throw CP::ECore();}
 CP::TEvent* CP::TVInputFile::PreviousEvent(int skip) {return NULL;}
+
+int CP::TVInputFile::Seek(int entry) {
+    if (entry < 1) return 0;
+    int count = 0;
+    for (CP::TEvent* event = FirstEvent(); event; event = NextEvent()) {
+        delete event;
+        if (entry <= ++count) break;
+    }
+    return count;
+}
+
+CP::TEvent* CP::TVInputFile::FindEvent(const CP::TEventContext& context) {
+    for (;;) {
+        CP::TEvent* event = NextEvent();
+        if (!event) return NULL;
+        if (IsAtOrAfter(event->GetContext(),context)) return event;
+        delete event;
+        if (EndOfFile()) return NULL;
+    }
+}
+
+bool CP::TVInputFile::ReadContext(int entry, CP::TEventContext& context) {
+    return false;
+}
+
+bool CP::TVInputFile::IsAtOrAfter(const CP::TEventContext& context,
+                                  const CP::TEventContext& target) {
+    if (target.GetRun() != CP::TEventContext::Invalid) {
+        if (context.GetRun() < target.GetRun()) return false;
+        if (context.GetRun() > target.GetRun()) return true;
+    }
+    if (target.GetEvent() == CP::TEventContext::Invalid) return true;
+    return (context.GetEvent() >= target.GetEvent());
+}
 int CP::TVInputFile::GetPosition() const {throw CP::ECore();}
+int CP::TVInputFile::GetEventsInFile() {return -1;}
 bool CP::TVInputFile::IsOpen() {throw CP::ECore();}
 bool CP::TVInputFile::EndOfFile() {throw CP::ECore();}
 void CP::TVInputFile::CloseFile() {throw CP::ECore();}
@@ -6,6 +6,7 @@
 namespace CP {
     class TVInputFile;
     class TEvent;
+    class TEventContext;
 
     EXCEPTION(EInputFile,ECore);
 };
@@ -36,12 +37,51 @@ public:
     /// be possible to read backwards and this will always return NULL.
     virtual TEvent* PreviousEvent(int skip = 0);
 
+    /// Position the file so that the next call to NextEvent() returns the
+    /// event at "entry" (counted from zero), and return the entry that will
+    /// be read next.  If the file has fewer events, the file is left at the
+    /// end of file and the number of events in the file is returned.  This
+    /// is meant to be called before the first event is read.  Files that
+    /// can find an entry directly (e.g. TRootInput) move without reading
+    /// any events.  The default implementation reads and throws away the
+    /// events before the entry.
+    virtual int Seek(int entry);
+
+    /// Read the first event after the current position that has a run and
+    /// event number at or after the run and event number in the context.
+    /// The events are assumed to be ordered by run and then event number.
+    /// If the run number in the context is CP::TEventContext::Invalid, only
+    /// the event number is compared.  If no event is found, this returns
+    /// NULL and the file is left at the end of file.  The default
+    /// implementation reads each event with NextEvent().  Input files that
+    /// have an index should override this to go straight to the event.
+    virtual TEvent* FindEvent(const CP::TEventContext& context);
+
+    /// Fill the context with the context of the event at "entry" (counted
+    /// from zero) without reading the event, and return true if the context
+    /// was read.  The file position is not changed.  This is used to select
+    /// events before they are read (see
+    /// CP::TEventLoopFunction::Accept()), so it should only be overridden
+    /// by files that can read the context much faster than the full event.
+    /// The default returns false.
+    virtual bool ReadContext(int entry, CP::TEventContext& context);
+
+    /// Return true if the event context is at or after the target run and
+    /// event number (see FindEvent()).
+    static bool IsAtOrAfter(const CP::TEventContext& context,
+                            const CP::TEventContext& target);
+
     /// Return the position of the event just read in the file.  A position of
     /// zero means that the first event was read.  A position of -1 means that
     /// no events have been read and we are not at the end of file.  The
     /// maximum position is the total number of events in the file.
     virtual int GetPosition(void) const = 0;
 
+    /// Return the number of events in the file without reading them, or a
+    /// negative value if the file can't count the events (e.g. a file that
+    /// can only be read sequentially).  The default returns -1.
+    virtual int GetEventsInFile(void);
+
     /// Flag that the file is open.
     virtual bool IsOpen() = 0;
 
@@ -4,12 +4,23 @@
 
 #include "TEvent.hxx"
 #include "TEventContext.hxx"
+#include "TEventFolder.hxx"
 #include "TRootInput.hxx"
+#include "TChainInput.hxx"
 #include "TRootOutput.hxx"
+#include "TStreamOutput.hxx"
 #include "TManager.hxx"
 #include "THandleHack.hxx"
 #include "TCaptLog.hxx"
 #include "TMemoryUsage.hxx"
+#include "TEventLoopTiming.hxx"
+#include "TEventLoopCheckpoint.hxx"
+#include "TEventLoopMetrics.hxx"
+#include "TEventLoopSlice.hxx"
+#include "TEventLoopProcesses.hxx"
+#include "TOutputRollover.hxx"
+#include "TDatumSizeReport.hxx"
+#include "TEventCatalogue.hxx"
 #include "TRuntimeParameters.hxx"
 #include "TInputManager.hxx"
 
@@ -18,17 +29,546 @@
 #include <limits>
 #include <memory>
 #include <unistd.h>
+#include <getopt.h>
 #include <csignal>
 #include <cmath>
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <deque>
 #include <cstdlib>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 #include <TROOT.h>
 #include <TObjString.h>
+#include <TFile.h>
+#include <TGeoManager.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TLeaf.h>
 
 namespace {
+    /// The values returned by getopt_long for options that only have a long
+    /// form.  These must not overlap with the single character options.
+    enum {
+        kReadAheadOption = 256,
+        kWriteBehindOption,
+        kShardOption,
+        kEntriesOption,
+        kCheckpointOption,
+        kCheckpointEveryOption,
+        kResumeOption,
+        kPrefetchOption,
+        kMetricsOption,
+        kMetricsEveryOption,
+        kSplitOption,
+        kCompressionOption,
+        kBasketSizeOption,
+        kAutoFlushOption,
+        kCacheSizeOption,
+        kCacheLearnOption,
+        kStreamOutputOption,
+        kMaxOutputSizeOption,
+        kMaxOutputEventsOption,
+        kDatumSizesOption,
+        kCatalogueOption,
+    };
+
+    /// The long form options.
+    const struct option gLongOptions[] = {
+        {"read-ahead", required_argument, NULL, kReadAheadOption},
+        {"write-behind", required_argument, NULL, kWriteBehindOption},
+        {"shard", required_argument, NULL, kShardOption},
+        {"entries", required_argument, NULL, kEntriesOption},
+        {"checkpoint", required_argument, NULL, kCheckpointOption},
+        {"checkpoint-every", required_argument, NULL, kCheckpointEveryOption},
+        {"resume", no_argument, NULL, kResumeOption},
+        {"prefetch", no_argument, NULL, kPrefetchOption},
+        {"metrics", required_argument, NULL, kMetricsOption},
+        {"metrics-every", required_argument, NULL, kMetricsEveryOption},
+        {"split", required_argument, NULL, kSplitOption},
+        {"compression", required_argument, NULL, kCompressionOption},
+        {"basket-size", required_argument, NULL, kBasketSizeOption},
+        {"auto-flush", required_argument, NULL, kAutoFlushOption},
+        {"cache-size", required_argument, NULL, kCacheSizeOption},
+        {"cache-learn", required_argument, NULL, kCacheLearnOption},
+        {"stream-output", required_argument, NULL, kStreamOutputOption},
+        {"max-output-size", required_argument, NULL, kMaxOutputSizeOption},
+        {"max-output-events", required_argument, NULL,
+         kMaxOutputEventsOption},
+        {"datum-sizes", required_argument, NULL, kDatumSizesOption},
+        {"catalogue", required_argument, NULL, kCatalogueOption},
+        {NULL, 0, NULL, 0}
+    };
+
+    /// A pool of worker threads used to run TEventLoopFunction::Process() on
+    /// several events at once.  Events are submitted in the order they are
+    /// read, and the results are returned in the same order so that the
+    /// output files are written in input order.  The pool is only used when
+    /// the user code declares that it is thread safe.
+    class TEventLoopWorkers {
+    public:
+        /// The result of processing one event.
+        struct Result {
+            Result() : event(NULL), save(-1), nextFile(false) {}
+            /// The event that was processed (owned by the caller).
+            CP::TEvent* event;
+            /// The output file index returned by Process().
+            int save;
+            /// Flag that Process() threw ENextEventLoopFile.
+            bool nextFile;
+            /// Any other exception thrown by Process().
+            std::exception_ptr exception;
+        };
+
+        TEventLoopWorkers(CP::TEventLoopFunction& userCode,
+                          int threads, int outputFiles)
+            : fUserCode(userCode), fOutputFiles(outputFiles),
+              fNextSubmit(0), fNextResult(0), fDiscard(-1), fStop(false) {
+            ROOT::EnableThreadSafety();
+            for (int i = 0; i<threads; ++i) {
+                fThreads.push_back(
+                    std::thread(&TEventLoopWorkers::Run, this, i));
+            }
+        }
+
+        /// Stop the workers.  The workers call FinalizeWorker() before they
+        /// exit.
+        ~TEventLoopWorkers() {
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                fStop = true;
+            }
+            fJobReady.notify_all();
+            for (std::vector<std::thread>::iterator t = fThreads.begin();
+                 t != fThreads.end(); ++t) {
+                t->join();
+            }
+        }
+
+        /// The number of threads in the pool.
+        int GetThreadCount() const {return fThreads.size();}
+
+        /// Queue an event to be processed.  The pool does not take ownership
+        /// of the event, which is returned by Next().
+        void Submit(CP::TEvent* event) {
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                fJobs.push_back(std::make_pair(fNextSubmit++, event));
+            }
+            fJobReady.notify_one();
+        }
+
+        /// The number of events that have been submitted, but not returned.
+        int InFlight() {
+            std::lock_guard<std::mutex> lock(fMutex);
+            return fNextSubmit - fNextResult;
+        }
+
+        /// Return the result for the oldest event that has been submitted.
+        /// This blocks until that event has been processed.
+        Result Next() {
+            std::unique_lock<std::mutex> lock(fMutex);
+            std::map<int,Result>::iterator r;
+            while ((r = fResults.find(fNextResult)) == fResults.end()) {
+                fResultReady.wait(lock);
+            }
+            Result result = r->second;
+            fResults.erase(r);
+            ++fNextResult;
+            return result;
+        }
+
+        /// Don't process any of the events that are currently submitted.
+        /// They are still returned by Next() (without being processed), so
+        /// that the caller can delete them.
+        void Discard() {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fDiscard = fNextSubmit;
+        }
+
+        /// Throw away all of the events that are currently submitted.
+        void Flush() {
+            Discard();
+            while (InFlight() > 0) delete Next().event;
+        }
+
+    private:
+        void Run(int worker) {
+            CP::TEventLoopFunction::SetWorkerIndex(worker);
+            fUserCode.InitializeWorker(worker);
+            for (;;) {
+                std::pair<int,CP::TEvent*> job;
+                bool discard = false;
+                {
+                    std::unique_lock<std::mutex> lock(fMutex);
+                    while (!fStop && fJobs.empty()) fJobReady.wait(lock);
+                    if (fJobs.empty()) break;
+                    job = fJobs.front();
+                    fJobs.pop_front();
+                    discard = (job.first < fDiscard);
+                }
+                Result result;
+                result.event = job.second;
+                if (!discard) {
+                    // Make the event current on this thread so that code
+                    // using TEventFolder::GetCurrentEvent() sees it.
+                    CP::TEventFolder::RegisterEvent(job.second);
+                    try {
+                        result.save = fUserCode.Process(*job.second,
+                                                        fOutputFiles);
+                    }
+                    catch (CP::ENextEventLoopFile&) {
+                        result.nextFile = true;
+                    }
+                    catch (...) {
+                        result.exception = std::current_exception();
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(fMutex);
+                    fResults[job.first] = result;
+                }
+                fResultReady.notify_all();
+            }
+            fUserCode.FinalizeWorker(worker);
+            CP::TEventLoopFunction::SetWorkerIndex(-1);
+        }
+
+        CP::TEventLoopFunction& fUserCode;
+        int fOutputFiles;
+        std::vector<std::thread> fThreads;
+        std::mutex fMutex;
+        std::condition_variable fJobReady;
+        std::condition_variable fResultReady;
+        std::deque< std::pair<int,CP::TEvent*> > fJobs;
+        std::map<int,Result> fResults;
+        int fNextSubmit;
+        int fNextResult;
+        int fDiscard;
+        bool fStop;
+    };
+
+    /// Open the next ROOT input file on a background thread while the
+    /// current file is being processed.  The file is opened, the event tree
+    /// is read, and the first basket of each branch is read so that the
+    /// CP::TRootInput made from the file can start reading immediately.
+    /// Only one file is prefetched at a time.
+    class TInputPrefetch {
+    public:
+        TInputPrefetch(): fFile(NULL) {
+            ROOT::EnableThreadSafety();
+        }
+
+        ~TInputPrefetch() {Discard();}
+
+        /// Start opening a file.  Any file that has already been prefetched
+        /// is closed.
+        void Start(const std::string& name) {
+            Discard();
+            fName = name;
+            fThread = std::thread(&TInputPrefetch::Run, this);
+        }
+
+        /// Return the prefetched file if it has the name, and NULL
+        /// otherwise.  The caller takes ownership of the file.  If the file
+        /// isn't returned, it is closed.
+        TFile* Take(const std::string& name) {
+            if (fThread.joinable()) fThread.join();
+            TFile* file = NULL;
+            if (name == fName) std::swap(file,fFile);
+            Discard();
+            return file;
+        }
+
+        /// Wait for the thread, and close the prefetched file.
+        void Discard() {
+            if (fThread.joinable()) fThread.join();
+            if (fFile) {
+                fFile->Close();
+                delete fFile;
+            }
+            fFile = NULL;
+            fName.clear();
+        }
+
+    private:
+        void Run() {
+            // Errors are not reported here since the file is opened again
+            // (and the error reported) when it isn't prefetched.
+            TFile* file = TFile::Open(fName.c_str(),"OLD");
+            if (!file) return;
+            if (!file->IsOpen()) {
+                delete file;
+                return;
+            }
+            // The tree stays in memory with the file, so the baskets read
+            // here are used when the events are read.
+            TTree* tree = dynamic_cast<TTree*>(file->Get("captainEventTree"));
+            if (tree) {
+                TIter next(tree->GetListOfLeaves());
+                while (TLeaf* leaf = dynamic_cast<TLeaf*>(next())) {
+                    TBranch* branch = leaf->GetBranch();
+                    if (branch && branch->GetEntries() > 0) {
+                        branch->GetBasket(0);
+                    }
+                }
+            }
+            fFile = file;
+        }
+
+        std::string fName;
+        TFile* fFile;
+        std::thread fThread;
+    };
+
+    /// Save an event into the output file selected by the user code.  This
+    /// also saves the geometry for the event if it hasn't already been
+    /// written.  The events saved in the first output are also sent to the
+    /// output stream (if any).  Returns true if the event was written.  If
+    /// the output file is being written asynchronously, the file takes
+    /// ownership of the event.
+    bool SaveEvent(std::unique_ptr<CP::TEvent>& event, int saveEvent,
+                   std::vector<CP::TRootOutput*>& outputFiles,
+                   CP::TStreamOutput* stream,
+                   bool preventSavedGeometry,
+                   CP::TEventLoopTiming& timing) {
+        bool toStream = (stream && saveEvent == 0);
+        bool toFile = (0 <= saveEvent
+                       && saveEvent < (int) outputFiles.size());
+        if (!toStream && !toFile) return false;
+        if (!preventSavedGeometry) {
+            // Check if the geometry should be saved.
+            CP::TEventLoopTiming::TScope scope(timing,
+                                             CP::TEventLoopTiming::kWriteGeometry);
+            try {
+                TGeoManager* geom = CP::TManager::Get().Geometry(event.get());
+                if (toStream) stream->WriteGeometry(geom);
+                if (toFile) outputFiles[saveEvent]->WriteGeometry(geom);
+            }
+            catch (CP::ENoGeometry) {
+                CaptSevere("Geometry not saved in output");
+            }
+            catch (CP::EManager) {
+                CaptSevere("Geometry not saved in output");
+            }
+        }
+        CP::TEventLoopTiming::TScope scope(timing,
+                                         CP::TEventLoopTiming::kWriteEvent);
+        if (toStream) stream->WriteEvent(*event);
+        if (!toFile) return true;
+        if (outputFiles[saveEvent]->GetAsynchronous() > 0) {
+            outputFiles[saveEvent]->AdoptEvent(event.release());
+        }
+        else {
+            outputFiles[saveEvent]->WriteEvent(*event);
+        }
+        return true;
+    }
+
+    /// Return the number of events in an input file without reading any of
+    /// the events.  This returns a negative value if the file can't be
+    /// opened, or if it can't count the events.
+    Long64_t CountInputEvents(const std::string& fileType,
+                              const std::string& fileName) {
+        try {
+            std::unique_ptr<CP::TVInputFile> input(
+                CP::TManager::Get().Input().Builder(fileType.c_str()).Open(
+                    fileName.c_str()));
+            if (!input || !input->IsOpen()) return -1;
+            Long64_t count = input->GetEventsInFile();
+            input->CloseFile();
+            return count;
+        }
+        catch (...) {
+            return -1;
+        }
+    }
+
+    /// The compression and basket settings for the output files.  The
+    /// settings that aren't given on the command line are taken from the
+    /// captEvent.output run-time parameters.
+    struct TOutputSettings {
+        TOutputSettings()
+            : compressionLevel(-1), basketSize(0),
+              autoFlush(0), autoFlushSet(false) {}
+        std::string compressionAlgorithm;
+        int compressionLevel;
+        int basketSize;
+        Long64_t autoFlush;
+        bool autoFlushSet;
+    };
+
+    /// Fill the output settings that weren't set on the command line from
+    /// the run-time parameters.
+    void DefaultOutputSettings(TOutputSettings& settings) {
+        CP::TRuntimeParameters& parameters = CP::TRuntimeParameters::Get();
+        if (settings.compressionAlgorithm.empty()
+            && parameters.HasParameter(
+                "captEvent.output.compressionAlgorithm")) {
+            settings.compressionAlgorithm = parameters.GetParameterS(
+                "captEvent.output.compressionAlgorithm");
+        }
+        if (settings.compressionLevel < 0
+            && parameters.HasParameter("captEvent.output.compressionLevel")) {
+            settings.compressionLevel = parameters.GetParameterI(
+                "captEvent.output.compressionLevel");
+        }
+        if (settings.basketSize < 1
+            && parameters.HasParameter("captEvent.output.basketSize")) {
+            settings.basketSize = parameters.GetParameterI(
+                "captEvent.output.basketSize");
+        }
+        if (!settings.autoFlushSet
+            && parameters.HasParameter("captEvent.output.autoFlush")) {
+            settings.autoFlush = parameters.GetParameterI(
+                "captEvent.output.autoFlush");
+            settings.autoFlushSet = true;
+        }
+    }
+
+    /// Open an output file and save the command line (and the slice of
+    /// entries being processed) into it.  The split datums are passed to
+    /// CP::TRootOutput::SetSplitDatums() for a new file.  The mode is passed
+    /// to TFile (e.g. "NEW", or "UPDATE" to add to an existing file).
+    CP::TRootOutput* OpenOutputFile(const std::string& name,
+                                    int argc, char** argv,
+                                    const std::string& sliceDescription,
+                                    int writeBehind,
+                                    const std::string& splitDatums,
+                                    const TOutputSettings& settings,
+                                    const char* mode = "NEW") {
+        CP::TRootOutput* output = new CP::TRootOutput(name.c_str(),mode);
+        if (!output->IsOpen()) {
+            std::cerr << "ERROR: Output file not open" << std::endl;
+            exit(2);
+        }
+        // Save the command line to the TFile.
+        std::string command;
+        for (int i=0; i<argc; ++i) {
+            if (i > 0) command += " ";
+            command += argv[i];
+        }
+        TObjString commandLine(command.c_str());
+        output->WriteObject(&commandLine,"commandLine");
+        // Save the slice of entries being processed.
+        if (!sliceDescription.empty()) {
+            TObjString shardString(sliceDescription.c_str());
+            output->WriteObject(&shardString,"shard");
+        }
+        // Set the compression and baskets before the branches are filled.
+        if (!settings.compressionAlgorithm.empty()) {
+            int level = settings.compressionLevel;
+            if (level < 0) level = 1;
+            output->SetCompression(settings.compressionAlgorithm, level);
+        }
+        if (settings.basketSize > 0) {
+            output->SetBasketSize(settings.basketSize);
+        }
+        if (settings.autoFlushSet) output->SetAutoFlush(settings.autoFlush);
+        // Write the top-level datums into separate branches.  A file that
+        // already has events keeps its layout.
+        if (!splitDatums.empty() && output->GetEventsWritten() == 0) {
+            output->SetSplitDatums(splitDatums);
+        }
+        // Compress and write the events on a background thread.
+        if (writeBehind > 0) output->SetAsynchronous(writeBehind);
+        return output;
+    }
+
+    /// Remove the events after the first "events" from the event tree of an
+    /// output file that is being resumed.  The tree can be saved with more
+    /// events than the checkpoint (e.g. by a ROOT AutoSave between
+    /// checkpoints, or when the job is killed while the checkpoint is
+    /// written), and those events are processed again.  This returns false
+    /// if the file has fewer events than the checkpoint.
+    bool TrimOutputFile(const std::string& name, int events) {
+        TFile file(name.c_str(),"UPDATE");
+        if (!file.IsOpen()) return false;
+        TTree* tree = dynamic_cast<TTree*>(file.Get("captainEventTree"));
+        Long64_t found = tree ? tree->GetEntries(): 0;
+        if (found < events) {
+            file.Close();
+            return false;
+        }
+        if (events < found) {
+            CaptLog("Remove " << found - events << " events saved after"
+                    << " the checkpoint from " << name);
+            TTree* trimmed = tree->CloneTree(events);
+            tree->Delete("all");
+            trimmed->Write();
+        }
+        file.Close();
+        return true;
+    }
+
+    /// Open the output files (see OpenOutputFile()).
+    std::vector<CP::TRootOutput*> OpenOutputFiles(
+        const std::vector<std::string>& outputNames,
+        int argc, char** argv,
+        const std::string& sliceDescription,
+        int writeBehind,
+        const std::string& splitDatums,
+        const TOutputSettings& settings,
+        const char* mode = "NEW") {
+        std::vector<CP::TRootOutput*> outputFiles;
+        for (std::vector<std::string>::const_iterator n = outputNames.begin();
+             n != outputNames.end();
+             ++n) {
+            outputFiles.push_back(
+                OpenOutputFile(*n, argc, argv, sliceDescription,
+                               writeBehind, splitDatums, settings, mode));
+        }
+        return outputFiles;
+    }
+
+    /// Save the names of the input files into an output file.  The names are
+    /// saved with the full path when it can be found.
+    void WriteInputNames(CP::TRootOutput* output,
+                         const std::vector<std::string>& inputNames) {
+        for (std::size_t n = 0; n < inputNames.size(); ++n) {
+            std::unique_ptr<char, void(*)(void*)>
+                resolvedPath(realpath(inputNames[n].c_str(), NULL),
+                             std::free);
+            TObjString inputNameString(
+                resolvedPath ? resolvedPath.get() : inputNames[n].c_str());
+            output->WriteObject(&inputNameString,"inputFile");
+        }
+    }
+
+    /// Find the location of an event in a catalogue (the "--catalogue"
+    /// option).  The event loop exits if the catalogue can't be read, or
+    /// doesn't have the event.
+    CP::TEventCatalogue::TLocation FindCatalogueEvent(
+        const std::string& catalogueName, int run, int event) {
+        CP::TEventCatalogue::TLocation location;
+        try {
+            CP::TEventCatalogue catalogue;
+            if (!catalogue.Read(catalogueName)) {
+                CaptError("ERROR: Catalogue " << catalogueName
+                          << " not found");
+                exit(1);
+            }
+            if (!catalogue.Find(run, event, location)) {
+                CaptError("ERROR: Event not found in " << catalogueName);
+                exit(1);
+            }
+        }
+        catch (CP::EEventCatalogue&) {
+            CaptError("ERROR: Cannot read catalogue " << catalogueName);
+            exit(1);
+        }
+        CaptLog("Event " << location.run << "," << location.event
+                << " is entry " << location.entry
+                << " of " << location.file);
+        return location;
+    }
+
     void eventLoopUsage(std::string programName, 
                              CP::TEventLoopFunction& userCode,
                              int readCount) {
@@ -48,6 +588,12 @@ namespace {
         std::cout << "    -a                Read all events";
         if (readCount<1) std::cout << " [Default]";
         std::cout << std::endl;
+
+        std::cout << "    -B <cnt>          Process events in batches of <cnt>"
+                  << std::endl
+                  << "                      (see TEventLoopFunction::"
+                  << "ProcessBatch)"
+                  << std::endl;
         
         std::cout << "    -c <file>         Set the logging config file name"
                   << std::endl;
@@ -79,10 +625,30 @@ namespace {
         std::cout << "    -H                Debug THandle (slow)"
                   << std::endl;
         
+        std::cout << "    -I <paths>        Only keep these datums in the"
+                  << " input events"
+                  << std::endl
+                  << "                      (e.g. hits,fits or"
+                  << " truth/G4Trajectories)"
+                  << std::endl;
+        
+        std::cout << "    -j <threads>      Process events on <threads> threads"
+                  << std::endl
+                  << "                      (only if the user code is"
+                  << " thread safe)"
+                  << std::endl;
+
 
         std::cout << "    -n <cnt>          Only read <cnt> events";
         if (readCount>0) std::cout << "  [Default: " << readCount << "]";
         std::cout << std::endl;
+
+        std::cout << "    -P <procs>        Process events in <procs> forked"
+                  << " processes"
+                  << std::endl
+                  << "                      (the outputs are merged at"
+                  << " the end)"
+                  << std::endl;
         
         std::cout << "    -q                Decrease the verbosity"
                   << std::endl;
@@ -112,9 +678,16 @@ namespace {
                       << " : " << doc << std::endl;
         }
 
+        std::cout << "    -T                Time each stage of the event loop"
+                  << std::endl;
+
         std::cout << "    -u                Log the memory and CPU usage"
                   << std::endl;
 
+        std::cout << "    -X <paths>        Don't keep these datums in the"
+                  << " input events"
+                  << std::endl;
+        
         std::cout << "    -v                Increase the verbosity"
                   << std::endl;
         
@@ -125,6 +698,158 @@ namespace {
 
         std::cout << "    -O <opt>[=<val>]  Set an option for the user code"
                   << std::endl;
+
+        std::cout << "    --read-ahead <cnt>"
+                  << std::endl
+                  << "                      Read <cnt> events ahead on a"
+                  << " background thread"
+                  << std::endl;
+
+        std::cout << "    --write-behind <cnt>"
+                  << std::endl
+                  << "                      Write output events on a"
+                  << " background thread with"
+                  << std::endl
+                  << "                        a backlog of <cnt> events"
+                  << std::endl;
+
+        std::cout << "    --shard <k>/<N>   Only process the k'th of N equal"
+                  << " slices of the entries"
+                  << std::endl
+                  << "                        in all of the input files"
+                  << " (k is from 0 to N-1)"
+                  << std::endl;
+
+        std::cout << "    --entries <a>:<b> Only process entries a to b-1"
+                  << " counted across all"
+                  << std::endl
+                  << "                        of the input files"
+                  << std::endl;
+
+        std::cout << "    --checkpoint <file>"
+                  << std::endl
+                  << "                      Commit the outputs and record"
+                  << " the progress in <file>"
+                  << std::endl;
+
+        std::cout << "    --checkpoint-every <cnt>"
+                  << std::endl
+                  << "                      Save a checkpoint every <cnt>"
+                  << " events  [Default: 1000]"
+                  << std::endl;
+
+        std::cout << "    --resume          Continue from the checkpoint"
+                  << " (the outputs are updated)"
+                  << std::endl
+                  << "                      or start again if there isn't"
+                  << " a checkpoint"
+                  << std::endl;
+
+        std::cout << "    --prefetch        Open the next input file while"
+                  << " the current"
+                  << std::endl
+                  << "                        file is read"
+                  << std::endl;
+
+        std::cout << "    --metrics <file>  Write the progress as JSON"
+                  << " to <file>"
+                  << std::endl;
+
+        std::cout << "    --metrics-every <sec>"
+                  << std::endl
+                  << "                      Rewrite the metrics every"
+                  << " <sec> seconds  [Default: 10]"
+                  << std::endl;
+
+        std::cout << "    --split <names>   Write the named top-level datums"
+                  << " in separate"
+                  << std::endl
+                  << "                        branches"
+                  << " (e.g. digits,hits,truth,fits)"
+                  << std::endl;
+
+        std::cout << "    --compression <alg>[:<level>]"
+                  << std::endl
+                  << "                      Compress the output with zlib,"
+                  << " lzma, lz4 or zstd"
+                  << std::endl
+                  << "                        at <level> (0 to 9)"
+                  << "  [Default: zlib:1]"
+                  << std::endl;
+
+        std::cout << "    --basket-size <bytes>"
+                  << std::endl
+                  << "                      Set the output basket size"
+                  << "  [Default: 128000]"
+                  << std::endl;
+
+        std::cout << "    --auto-flush <cnt>"
+                  << std::endl
+                  << "                      Flush the output baskets every"
+                  << " <cnt> events"
+                  << std::endl
+                  << "                        (or every -<cnt> bytes)"
+                  << std::endl;
+
+        std::cout << "    --cache-size <bytes>"
+                  << std::endl
+                  << "                      Read the input through a"
+                  << " <bytes> tree cache"
+                  << std::endl
+                  << "                        (0 to turn off)"
+                  << "  [Default: 30000000]"
+                  << std::endl;
+
+        std::cout << "    --cache-learn <cnt>"
+                  << std::endl
+                  << "                      Learn the cached branches from"
+                  << " <cnt> events"
+                  << std::endl
+                  << "                        [Default: 10]"
+                  << std::endl;
+
+
+        std::cout << "    --stream-output <name>"
+                  << std::endl
+                  << "                      Send the saved events to a pipe"
+                  << " or FIFO (\"-\" for"
+                  << std::endl
+                  << "                        standard output) to be read"
+                  << " with \"-t stream\""
+                  << std::endl;
+
+        std::cout << "    --max-output-size <bytes>"
+                  << std::endl
+                  << "                      Continue each output in a"
+                  << " numbered file when it"
+                  << std::endl
+                  << "                        reaches <bytes>"
+                  << std::endl;
+
+        std::cout << "    --max-output-events <cnt>"
+                  << std::endl
+                  << "                      Continue each output in a"
+                  << " numbered file when it"
+                  << std::endl
+                  << "                        has <cnt> events"
+                  << std::endl;
+
+        std::cout << "    --datum-sizes <cnt>"
+                  << std::endl
+                  << "                      Report the size of each datum"
+                  << " read, and the datums"
+                  << std::endl
+                  << "                        in the <cnt> largest events"
+                  << std::endl;
+
+        std::cout << "    --catalogue <file>"
+                  << std::endl
+                  << "                      Find the event for -f in a"
+                  << " catalogue and only read"
+                  << std::endl
+                  << "                        the file with the event"
+                  << " (see index-events)"
+                  << std::endl;
         
         std::cout << std::endl;
         
@@ -151,8 +876,36 @@ int CP::eventLoop(int argc, char** argv,
     std::string geometryFile = "";
     int targetRun = -1;
     int targetEvent = -1;
+    int threadCount = 1;
+    int processCount = 1;
+    int batchSize = 1;
+    int readAhead = 0;
+    bool prefetchInput = false;
+    std::string metricsName;
+    double metricsEvery = 10;
+    std::string splitDatums;
+    TOutputSettings outputSettings;
+    Long64_t cacheSize = -1;
+    int cacheLearnEntries = -1;
+    std::string streamName;
+    Long64_t maxOutputSize = 0;
+    int maxOutputEvents = 0;
+    int datumSizesLargest = -1;
+    std::string catalogueName;
+    std::string catalogueInput;
+    std::vector<char*> catalogueArgv;
+    std::string includedDatums;
+    std::string excludedDatums;
+    int writeBehind = 0;
+    std::string shardOption;
+    std::string entriesOption;
+    std::string checkpointName;
+    int checkpointEvery = 1000;
+    bool resume = false;
+    const char* outputMode = "NEW";
     int exitStatus = 0;
     TMemoryUsage memoryUsage;
+    TEventLoopTiming timing;
 
     // If this is not zero, then only accept triggers matched in this mask.
     signal(SIGSEGV, SIG_DFL);
@@ -161,7 +914,9 @@ int CP::eventLoop(int argc, char** argv,
 
     // Process the options.
     for (;;) {
-        int c = getopt(argc, argv, "ac:dD:f:G:gHn:o:O:qr:R:s:t:uvV:");
+        int c = getopt_long(argc, argv,
+                            "aB:c:dD:f:G:gHI:j:n:o:O:P:qr:R:s:t:TuvV:X:",
+                            gLongOptions, NULL);
         if (c<0) break;
         switch (c) {
         case 'a':
@@ -170,6 +925,13 @@ int CP::eventLoop(int argc, char** argv,
             readCount = 0;
             break;
         }
+        case 'B':
+        {
+            std::istringstream tmp(optarg);
+            tmp >> batchSize;
+            if (batchSize < 1) batchSize = 1;
+            break;
+        }
         case 'c':
         {
             configName = strdup(optarg);
@@ -228,6 +990,18 @@ int CP::eventLoop(int argc, char** argv,
             }
             break;
         }   
+        case 'I':
+        {
+            // Only keep these datums in the input events.
+            includedDatums = optarg;
+            break;
+        }
+        case 'X':
+        {
+            // Don't keep these datums in the input events.
+            excludedDatums = optarg;
+            break;
+        }
         case 'G':
         {
             // Force a particular geometry file.
@@ -246,6 +1020,20 @@ int CP::eventLoop(int argc, char** argv,
             EnableHandleRegistry(true);
             break;
         }
+        case 'j':
+        {
+            std::istringstream tmp(optarg);
+            tmp >> threadCount;
+            if (threadCount < 1) threadCount = 1;
+            break;
+        }
+        case 'P':
+        {
+            std::istringstream tmp(optarg);
+            tmp >> processCount;
+            if (processCount < 1) processCount = 1;
+            break;
+        }
         case 'n':
         {
             std::istringstream tmp(optarg);
@@ -317,6 +1105,12 @@ int CP::eventLoop(int argc, char** argv,
             fileType = optarg;
             break;
         }
+        case 'T':
+        {
+            // Enable timing of the event loop stages.
+            timing.Enable();
+            break;
+        }
         case 'u':
         {
           // Enable logging of memory usage
@@ -364,6 +1158,134 @@ int CP::eventLoop(int argc, char** argv,
             }
             break;
         }
+        case kReadAheadOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> readAhead;
+            break;
+        }
+        case kWriteBehindOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> writeBehind;
+            break;
+        }
+        case kShardOption:
+        {
+            shardOption = optarg;
+            break;
+        }
+        case kEntriesOption:
+        {
+            entriesOption = optarg;
+            break;
+        }
+        case kCheckpointOption:
+        {
+            checkpointName = optarg;
+            break;
+        }
+        case kCheckpointEveryOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> checkpointEvery;
+            if (checkpointEvery < 1) checkpointEvery = 1;
+            break;
+        }
+        case kResumeOption:
+        {
+            resume = true;
+            break;
+        }
+        case kPrefetchOption:
+        {
+            prefetchInput = true;
+            break;
+        }
+        case kMetricsOption:
+        {
+            metricsName = optarg;
+            break;
+        }
+        case kMetricsEveryOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> metricsEvery;
+            break;
+        }
+        case kSplitOption:
+        {
+            splitDatums = optarg;
+            break;
+        }
+        case kCompressionOption:
+        {
+            // The option is "<algorithm>[:<level>]".
+            std::string arg(optarg);
+            std::size_t sep = arg.find(':');
+            outputSettings.compressionAlgorithm = arg.substr(0,sep);
+            if (sep != std::string::npos) {
+                std::istringstream tmp(arg.substr(sep+1));
+                tmp >> outputSettings.compressionLevel;
+            }
+            if (CP::TRootOutput::GetCompressionAlgorithm(
+                    outputSettings.compressionAlgorithm) < 0) {
+                std::cerr << "ERROR: Unknown compression \"" << arg << "\""
+                          << std::endl << std::endl;
+                eventLoopUsage(programName,userCode,defaultReadCount);
+            }
+            break;
+        }
+        case kBasketSizeOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> outputSettings.basketSize;
+            break;
+        }
+        case kAutoFlushOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> outputSettings.autoFlush;
+            outputSettings.autoFlushSet = true;
+            break;
+        }
+        case kCacheSizeOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> cacheSize;
+            break;
+        }
+        case kCacheLearnOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> cacheLearnEntries;
+            break;
+        }
+        case kStreamOutputOption:
+            streamName = optarg;
+            break;
+        case kMaxOutputSizeOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> maxOutputSize;
+            break;
+        }
+        case kMaxOutputEventsOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> maxOutputEvents;
+            break;
+        }
+        case kDatumSizesOption:
+        {
+            std::istringstream tmp(optarg);
+            tmp >> datumSizesLargest;
+            if (datumSizesLargest < 0) datumSizesLargest = 0;
+            break;
+        }
+        case kCatalogueOption:
+            catalogueName = optarg;
+            break;
         default:
             eventLoopUsage(programName,userCode,defaultReadCount);
         }
@@ -415,39 +1337,86 @@ int CP::eventLoop(int argc, char** argv,
         CP::TCaptLog::SetDebugLevel(i->first.c_str(), i->second);
     }
          
-    if (!outputNames.empty()) {
-        for (std::vector<std::string>::iterator n = outputNames.begin();
-             n != outputNames.end();
-             ++n) {
-            TRootOutput* output = new TRootOutput((*n).c_str(),"NEW");
-            if (!output->IsOpen()) {
-                std::cerr << "ERROR: Output file not open" << std::endl;
-                exit(2);
-            }
-            // Save the command line to the TFile.
-            std::string command;
-            for (int i=0; i<argc; ++i) {
-                if (i > 0) command += " ";
-                command += argv[i];
-            }
-            TObjString commandLine(command.c_str());
-            output->WriteObject(&commandLine,"commandLine");
-            outputFiles.push_back(output);
-        }
-    }
-    
-    // Check that there is an input file to open.
-    if (argc<=optind) {
+    // Check that there is an input file to open.  With a catalogue, the
+    // input file is found in the catalogue.
+    if (argc<=optind && catalogueName.empty()) {
         std::cerr << "ERROR: No input file" << std::endl << std::endl;
         eventLoopUsage(programName,userCode,defaultReadCount);
     }
+
+    // Fill the output settings that weren't on the command line (this is
+    // after the options so that "-r" can override the defaults).
+    if (!outputNames.empty()) DefaultOutputSettings(outputSettings);
+    if (fileType == "root") {
+        CP::TRuntimeParameters& parameters = CP::TRuntimeParameters::Get();
+        if (cacheSize < 0
+            && parameters.HasParameter("captEvent.input.cacheSize")) {
+            cacheSize = parameters.GetParameterI("captEvent.input.cacheSize");
+        }
+        if (cacheLearnEntries < 1
+            && parameters.HasParameter("captEvent.input.cacheLearnEntries")) {
+            cacheLearnEntries = parameters.GetParameterI(
+                "captEvent.input.cacheLearnEntries");
+        }
+    }
     
-    if (!outputFiles.empty()) outputFiles.front()->cd();
-    userCode.Initialize();
-    
-    // If readcount is zero, that means read the entire file.
-    if (readCount<1) readCount = std::numeric_limits<int>::max();
-    
+    // Find the file with the requested event in the catalogue.  The input
+    // files on the command line are replaced by that file, and it's read
+    // starting at the event.
+    if (!catalogueName.empty()) {
+        if (targetRun < 0 && targetEvent < 0) {
+            CaptError("ERROR: --catalogue requires -f");
+            exit(1);
+        }
+        if (fileType != "root") {
+            CaptError("ERROR: --catalogue only works for ROOT input");
+            exit(1);
+        }
+        CP::TEventCatalogue::TLocation location
+            = FindCatalogueEvent(catalogueName, targetRun, targetEvent);
+        catalogueInput = location.file;
+        catalogueArgv.assign(argv, argv + optind);
+        catalogueArgv.push_back(&catalogueInput[0]);
+        catalogueArgv.push_back(NULL);
+        argc = catalogueArgv.size() - 1;
+        argv = &catalogueArgv[0];
+        skipCount += location.entry;
+    }
+
+    // Find the slice of entries to process when the job is one of several
+    // processing the same input files.  The entries are counted across all
+    // of the input files (in command line order) so that each job gets a
+    // disjoint and deterministic slice.  Any events skipped with "-s" are
+    // skipped from the start of the slice.
+    const int firstInput = optind;
+    std::unique_ptr<TEventLoopSlice> slice;
+    std::string sliceDescription;
+    if (!shardOption.empty() || !entriesOption.empty()
+        || processCount > 1) {
+        slice.reset(new TEventLoopSlice);
+        for (int i = firstInput; i<argc; ++i) {
+            Long64_t count = CountInputEvents(fileType, argv[i]);
+            if (count < 0) {
+                CaptError("ERROR: Cannot count the events in " << argv[i]);
+                exit(1);
+            }
+            slice->AddInput(count);
+        }
+        if (!entriesOption.empty() && !slice->SetEntries(entriesOption)) {
+            eventLoopUsage(programName,userCode,defaultReadCount);
+        }
+        if (!shardOption.empty() && !slice->SetShard(shardOption)) {
+            CaptError("ERROR: Invalid shard \"" << shardOption << "\"");
+            eventLoopUsage(programName,userCode,defaultReadCount);
+        }
+        if (!shardOption.empty() || !entriesOption.empty()) {
+            sliceDescription = slice->GetDescription();
+            CaptLog("Processing " << sliceDescription);
+        }
+        slice->Skip(skipCount);
+        skipCount = 0;
+    }
+
     if (geometryFile == "CAPTAIN") {
         const char* geomFile = gSystem->Getenv("CAPTAINGEOMETRY");
         if (geomFile) geometryFile = geomFile;
@@ -463,23 +1432,340 @@ int CP::eventLoop(int argc, char** argv,
         TManager::Get().SetGeometryOverride(geometryFile);
     }
 
+    // Read the checkpoint when an earlier job is being resumed.
+    std::unique_ptr<TEventLoopCheckpoint> checkpoint;
+    if (!checkpointName.empty()) {
+        if (processCount > 1) {
+            CaptError("ERROR: --checkpoint cannot be used with -P");
+            exit(1);
+        }
+        checkpoint.reset(new TEventLoopCheckpoint(checkpointName));
+        if (resume && !checkpoint->Exists()) {
+            // The job was stopped before the first checkpoint, so it's
+            // started again from the beginning.
+            CaptLog("No checkpoint " << checkpointName
+                    << ": Start from the beginning");
+            resume = false;
+            outputMode = "RECREATE";
+        }
+        if (resume) {
+            if (!checkpoint->Read()) {
+                CaptError("ERROR: Cannot read checkpoint " << checkpointName);
+                exit(1);
+            }
+            if (checkpoint->IsFinished()) {
+                CaptLog("Event loop already finished: " << checkpointName);
+                return 0;
+            }
+            CaptLog("Resume from entry " << checkpoint->GetNextEntry()
+                    << " of input " << checkpoint->GetInputIndex()
+                    << " " << checkpoint->GetInputName());
+        }
+    }
+    else if (resume) {
+        CaptError("ERROR: --resume requires --checkpoint <file>");
+        exit(1);
+    }
+
+    // The outputs that are rolled over can't be matched to a checkpoint, or
+    // merged from the worker processes.
+    if (maxOutputSize > 0 || maxOutputEvents > 0) {
+        if (resume) {
+            CaptError("ERROR: --max-output-size and --max-output-events"
+                      << " cannot be used with --resume");
+            exit(1);
+        }
+        if (processCount > 1) {
+            CaptError("ERROR: --max-output-size and --max-output-events"
+                      << " cannot be used with -P");
+            exit(1);
+        }
+    }
+
+    // The datum sizes are collected for the events read by one process.
+    if (datumSizesLargest >= 0 && processCount > 1) {
+        CaptError("ERROR: --datum-sizes cannot be used with -P");
+        exit(1);
+    }
+
+    // Fork the worker processes.  The parent waits for the workers and then
+    // merges their output files, and then returns from the event loop.  Each
+    // worker processes a contiguous block of the slice into a temporary
+    // output file, so the merged files have the events in entry order.
+    std::unique_ptr<TEventLoopProcesses> processes;
+    int workerProcess = -1;
+    if (processCount > 1) {
+        if (targetRun >= 0 || targetEvent >= 0) {
+            CaptError("ERROR: -f cannot be used with -P");
+            exit(1);
+        }
+        if (!streamName.empty()) {
+            CaptError("ERROR: --stream-output cannot be used with -P");
+            exit(1);
+        }
+        // Every entry of the slice is divided between the workers.
+        if (readCount > 0) slice->Limit(readCount);
+        readCount = 0;
+        processes.reset(new TEventLoopProcesses(processCount));
+        processes->LoadGeometry(fileType, argv + firstInput, *slice);
+        workerProcess = processes->Fork();
+        if (workerProcess < 0) {
+            // The parent writes the total progress of the workers to the
+            // metrics file.  Each worker writes its own metrics file.
+            std::unique_ptr<TEventLoopMetrics> metrics;
+            if (!metricsName.empty()) {
+                metrics.reset(new TEventLoopMetrics(metricsName));
+                metrics->SetInterval(metricsEvery);
+                metrics->SetExpectedEvents(slice->GetEntries());
+                metrics->Write();
+            }
+            exitStatus = processes->Finish(outputNames, metrics.get());
+            if (exitStatus > 0) {
+                CaptError("Terminating with non-zero exit status.");
+                std::exit(exitStatus);
+            }
+            return 0;
+        }
+        // The worker only processes its block of the slice, and writes to
+        // temporary files that are merged by the parent.
+        slice->Divide(workerProcess, processCount);
+        for (std::vector<std::string>::iterator n = outputNames.begin();
+             n != outputNames.end(); ++n) {
+            *n = processes->GetWorkerName(*n, workerProcess);
+        }
+    }
+
+    // The events in a resumed output file must match the checkpoint.  The
+    // events that were saved after the checkpoint are removed since they
+    // will be processed again.
+    if (resume) {
+        outputMode = "UPDATE";
+        for (std::size_t f = 0; f < outputNames.size(); ++f) {
+            int expected = checkpoint->GetOutput(outputNames[f]);
+            if (expected < 0 || !TrimOutputFile(outputNames[f], expected)) {
+                CaptError("ERROR: Output " << outputNames[f]
+                          << " doesn't have the " << expected
+                          << " events in the checkpoint");
+                exit(2);
+            }
+        }
+    }
+
+    outputFiles = OpenOutputFiles(outputNames, argc, argv, sliceDescription,
+                                  writeBehind, splitDatums, outputSettings,
+                                  outputMode);
+
+    // Send the saved events down a pipe (or FIFO) to the next stage of a
+    // pipeline.  The user code sees the stream as the first output file when
+    // there aren't any other outputs.
+    std::unique_ptr<CP::TStreamOutput> streamOutput;
+    if (!streamName.empty()) {
+        try {
+            streamOutput.reset(new CP::TStreamOutput(streamName.c_str()));
+        }
+        catch (CP::EStreamOutput&) {
+            CaptError("ERROR: Cannot open output stream " << streamName);
+            exit(1);
+        }
+    }
+    int outputCount = outputFiles.size();
+    if (streamOutput && outputCount < 1) outputCount = 1;
+
+    // Roll the outputs over to numbered files when they reach the maximum
+    // size or number of events.  The new file gets the command line and the
+    // names of the current input files, and the geometry is written with its
+    // first event.
+    std::vector<std::string> currentInputNames;
+    CP::TOutputRollover rollover(
+        outputFiles, outputNames,
+        [&](const std::string& name) {
+            CP::TRootOutput* next
+                = OpenOutputFile(name, argc, argv, sliceDescription,
+                                 writeBehind, splitDatums, outputSettings);
+            WriteInputNames(next, currentInputNames);
+            return next;
+        });
+    rollover.SetMaxSize(maxOutputSize);
+    rollover.SetMaxEvents(maxOutputEvents);
+
+    // Save an event in the output selected by the user code (see
+    // SaveEvent()), and return true if it was written.
+    auto saveOutputEvent = [&](std::unique_ptr<TEvent>& event,
+                               int saveEvent) {
+        rollover.BeforeSave(saveEvent);
+        if (!SaveEvent(event, saveEvent, outputFiles,
+                       streamOutput.get(), preventSavedGeometry, timing)) {
+            return false;
+        }
+        rollover.EventSaved(saveEvent);
+        return true;
+    };
+
+    if (!outputFiles.empty()) outputFiles.front()->cd();
+    userCode.Initialize();
+
+    // Find out if the user code selects events on their context.  The
+    // contexts are only read from the input files when it does.
+    userCode.Accept(CP::TEventContext());
+    const bool contextSelection = userCode.UsesAccept();
+    
+    // If readcount is zero, that means read the entire file.
+    if (readCount<1) readCount = std::numeric_limits<int>::max();
+    
+    // Start the worker threads if the user code can run on several threads.
+    std::unique_ptr<TEventLoopWorkers> workers;
+    if (threadCount > 1) {
+        if (userCode.IsThreadSafe()) {
+            CaptLog("Processing events with " << threadCount << " threads");
+            workers.reset(new TEventLoopWorkers(userCode, threadCount,
+                                                outputCount));
+        }
+        else {
+            CaptError("User code is not thread safe:"
+                      << " Ignoring \"-j " << threadCount << "\"");
+        }
+    }
+
+    // Open the next input file in the background.  The prefetched file is
+    // read by CP::TRootInput, so this only works for ROOT input files.
+    std::unique_ptr<TInputPrefetch> prefetch;
+    if (prefetchInput) {
+        if (fileType == "root") prefetch.reset(new TInputPrefetch);
+        else CaptWarn("Prefetch is only available for ROOT input");
+    }
+
+    if (workers && batchSize > 1) {
+        CaptError("Batches are not used with threads:"
+                  << " Ignoring \"-B " << batchSize << "\"");
+        batchSize = 1;
+    }
+
+    // Collect the size of each datum in the events that are read.
+    std::unique_ptr<TDatumSizeReport> datumSizes;
+    if (datumSizesLargest >= 0) {
+        datumSizes.reset(new TDatumSizeReport);
+        datumSizes->SetLargestEvents(datumSizesLargest);
+    }
+
+    // Write the progress of the job.  Each worker process writes its own
+    // metrics file, and the parent combines them.  The number of events expected is used to estimate the
+    // time to completion, and isn't known when a job is resumed.
+    std::unique_ptr<TEventLoopMetrics> metrics;
+    if (!metricsName.empty()) {
+        std::string name = metricsName;
+        if (workerProcess >= 0) {
+            name = processes->GetWorkerName(metricsName, workerProcess);
+        }
+        metrics.reset(new TEventLoopMetrics(name));
+        metrics->SetInterval(metricsEvery);
+        Long64_t expected = -1;
+        if (slice) {
+            expected = slice->GetEntries();
+        }
+        else if (!resume) {
+            expected = 0;
+            for (int i = optind; i<argc; ++i) {
+                Long64_t count = CountInputEvents(fileType, argv[i]);
+                if (count < 0) {
+                    expected = -1;
+                    break;
+                }
+                expected += count;
+            }
+            if (expected >= 0) {
+                expected = std::max((Long64_t) 0, expected - skipCount);
+            }
+        }
+        if (expected >= 0 && readCount < expected) expected = readCount;
+        if (resume) expected = -1;
+        metrics->SetExpectedEvents(expected);
+        metrics->Write();
+    }
+
     int totalRead = 0;
     int totalWritten = 0;
+    if (resume) {
+        totalRead = checkpoint->GetTotalRead();
+        totalWritten = checkpoint->GetTotalWritten();
+    }
     double nextOutput = 10;
+
+    // Commit the output files, and then record the position of the next
+    // entry to process in the checkpoint.
+    int lastCheckpoint = totalRead;
+    auto saveCheckpoint = [&](int index, const std::string& name,
+                              Long64_t nextEntry) {
+        for (std::size_t f = 0; f < outputFiles.size(); ++f) {
+            outputFiles[f]->Commit();
+            checkpoint->SetOutput(outputNames[f],
+                                  outputFiles[f]->GetEventsWritten());
+        }
+        checkpoint->SetInput(index, name, nextEntry);
+        checkpoint->SetTotals(totalRead, totalWritten);
+        checkpoint->Write();
+        lastCheckpoint = totalRead;
+    };
+
+    // Record the progress in the metrics file.  The counts are for the
+    // events processed by this job (a resumed job starts from zero).
+    const int metricsStartRead = totalRead;
+    const int metricsStartWritten = totalWritten;
+    auto updateMetrics = [&](int fileRead, int fileWritten) {
+        if (!metrics) return;
+        metrics->SetFileCounts(fileRead, fileWritten);
+        metrics->SetTotals(totalRead - metricsStartRead,
+                           totalWritten - metricsStartWritten);
+        metrics->Update();
+    };
+
     while (optind<argc) {
         // Check to see if we need to read more events.
         if (readCount<=totalRead) break;
         
         // Open input the file
+        const int inputIndex = optind - firstInput;
         std::string fileName = argv[optind++];
         CP::TEventContext firstContext;
         CP::TEventContext lastContext;
         int fileRead = 0;
         int fileWritten = 0;
+
+        // Find the entries of this file that are in the slice.  The end is
+        // negative when all of the events are processed.
+        int fileEnd = -1;
+        if (slice) {
+            Long64_t begin = 0;
+            Long64_t end = 0;
+            if (!slice->GetInputEntries(inputIndex, begin, end)) {
+                CaptInfo("No entries in slice for " << fileName);
+                continue;
+            }
+            skipCount = begin;
+            fileEnd = end;
+        }
+
+        // Skip the input files that were finished before the checkpoint,
+        // and start from the next unprocessed entry.
+        if (resume && inputIndex < checkpoint->GetInputIndex()) continue;
+        if (resume && inputIndex == checkpoint->GetInputIndex()) {
+            if (!checkpoint->GetInputName().empty()
+                && checkpoint->GetInputName() != fileName) {
+                CaptError("ERROR: Input " << fileName
+                          << " does not match the checkpoint input "
+                          << checkpoint->GetInputName());
+                exit(1);
+            }
+            skipCount = checkpoint->GetNextEntry();
+        }
+
         try {
             std::unique_ptr<CP::TVInputFile> input;
+            if (prefetch) {
+                TFile* file = prefetch->Take(fileName);
+                if (file) input.reset(new CP::TRootInput(file));
+            }
             try {
-                input.reset(
+                if (!input) input.reset(
                     CP::TManager::Get().Input().Builder(fileType.c_str()).Open(
                         fileName.c_str()));
             }
@@ -498,49 +1784,216 @@ int CP::eventLoop(int argc, char** argv,
                 CaptError("ERROR: File not found " << fileName);
                 continue;
             }
+            if (metrics) metrics->BeginFile(fileName);
             
+            // Save the input file name input the output file.  A chain
+            // saves the name of each file in the chain.  The names are kept
+            // for the files that continue an output that is rolled over.
+            currentInputNames.assign(1,fileName);
+            CP::TChainInput* chainInput
+                = dynamic_cast<CP::TChainInput*>(input.get());
+            if (chainInput) currentInputNames = chainInput->GetFileNames();
             if (!outputFiles.empty()) {
-                // Save the input file name input the output file.
                 for (std::vector<CP::TRootOutput*>::iterator f
                          = outputFiles.begin();
                      f != outputFiles.end(); ++f) {
-                    std::unique_ptr<char>
-                        resolvedPath(realpath(fileName.c_str(),NULL));
-                    TObjString inputNameString(resolvedPath.get());
-                    (*f)->WriteObject(&inputNameString,"inputFile");
+                    WriteInputNames(*f, currentInputNames);
                 }
                 // Make sure we are on the first output file so that any
                 // created histograms go to a predictable place.
                 outputFiles.front()->cd();
             }
 
+            // Start opening the next input file.
+            if (prefetch && optind < argc) prefetch->Start(argv[optind]);
+
+            // Choose the parts of the event to be read.
+            if (!includedDatums.empty() || !excludedDatums.empty()) {
+                CP::TRootInput* rootInput
+                    = dynamic_cast<CP::TRootInput*>(input.get());
+                if (rootInput) {
+                    rootInput->SetIncludedDatums(includedDatums);
+                    rootInput->SetExcludedDatums(excludedDatums);
+                    if (!rootInput->HasDatumBranches()) {
+                        CaptWarn("Input " << fileName << " was not written"
+                                 << " with --split, so the full event is"
+                                 << " read before -I and -X remove"
+                                 << " datums");
+                    }
+                }
+                else {
+                    CaptWarn("Datum selection is only available"
+                             << " for ROOT input");
+                }
+            }
+
+            // Read the event tree through a cache.
+            if (cacheSize >= 0) {
+                CP::TRootInput* rootInput
+                    = dynamic_cast<CP::TRootInput*>(input.get());
+                if (rootInput) {
+                    rootInput->SetCacheSize(cacheSize, cacheLearnEntries);
+                }
+            }
+
+            // Start reading events on a background thread.
+            if (readAhead > 0) {
+                CP::TRootInput* rootInput
+                    = dynamic_cast<CP::TRootInput*>(input.get());
+                if (rootInput) rootInput->SetReadAhead(readAhead);
+                else CaptWarn("Read-ahead is only available for ROOT input");
+            }
+
+            if (datumSizes) datumSizes->SetCompressionRatios(input.get());
             userCode.BeginFile(input.get());
             
-            std::unique_ptr<TEvent> event(input->FirstEvent());
+            // Read the event "stride" entries after the current position.
+            // When the user code selects events on their context and the
+            // input file can read the context without the event, the
+            // entries rejected by the user code are passed over without
+            // being read.
+            int fileRejected = 0;
+            auto readNextEvent = [&](int stride) {
+                TEventLoopTiming::TScope scope(timing,
+                                               TEventLoopTiming::kNextEvent);
+                int next = input->GetPosition() + stride;
+                int accepted = next;
+                CP::TEventContext context;
+                while (contextSelection
+                       && (fileEnd < 0 || accepted < fileEnd)
+                       && input->ReadContext(accepted,context)
+                       && !userCode.Accept(context)) {
+                    ++accepted;
+                    ++fileRejected;
+                }
+                if (accepted == next) return input->NextEvent(stride-1);
+                input->Seek(accepted);
+                return input->NextEvent();
+            };
 
-            // Position to the first event in the file to read.  This might
-            // leave the file positioned at the end of file.
-            while (skipCount > 0) {
-                int startPosition = input->GetPosition();
-                event.reset(input->NextEvent(skipCount-1));
-                int changedPosition = input->GetPosition() - startPosition;
-                if (changedPosition>0) skipCount -= changedPosition;
-                else --skipCount;
+            // Position to the first event in the file to read.  The skip
+            // only moves the entry number (for input files that support
+            // it), and can leave the file positioned at the end of file in
+            // which case the rest of the skip is applied to the next file.
+            std::unique_ptr<TEvent> event;
+            if (skipCount > 0) {
+                {
+                    TEventLoopTiming::TScope scope(timing,
+                                                TEventLoopTiming::kNextEvent);
+                    skipCount -= input->Seek(skipCount);
+                }
+                if (skipCount < 1) event.reset(readNextEvent(1));
+            }
+            else {
+                CP::TEventContext context;
+                if (contextSelection && input->ReadContext(0,context)) {
+                    input->Seek(0);
+                    event.reset(readNextEvent(1));
+                }
+                else {
+                    TEventLoopTiming::TScope scope(timing,
+                                                TEventLoopTiming::kNextEvent);
+                    event.reset(input->FirstEvent());
+                }
+            }
+
+            // Go to the requested run and event.  The input file uses an
+            // index if it has one.  If the event isn't in this file, the
+            // search continues in the next file.
+            if (targetRun >= 0 || targetEvent >= 0) {
+                TEventContext target;
+                if (targetRun >= 0) target.SetRun(targetRun);
+                if (targetEvent >= 0) target.SetEvent(targetEvent);
+                if (event && !TVInputFile::IsAtOrAfter(event->GetContext(),
+                                                       target)) {
+                    event.reset(input->FindEvent(target));
+                }
+                if (event) {
+                    targetRun = -1;
+                    targetEvent = -1;
+                }
             }
 
             // Get the first event context that will be processed.
-            firstContext = event->GetContext();
+            if (event) firstContext = event->GetContext();
             
-            // Process the events in the file.
-            for (;!input->EndOfFile();event.reset(input->NextEvent())) {
+            // Handle an event that has been returned by the worker threads.
+            // The events come back in the order they were read.  If the user
+            // code asked to skip to the next file, the events read after
+            // that one are thrown away.
+            bool nextFile = false;
+            std::exception_ptr workerFailure;
+            auto writeWorkerResult = [&]() {
+                TEventLoopWorkers::Result result;
+                {
+                    TEventLoopTiming::TScope scope(timing,
+                                                   TEventLoopTiming::kProcess);
+                    result = workers->Next();
+                }
+                std::unique_ptr<TEvent> done(result.event);
+                if (nextFile || workerFailure) return;
+                if (result.exception) {
+                    workerFailure = result.exception;
+                    workers->Discard();
+                    return;
+                }
+                if (result.nextFile) {
+                    nextFile = true;
+                    workers->Discard();
+                    return;
+                }
+                if (saveOutputEvent(done, result.save)) {
+                    ++totalWritten;
+                    ++fileWritten;
+                }
+            };
 
-                if (targetRun>=0 
-                    && event->GetRunId()< (UInt_t) targetRun) continue;
-                else targetRun = -1;
+            // Process the events that have been collected into a batch, and
+            // then write them.  If the user code asks to skip to the next
+            // file, none of the events in the batch are saved.
+            std::vector< std::unique_ptr<TEvent> > batch;
+            auto processBatch = [&]() {
+                if (batch.empty()) return;
+                std::vector<TEvent*> events;
+                for (std::size_t i = 0; i < batch.size(); ++i) {
+                    events.push_back(batch[i].get());
+                }
+                std::vector<int> saveEvents;
+                try {
+                    TEventLoopTiming::TScope scope(timing,
+                                                   TEventLoopTiming::kProcess);
+                    if (!outputFiles.empty()) outputFiles.front()->cd();
+                    saveEvents = userCode.ProcessBatch(events,
+                                                       outputCount);
+                }
+                catch (ENextEventLoopFile& ex) {
+                    nextFile = true;
+                }
+                for (std::size_t i = 0; !nextFile && i < batch.size(); ++i) {
+                    int saveEvent = -1;
+                    if (i < saveEvents.size()) saveEvent = saveEvents[i];
+                    if (saveOutputEvent(batch[i], saveEvent)) {
+                        ++totalWritten;
+                        ++fileWritten;
+                    }
+                }
+                batch.clear();
+                TEventLoopTiming::TScope scope(timing,
+                                               TEventLoopTiming::kHandleCheck);
+                if (writeBehind < 1 && !CleanHandleRegistry()) {
+                    DumpHandleRegistry();
+                    CaptError("WARNING: Memory Leak in "
+                              << " File(event,run): " << fileName 
+                              << ":(" 
+                              << lastContext << ")");
+                }
+            };
 
-                if (targetEvent>=0 
-                    && event->GetEventId()<(UInt_t) targetEvent) continue;
-                else targetEvent = -1;
+            // Process the events in the file.
+            for (;!input->EndOfFile();
+                 event.reset(readNextEvent(1))) {
+                if (!event) break;
+                if (fileEnd >= 0 && fileEnd <= input->GetPosition()) break;
 
                 ++totalRead;
                 ++fileRead;
@@ -548,47 +2001,71 @@ int CP::eventLoop(int argc, char** argv,
                 // Save the last event context that was read.
                 lastContext = event->GetContext();
                 memoryUsage.LogMemory();
-                
-                int saveEvent = -1;
-                try {
-                    if (!outputFiles.empty()) outputFiles.front()->cd();
-                    saveEvent = userCode.Process(*event,outputFiles.size());
+                if (datumSizes) datumSizes->AddEvent(*event);
+
+                if (workers) {
+                    // Hand the event to the workers, and then write any
+                    // finished events while limiting the number of events
+                    // that are in memory.  The time waiting for the workers
+                    // is counted as processing time.
+                    workers->Submit(event.release());
+                    while (workers->InFlight()
+                           >= 2*workers->GetThreadCount()) {
+                        writeWorkerResult();
+                    }
+                    if (nextFile || workerFailure) break;
                 }
-                catch (ENextEventLoopFile& ex) {
-                    break;
+                else if (batchSize > 1) {
+                    // Collect the event into the batch, and process the
+                    // batch when it is full.
+                    batch.push_back(std::move(event));
+                    if (batchSize <= (int) batch.size()) processBatch();
+                    if (nextFile) break;
                 }
+                else {
+                    int saveEvent = -1;
+                    try {
+                        TEventLoopTiming::TScope scope(timing,
+                                                   TEventLoopTiming::kProcess);
+                        if (!outputFiles.empty()) outputFiles.front()->cd();
+                        saveEvent = userCode.Process(*event,
+                                                     outputCount);
+                    }
+                    catch (ENextEventLoopFile& ex) {
+                        break;
+                    }
 
-                if (!preventSavedGeometry) {
-                    int geomFile = std::max(0,saveEvent);
-                    // Check if the geometry should be saved.
-                    if (0 <= saveEvent 
-                        && saveEvent < (int) outputFiles.size()) {
-                        try {
-                            outputFiles[geomFile]
-                                ->WriteGeometry(TManager::Get().Geometry());
-                        }
-                        catch (ENoGeometry) {
-                            CaptSevere("Geometry not saved in output");
-                        }
-                        catch (EManager) {
-                            CaptSevere("Geometry not saved in output");
-                        }
+                    if (saveOutputEvent(event, saveEvent)) {
+                        ++totalWritten;
+                        ++fileWritten;
                     }
-                }
                 
-                if (0 <= saveEvent && saveEvent < (int) outputFiles.size()) {
-                    outputFiles[saveEvent]->WriteEvent(*event);
-                    ++totalWritten;
-                    ++fileWritten;
+                    // Events handed to an asynchronous output file are
+                    // still alive, so the registry is only checked at the
+                    // end of the file.
+                    event.reset(NULL);
+                    TEventLoopTiming::TScope scope(timing,
+                                               TEventLoopTiming::kHandleCheck);
+                    if (writeBehind < 1 && !CleanHandleRegistry()) {
+                        DumpHandleRegistry();
+                        CaptError("WARNING: Memory Leak in "
+                                  << " File(event,run): " << fileName 
+                                  << ":(" 
+                                  << lastContext << ")");
+                    }
                 }
-                
-                event.reset(NULL);
-                if (!CleanHandleRegistry()) {
-                    DumpHandleRegistry();
-                    CaptError("WARNING: Memory Leak in "
-                              << " File(event,run): " << fileName 
-                              << ":(" 
-                              << lastContext << ")");
+                timing.EndEvent();
+
+                // Save a checkpoint once all of the events that have been
+                // read are written.
+                if (checkpoint && checkpointEvery <= totalRead-lastCheckpoint) {
+                    while (workers && workers->InFlight() > 0) {
+                        writeWorkerResult();
+                    }
+                    processBatch();
+                    if (nextFile || workerFailure) break;
+                    saveCheckpoint(inputIndex, fileName,
+                                   input->GetPosition()+1);
                 }
                 
                 if (totalRead>(nextOutput-0.5)) {
@@ -598,10 +2075,23 @@ int CP::eventLoop(int argc, char** argv,
                     }
                     CaptLog("Events Processed: " << totalRead);
                 }
+                updateMetrics(fileRead, fileWritten);
 
                 // Check to see if we have read enough events.
                 if (readCount<=totalRead) break;
             }
+
+            // Finish the events that are still being processed.  The
+            // handle registry can only be checked once all of the events in
+            // flight are deleted.
+            while (workers && workers->InFlight() > 0) writeWorkerResult();
+            if (workerFailure) std::rethrow_exception(workerFailure);
+            processBatch();
+            for (std::vector<CP::TRootOutput*>::iterator f
+                     = outputFiles.begin();
+                 f != outputFiles.end(); ++f) {
+                (*f)->Synchronize();
+            }
             
             if (!CleanHandleRegistry()) {
                 DumpHandleRegistry();
@@ -609,14 +2099,40 @@ int CP::eventLoop(int argc, char** argv,
                           << fileName);
             }
             
+            if (fileRejected > 0) {
+                CaptLog("Events rejected by context in " << fileName
+                        << ": " << fileRejected);
+            }
+
+            {
+                CP::TRootInput* rootInput
+                    = dynamic_cast<CP::TRootInput*>(input.get());
+                std::string cacheStatistics;
+                if (rootInput) {
+                    cacheStatistics = rootInput->GetCacheStatistics();
+                }
+                if (!cacheStatistics.empty()) {
+                    CaptLog("Tree cache for " << fileName << ": "
+                            << cacheStatistics);
+                }
+            }
+
             if (!outputFiles.empty()) outputFiles.front()->cd();
             userCode.EndFile(input.get());
             input->CloseFile();
+
+            // The file is finished, so a resumed job starts with the next
+            // input file.
+            if (checkpoint) {
+                saveCheckpoint(inputIndex+1, (optind<argc) ? argv[optind]: "",
+                               0);
+            }
         }
         catch (std::exception& except) {
             CaptError("ERROR: Uncaught exception in " 
                       << fileName);
             CaptError("    What: " << except.what());
+            if (workers) workers->Flush();
             if (!CleanHandleRegistry()) {
                 DumpHandleRegistry();
                 CaptError("WARNING: Memory Leak after finishing "
@@ -628,6 +2144,7 @@ int CP::eventLoop(int argc, char** argv,
             // Don't crash on an error, but try to go to the next file.
             CaptError("ERROR: Uncaught exception in " 
                       << fileName);
+            if (workers) workers->Flush();
             if (!CleanHandleRegistry()) {
                 DumpHandleRegistry();
                 CaptError("WARNING: Memory Leak after finishing "
@@ -644,33 +2161,79 @@ int CP::eventLoop(int argc, char** argv,
                   << "," << fileRead
                   << "," << fileWritten
                   << std::endl;
+        updateMetrics(fileRead, fileWritten);
         if (exitStatus != 0) break;
     }
     
+    // Stop the worker threads.  This calls FinalizeWorker() on each thread.
+    workers.reset();
+
     if (!outputFiles.empty()) {
         for (std::vector<CP::TRootOutput*>::iterator file 
                  = outputFiles.begin();
              file != outputFiles.end(); 
              ++ file) {
+            // Finish the asynchronous output before the user code writes
+            // into the file.
+            (*file)->Synchronize();
             userCode.Finalize(*file);
             memoryUsage.Write(*file);
+            timing.Write(*file);
         }
     }
     else {
         userCode.Finalize((CP::TRootOutput*) NULL);
         memoryUsage.Write((CP::TRootOutput*) NULL);
+        timing.Write((CP::TRootOutput*) NULL);
+    }
+    
+    // Record the final state of the output files.
+    if (checkpoint) {
+        for (std::size_t f = 0; f < outputFiles.size(); ++f) {
+            checkpoint->SetOutput(outputNames[f],
+                                  outputFiles[f]->GetEventsWritten());
+        }
+        checkpoint->SetTotals(totalRead, totalWritten);
     }
     
     std::cout << "Total Events Read: " << totalRead << std::endl;
+    if (datumSizes) datumSizes->Print(std::cout);
+    if (streamOutput) {
+        std::cout << "Total Events Sent: "
+                  << streamOutput->GetEventsWritten() << std::endl;
+        streamOutput->Close();
+    }
     if (!outputFiles.empty()) {
         std::cout << "Total Events Written: " << totalWritten << std::endl;
         for (std::vector<TRootOutput*>::iterator file = outputFiles.begin();
              file != outputFiles.end();
              ++file) {
-            (*file)->Close();
+            try {
+                (*file)->Close();
+            }
+            catch (CP::ERootOutputWriteFailed&) {
+                CaptError("Events were not written to "
+                          << (*file)->GetName());
+                exitStatus = 1;
+            }
         }
     }
 
+    if (metrics) {
+        metrics->SetTotals(totalRead - metricsStartRead,
+                           totalWritten - metricsStartWritten);
+        metrics->Write(true);
+    }
+
+    // Mark the job as finished so that it won't be resumed.
+    if (checkpoint && exitStatus == 0) {
+        checkpoint->SetFinished(true);
+        checkpoint->Write();
+    }
+
+    // A worker process must not return to the caller's main().
+    if (workerProcess >= 0) std::exit(exitStatus);
+
     if (exitStatus > 0) {
         CaptError("Terminating with non-zero exit status.");
         std::exit(exitStatus);
@@ -47,6 +47,8 @@ namespace CP {
 //     -o <file>         Set the name of an output file.
 //                       Multiple output files can be provided.
 //     -a                Read all events
+//     -B <cnt>          Process events in batches of <cnt>
+//                       (see TEventLoopFunction::ProcessBatch)
 //     -c <file>         Set the logging config file name
 //     -d                Increase the debug level
 //     -D <name>=[error,severe,warn,debug,trace]
@@ -56,17 +58,76 @@ namespace CP {
 //     -G <file>         Force a geometry file
 //     -g                Don't save geometry in output
 //     -H                Debug THandle (slow)
+//     -I <paths>        Only keep these datums in the input events
+//                       (e.g. hits,fits or truth/G4Trajectories)
+//     -j <threads>      Process events on <threads> threads
+//                       (only if the user code is thread safe)
 //     -n <cnt>          Only read <cnt> events  [Default: 1]
+//     -P <procs>        Process events in <procs> forked processes
+//                       (the outputs are merged at the end)
 //     -q                Decrease the verbosity
 //     -r <override>     Override a parameter "name:value"
 //                          example: -r "elecSim.simple.drift.life:0.1 ms"
 //     -R <override>     Name of an run-time parameter override file
 //     -s <cnt>          Skip <cnt> events
+//     -T                Time each stage of the event loop
 //     -u                Log the memory and CPU usage
+//     -X <paths>        Don't keep these datums in the input events
 //     -v                Increase the verbosity
 //     -V <name>=[quiet,log,info,verbose]
 //                       Change the named log level
 //     -O <opt>[=<val>]  Set an option for the user code
+//     --read-ahead <cnt>
+//                       Read <cnt> events ahead on a background thread
+//     --write-behind <cnt>
+//                       Write output events on a background thread with
+//                         a backlog of <cnt> events
+//     --shard <k>/<N>   Only process the k'th of N equal slices of the entries
+//                         in all of the input files (k is from 0 to N-1)
+//     --entries <a>:<b> Only process entries a to b-1 counted across all
+//                         of the input files
+//     --checkpoint <file>
+//                       Commit the outputs and record the progress in <file>
+//     --checkpoint-every <cnt>
+//                       Save a checkpoint every <cnt> events  [Default: 1000]
+//     --resume          Continue from the checkpoint (the outputs are updated)
+//                       or start again if there isn't a checkpoint
+//     --prefetch        Open the next input file while the current
+//                         file is read
+//     --metrics <file>  Write the progress as JSON to <file>
+//     --metrics-every <sec>
+//                       Rewrite the metrics every <sec> seconds  [Default: 10]
+//     --split <names>   Write the named top-level datums in separate
+//                         branches (e.g. digits,hits,truth,fits)
+//     --compression <alg>[:<level>]
+//                       Compress the output with zlib, lzma, lz4 or zstd
+//                         at <level> (0 to 9)  [Default: zlib:1]
+//     --basket-size <bytes>
+//                       Set the output basket size  [Default: 128000]
+//     --auto-flush <cnt>
+//                       Flush the output baskets every <cnt> events
+//                         (or every -<cnt> bytes)
+//     --cache-size <bytes>
+//                       Read the input through a <bytes> tree cache
+//                         (0 to turn off)  [Default: 30000000]
+//     --cache-learn <cnt>
+//                       Learn the cached branches from <cnt> events
+//                         [Default: 10]
+//     --stream-output <name>
+//                       Send the saved events to a pipe or FIFO ("-" for
+//                         standard output) to be read with "-t stream"
+//     --max-output-size <bytes>
+//                       Continue each output in a numbered file when it
+//                         reaches <bytes>
+//     --max-output-events <cnt>
+//                       Continue each output in a numbered file when it
+//                         has <cnt> events
+//     --datum-sizes <cnt>
+//                       Report the size of each datum read, and the datums
+//                         in the <cnt> largest events
+//     --catalogue <file>
+//                       Find the event for -f in a catalogue and only read
+//                         the file with the event (see index-events)
 /// \endcode
 ///
 /// \htmlonly
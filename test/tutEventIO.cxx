@@ -6,11 +6,44 @@
 #include <iostream>
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
 #include <tut.h>
 
+#include <TObjString.h>
+#include <TKey.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TH1F.h>
+
 #include "TEvent.hxx"
 #include "TRootInput.hxx"
+#include "TChainInput.hxx"
 #include "TRootOutput.hxx"
+#include "TRawMmapInput.hxx"
+#include "TRawDigitWriter.hxx"
+#include "TStreamInput.hxx"
+#include "TDatumSizeReport.hxx"
+#include "TEventFileMerger.hxx"
+#include "TEventCatalogue.hxx"
+#include "TEventLoopFunction.hxx"
+#include "TEventLoopCheckpoint.hxx"
+#include "TEventLoopSlice.hxx"
+#include "TEventLoopProcesses.hxx"
+#include "TEventLoopTiming.hxx"
+#include "TEventLoopMetrics.hxx"
+#include "TRuntimeParameters.hxx"
+#include "eventLoop.hxx"
+#include "TStreamOutput.hxx"
+#include "TDigitContainer.hxx"
+#include "TPulseDigit.hxx"
 #include "TMCHit.hxx"
 #include "TG4VHit.hxx"
 #include "TG4HitSegment.hxx"
@@ -149,6 +182,144 @@ namespace {
         event.AddDatum(d1);
     }
 
+    /// Write "count" empty events for a run with the event numbers
+    /// firstEvent, firstEvent+step, ...  If a fill function is given, it's
+    /// called for each event before it's written.
+    void WriteEvents(CP::TRootOutput& output, int run, int firstEvent,
+                     int step, int count,
+                     void (*fill)(CP::TEvent&) = NULL) {
+        for (int i=0; i<count; ++i) {
+            CP::TEvent event;
+            event.SetRunId(run);
+            event.SetEventId(firstEvent + step*i);
+            if (fill) fill(event);
+            output.WriteEvent(event);
+        }
+    }
+
+    /// Write a new file of events (see above).
+    void WriteEvents(const char* fileName, int run, int firstEvent,
+                     int step, int count,
+                     void (*fill)(CP::TEvent&) = NULL) {
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        WriteEvents(*output, run, firstEvent, step, count, fill);
+        output->Close();
+        delete output;
+    }
+
+    /// Write a file of empty events for runs 1 and 2 with the even event
+    /// numbers from 0 to 8.
+    void WriteEmptyEvents(const char* fileName) {
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        for (int run=1; run<3; ++run) {
+            for (int i=0; i<5; ++i) {
+                CP::TEvent event;
+                event.SetRunId(run);
+                event.SetEventId(2*i);
+                output->WriteEvent(event);
+            }
+        }
+        output->Close();
+        delete output;
+    }
+
+    /// Set the sub-run of an event.
+    void SetSubRun5(CP::TEvent& event) {
+        CP::TEventContext context = event.GetContext();
+        context.SetSubRun(5);
+        event.SetContext(context);
+    }
+
+    /// Record the context of the events processed by an event loop.
+    class TRecordContext : public CP::TEventLoopFunction {
+    public:
+        bool operator () (CP::TEvent& event) {
+            fContexts.push_back(event.GetContext());
+            return false;
+        }
+        std::vector<CP::TEventContext> fContexts;
+    };
+
+    /// Record the context of the events from run 2.
+    class TAcceptRun2 : public TRecordContext {
+    public:
+        bool Accept(const CP::TEventContext& context) {
+            return context.GetRun() == 2;
+        }
+    };
+
+    /// Save every event in the first output, and histogram the event
+    /// numbers.
+    class TSaveEvents : public CP::TEventLoopFunction {
+    public:
+        TSaveEvents() : fHistogram(NULL) {}
+        void Initialize(void) {
+            fHistogram = new TH1F("savedEvents","Saved events",10,0,10);
+        }
+        bool operator () (CP::TEvent& event) {
+            fHistogram->Fill(event.GetEventId());
+            return true;
+        }
+        TH1F* fHistogram;
+    };
+
+    /// Count the calls of the worker methods of a thread safe event loop,
+    /// and save every event in the first output.
+    class TCountWorkers : public CP::TEventLoopFunction {
+    public:
+        bool IsThreadSafe(void) const {return true;}
+        void InitializeWorker(int worker) {
+            std::lock_guard<std::mutex> lock(fMutex);
+            ++fInitialized[worker];
+        }
+        void FinalizeWorker(int worker) {
+            std::lock_guard<std::mutex> lock(fMutex);
+            ++fFinalized[worker];
+        }
+        int Process(CP::TEvent&, int) {
+            std::lock_guard<std::mutex> lock(fMutex);
+            ++fProcessed[GetWorkerIndex()];
+            return 0;
+        }
+        std::mutex fMutex;
+        std::map<int,int> fInitialized;
+        std::map<int,int> fFinalized;
+        std::map<int,int> fProcessed;
+    };
+
+    /// Record the size of each batch of events, and save every event in a
+    /// batch except the last one.
+    class TBatchEvents : public CP::TEventLoopFunction {
+    public:
+        std::vector<int> ProcessBatch(std::vector<CP::TEvent*>& events,
+                                      int) {
+            fBatchSizes.push_back(events.size());
+            return std::vector<int>(events.size()-1, 0);
+        }
+        std::vector<int> fBatchSizes;
+    };
+
+    /// Return the number of events in a file, or -1 if the file doesn't
+    /// exist.
+    Long64_t CountFileEvents(const char* fileName) {
+        struct stat status;
+        if (stat(fileName, &status) != 0) return -1;
+        TFile file(fileName,"READ");
+        TTree* tree = dynamic_cast<TTree*>(file.Get("captainEventTree"));
+        Long64_t events = tree ? tree->GetEntries(): 0;
+        file.Close();
+        return events;
+    }
+
+    /// Return the contents of a text file, or an empty string if the file
+    /// doesn't exist.
+    std::string ReadTextFile(const char* fileName) {
+        std::ifstream input(fileName);
+        std::ostringstream contents;
+        contents << input.rdbuf();
+        return contents.str();
+    }
+
     void FillEvent(CP::TEvent& event) {
         CreateTruth(event);
         CreateHits(event,"captain");
@@ -593,4 +764,1340 @@ namespace tut {
             ensure("State 2 track does not have a cluster state",!clusterState);
         }
     }
+
+    // Test that events can be found by run and event number using the index
+    // saved in the output file.
+    template<> template<>
+    void testEventIO::test<12> () {
+        const char* fileName = "./tutEventIOIndex.root";
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        for (int run=1; run<3; ++run) {
+            for (int i=0; i<5; ++i) {
+                CP::TEvent event;
+                event.SetRunId(run);
+                event.SetEventId(2*i);
+                output->WriteEvent(event);
+            }
+        }
+        output->Close();
+        delete output;
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        CP::TEvent* event 
+            = input->FindEvent(CP::TEventContext(CP::TEventContext::Invalid,
+                                                 2, 0, 4, 0, 0));
+        ensure("Event with run 2, event 4 is found", event);
+        ensure_equals("Found event run number", event->GetRunId(), 2U);
+        ensure_equals("Found event number", event->GetEventId(), 4U);
+        ensure_equals("Found event position", input->GetPosition(), 7);
+        delete event;
+
+        // Look for an event number that isn't in the file.  The next event
+        // is returned.
+        event = input->FindEvent(CP::TEventContext(CP::TEventContext::Invalid,
+                                                   2, 0, 5, 0, 0));
+        ensure("Event after run 2, event 5 is found", event);
+        ensure_equals("Following event number", event->GetEventId(), 6U);
+        delete event;
+
+        // Look for an event after the end of the file.
+        event = input->FindEvent(CP::TEventContext(CP::TEventContext::Invalid,
+                                                   3, 0, 0, 0, 0));
+        ensure("Event after the last run is not found", !event);
+        ensure("Input is at the end of file", input->EndOfFile());
+
+        input->Close();
+        delete input;
+    }
+
+    // Test that an input file can be positioned without reading events.
+    template<> template<>
+    void testEventIO::test<13> () {
+        const char* fileName = "./tutEventIOSeek.root";
+        WriteEmptyEvents(fileName);
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        ensure_equals("Seek to entry 6", input->Seek(6), 6);
+        ensure_equals("No events read by seek", input->GetEventsRead(), 0);
+        CP::TEvent* event = input->NextEvent();
+        ensure("Event after seek is read", event);
+        ensure_equals("Event after seek run number", event->GetRunId(), 2U);
+        ensure_equals("Event after seek event number",
+                      event->GetEventId(), 2U);
+        delete event;
+
+        ensure_equals("Seek past the end of file", input->Seek(20), 10);
+        ensure("Input is at the end of file", input->EndOfFile());
+
+        input->Close();
+        delete input;
+    }
+
+    // Test that the event context can be read without reading the event.
+    template<> template<>
+    void testEventIO::test<14> () {
+        const char* fileName = "./tutEventIOContext.root";
+        WriteEmptyEvents(fileName);
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        CP::TEventContext context;
+        ensure("Context of entry 7 is read", input->ReadContext(7,context));
+        ensure_equals("Context run number", context.GetRun(), 2U);
+        ensure_equals("Context event number", context.GetEvent(), 4U);
+        ensure_equals("No events read for context",
+                      input->GetEventsRead(), 0);
+        ensure("Context past the end of file is not read",
+               !input->ReadContext(10,context));
+
+        CP::TEvent* event = input->NextEvent();
+        ensure("First event is read after the context", event);
+        ensure_equals("First event run number", event->GetRunId(), 1U);
+        delete event;
+
+        input->Close();
+        delete input;
+
+        // The contexts are only used when the user code overrides Accept().
+        TRecordContext defaultCode;
+        defaultCode.Accept(CP::TEventContext());
+        ensure("Default Accept is not used", !defaultCode.UsesAccept());
+        TAcceptRun2 selectCode;
+        selectCode.Accept(CP::TEventContext());
+        ensure("Overridden Accept is used", selectCode.UsesAccept());
+
+        const char* args[] = {"tutEventIO", fileName, NULL};
+        optind = 1;
+        CP::eventLoop(2, const_cast<char**>(args), selectCode);
+        ensure_equals("Events accepted on their context",
+                      selectCode.fContexts.size(), 5U);
+        ensure_equals("Accepted event run number",
+                      selectCode.fContexts[0].GetRun(), 2U);
+    }
+
+    // Test that the top-level datums can be written in separate branches,
+    // and that the event is put back together when it is read.
+    template<> template<>
+    void testEventIO::test<15> () {
+        const char* fileName = "./tutEventIOSplit.root";
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        output->SetSplitDatums("digits,hits,truth");
+        ensure_equals("Split datums", output->GetSplitDatums().size(), 3U);
+
+        CP::TEvent event;
+        event.SetRunId(1);
+        event.SetEventId(1);
+        event.Get<CP::TDataVector>("hits")->push_back(
+            new CP::TDataVector("splitHits"));
+        std::vector<std::string> names;
+        for (CP::TEvent::iterator d = event.begin(); d != event.end(); ++d) {
+            names.push_back((*d)->GetName());
+        }
+        output->WriteEvent(event);
+        event.SetEventId(2);
+        output->WriteEvent(event);
+        output->Close();
+        delete output;
+
+        // The event written is unchanged.
+        std::vector<std::string> written;
+        for (CP::TEvent::iterator d = event.begin(); d != event.end(); ++d) {
+            written.push_back((*d)->GetName());
+            ensure("Written datum parent is the event",
+                   (*d)->GetParentDatum() == &event);
+        }
+        ensure("Written event has the same datums", names == written);
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        CP::TEvent* read = input->FirstEvent();
+        ensure("Split event is read", read);
+        ensure("Split datum is read", 
+               read->Get<CP::TDataVector>("~/hits/splitHits"));
+        ensure("Unsplit datum is read", read->Get<CP::TDataVector>("~/fits"));
+        ensure("Missing split datum is not added",
+               !read->Get<CP::TDatum>("~/truth"));
+        // The split datums are put back in their original positions.
+        for (int i = 0; i < 2; ++i) {
+            ensure("Split event is read", read);
+            std::vector<std::string> readNames;
+            for (CP::TEvent::iterator d = read->begin();
+                 d != read->end(); ++d) {
+                readNames.push_back((*d)->GetName());
+            }
+            ensure("Read event has the original datum order",
+                   names == readNames);
+            delete read;
+            read = input->NextEvent();
+        }
+        ensure("Only two events are read", !read);
+        input->Close();
+        delete input;
+    }
+
+    // Test reading only part of the event.
+    template<> template<>
+    void testEventIO::test<16> () {
+        const char* fileName = "./tutEventIOSelect.root";
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        output->SetSplitDatums("digits,hits");
+        CP::TEvent event;
+        event.SetRunId(1);
+        event.SetEventId(1);
+        event.Get<CP::TDataVector>("hits")->push_back(
+            new CP::TDataVector("keepHits"));
+        event.Get<CP::TDataVector>("hits")->push_back(
+            new CP::TDataVector("dropHits"));
+        output->WriteEvent(event);
+        output->Close();
+        delete output;
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        input->SetIncludedDatums("hits,~/fits/");
+        input->SetExcludedDatums("hits/dropHits");
+        CP::TEvent* read = input->FirstEvent();
+        ensure("Selected event is read", read);
+        ensure("Included datum is read",
+               read->Get<CP::TDataVector>("~/hits/keepHits"));
+        ensure("Excluded datum is not read",
+               !read->Get<CP::TDatum>("~/hits/dropHits"));
+        ensure("Included unsplit datum is read",
+               read->Get<CP::TDataVector>("~/fits"));
+        ensure("Other split datum is not read",
+               !read->Get<CP::TDatum>("~/digits"));
+        ensure("Input has datum branches", input->HasDatumBranches());
+        // The branch of a datum that isn't selected is turned off, so
+        // nothing is read from it.
+        TTree* tree = dynamic_cast<TTree*>(
+            input->GetFilePointer()->Get("captainEventTree"));
+        ensure("Event tree is found", tree);
+        ensure("Selected datum branch is on", tree->GetBranchStatus("hits"));
+        ensure_equals("Selected datum branch is read",
+                      tree->GetBranch("hits")->GetReadEntry(), 0LL);
+        ensure("Other datum branch is off", !tree->GetBranchStatus("digits"));
+        ensure_equals("Nothing is read from the other datum branch",
+                      tree->GetBranch("digits")->GetReadEntry(), -1LL);
+        delete read;
+        input->Close();
+        delete input;
+
+        // A file without datum branches is flagged so the user can be
+        // warned that the whole event is read.
+        input = new CP::TRootInput("./tutEventIO.root","OLD");
+        ensure("Unsplit input has no datum branches",
+               !input->HasDatumBranches());
+        input->Close();
+        delete input;
+    }
+
+    // Test reading several files as one chain.
+    template<> template<>
+    void testEventIO::test<18> () {
+        const char* fileNames[] = {"./tutEventIOChain1.root",
+                                   "./tutEventIOChain2.root"};
+        int eventId = 0;
+        for (int f = 0; f < 2; ++f) {
+            CP::TRootOutput* output
+                = new CP::TRootOutput(fileNames[f],"RECREATE");
+            for (int i = 0; i < 3; ++i) {
+                CP::TEvent event;
+                event.SetRunId(1);
+                event.SetEventId(++eventId);
+                output->WriteEvent(event);
+            }
+            output->Close();
+            delete output;
+        }
+
+        CP::TChainInput chain("./tutEventIOChain1.root,"
+                              "./tutEventIOChain2.root");
+        ensure_equals("Files in chain", chain.GetFileNames().size(), 2U);
+        ensure_equals("Events in chain", chain.GetEventsInFile(), 6);
+        ensure_equals("Second file starts after first",
+                      chain.GetFirstEntry(1), 3);
+        ensure_equals("Entry in second file", chain.GetFileIndex(4), 1);
+
+        chain.Seek(2);
+        CP::TEvent* event = chain.NextEvent();
+        ensure("Last event in first file is read", event);
+        ensure_equals("Last event in first file", event->GetEventId(), 3U);
+        delete event;
+        event = chain.NextEvent();
+        ensure("First event in second file is read", event);
+        ensure_equals("First event in second file", event->GetEventId(), 4U);
+        ensure_equals("Position counted across files",
+                      chain.GetPosition(), 3);
+        delete event;
+        event = chain.PreviousEvent();
+        ensure("Previous event is read", event);
+        ensure_equals("Previous event crosses files",
+                      event->GetEventId(), 3U);
+        delete event;
+
+        CP::TEventContext target;
+        target.SetRun(1);
+        target.SetEvent(6);
+        event = chain.FindEvent(target);
+        ensure("Event is found in chain", event);
+        ensure_equals("Found event", event->GetEventId(), 6U);
+        ensure_equals("Position of found event", chain.GetPosition(), 5);
+        delete event;
+        ensure("No events after the end", !chain.NextEvent());
+        ensure("End of chain", chain.EndOfFile());
+        chain.CloseFile();
+    }
+
+    // Test that digits written to a raw digit file are read back with the
+    // memory mapped input.
+    template<> template<>
+    void testEventIO::test<19> () {
+        const char* fileName = "./tutEventIORaw.dat";
+        {
+            CP::TRawDigitWriter writer(fileName);
+            ensure("Raw digit file is open", writer.IsOpen());
+            for (int i = 0; i < 3; ++i) {
+                CP::TEvent event;
+                event.SetRunId(7);
+                event.SetEventId(i+1);
+                CP::TDigitContainer* container
+                    = new CP::TDigitContainer("drift");
+                for (int d = 0; d <= i; ++d) {
+                    CP::TPulseDigit::Vector samples(2*d+1, 100+d);
+                    container->push_back(
+                        new CP::TPulseDigit(CP::TChannelId(1000+d),
+                                            d-1, samples));
+                }
+                event.Get<CP::TDataVector>("~/digits")
+                    ->AddDatum(container);
+                ensure_equals("Digits written", writer.WriteEvent(event),
+                              i+1);
+            }
+            writer.Close();
+        }
+
+        CP::TRawMmapInput input(fileName);
+        ensure_equals("Events in raw file", input.GetEventsInFile(), 3);
+        CP::TEvent* event = input.ReadEvent(2);
+        ensure("Last raw event is read", event);
+        ensure_equals("Raw event run", event->GetRunId(), 7U);
+        ensure_equals("Raw event number", event->GetEventId(), 3U);
+        CP::THandle<CP::TDigitContainer> drift
+            = event->Get<CP::TDigitContainer>("~/digits/drift");
+        ensure("Raw digit container is read", drift);
+        ensure_equals("Raw digits read", drift->size(), 3U);
+        const CP::TPulseDigit* pulse
+            = dynamic_cast<const CP::TPulseDigit*>(drift->back());
+        ensure("Raw digit is a pulse digit", pulse);
+        ensure_equals("Raw digit channel",
+                      pulse->GetChannelId().AsUInt(), 1002U);
+        ensure_equals("Raw digit first sample", pulse->GetFirstSample(), 1);
+        ensure_equals("Raw digit samples", pulse->GetSampleCount(), 5U);
+        ensure_equals("Raw digit sample value", pulse->GetSample(4), 102);
+        delete event;
+
+        event = input.FirstEvent();
+        ensure("First raw event is read", event);
+        ensure_equals("First raw event", event->GetEventId(), 1U);
+        delete event;
+        input.CloseFile();
+
+        // A record that isn't a whole number of 32 bit words is rejected.
+        const char* badName = "./tutEventIORawBad.dat";
+        FILE* bad = std::fopen(badName,"wb");
+        ensure("Bad raw digit file is open", bad);
+        const unsigned int header[] = {CP::TRawMmapInput::kVersion, 0, 6, 0};
+        std::fwrite(CP::TRawMmapInput::GetMagic(), 1, 8, bad);
+        std::fwrite(header, sizeof(header[0]), 4, bad);
+        std::fwrite(header, 1, 2, bad);
+        std::fclose(bad);
+        bool rejected = false;
+        try {
+            CP::TRawMmapInput badInput(badName);
+        }
+        catch (CP::ERawDigitFormat&) {
+            rejected = true;
+        }
+        ensure("Unaligned raw digit record is rejected", rejected);
+    }
+
+    // Test that events sent to a stream are read back in order.  A regular
+    // file is used in place of a pipe.
+    template<> template<>
+    void testEventIO::test<20> () {
+        const char* fileName = "./tutEventIOStream.dat";
+        {
+            CP::TStreamOutput output(fileName);
+            ensure("Output stream is open", output.IsOpen());
+            for (int i = 0; i < 3; ++i) {
+                CP::TEvent event;
+                event.SetRunId(9);
+                event.SetEventId(i+1);
+                output.WriteEvent(event);
+            }
+            ensure_equals("Events sent", output.GetEventsWritten(), 3);
+            output.Close();
+        }
+
+        CP::TStreamInput input(fileName);
+        ensure("Input stream is open", input.IsOpen());
+        ensure_equals("Stream events are not counted",
+                      input.GetEventsInFile(), -1);
+        CP::TEvent* event = input.FirstEvent();
+        ensure("First stream event is read", event);
+        ensure_equals("First stream event run", event->GetRunId(), 9U);
+        ensure_equals("First stream event", event->GetEventId(), 1U);
+        delete event;
+        event = input.NextEvent(1);
+        ensure("Skipped stream event is read", event);
+        ensure_equals("Skipped stream event", event->GetEventId(), 3U);
+        ensure_equals("Stream position", input.GetPosition(), 2);
+        delete event;
+        ensure("No events after the end of the stream", !input.NextEvent());
+        ensure("End of stream", input.EndOfFile());
+        ensure_equals("Stream position at the end", input.GetPosition(), 3);
+        input.CloseFile();
+
+        // A reader that closes the pipe early is reported as a write error
+        // instead of killing the writer with SIGPIPE.
+        const char* fifoName = "./tutEventIOStream.fifo";
+        std::remove(fifoName);
+        ensure_equals("FIFO is made", mkfifo(fifoName, 0600), 0);
+        struct sigaction before;
+        sigaction(SIGPIPE, NULL, &before);
+        int reader = open(fifoName, O_RDONLY | O_NONBLOCK);
+        ensure("FIFO reader is open", reader >= 0);
+        bool failed = false;
+        {
+            CP::TStreamOutput output(fifoName);
+            ensure("FIFO stream is open", output.IsOpen());
+            close(reader);
+            CP::TEvent event;
+            try {
+                output.WriteEvent(event);
+            }
+            catch (CP::EStreamOutputWriteFailed&) {
+                failed = true;
+            }
+            ensure("Stream is closed after a failed write", !output.IsOpen());
+        }
+        ensure("Closed reader is a write error", failed);
+        struct sigaction after;
+        sigaction(SIGPIPE, NULL, &after);
+        ensure("SIGPIPE handler is restored",
+               before.sa_handler == after.sa_handler);
+        std::remove(fifoName);
+    }
+
+    // Test that the datum sizes are collected for each path and class, and
+    // that the largest events are kept.
+    template<> template<>
+    void testEventIO::test<21> () {
+        CP::TDatumSizeReport report;
+        report.SetCompressionRatios((TTree*) NULL);
+        report.SetLargestEvents(2);
+        for (int i = 0; i < 4; ++i) {
+            CP::TEvent event;
+            event.SetEventId(i+1);
+            CP::TDigitContainer* container
+                = new CP::TDigitContainer("drift");
+            for (int d = 0; d < 10*(i+1); ++d) {
+                CP::TPulseDigit::Vector samples(100, d);
+                container->push_back(
+                    new CP::TPulseDigit(CP::TChannelId(1000+d), 0, samples));
+            }
+            event.Get<CP::TDataVector>("~/digits")->AddDatum(container);
+            report.AddEvent(event);
+        }
+        ensure_equals("Events in size report", report.GetEventCount(), 4);
+        ensure_equals("Uncompressed by default",
+                      report.GetCompressionRatio("digits"), 1.0);
+
+        const std::map<std::string,CP::TDatumSizeReport::TSizes>& paths
+            = report.GetPathSizes();
+        ensure("Drift digits are reported", paths.count("~/digits/drift"));
+        const CP::TDatumSizeReport::TSizes& drift
+            = paths.find("~/digits/drift")->second;
+        ensure_equals("Drift digits counted", drift.count, 4);
+        ensure("Drift digits have a size", drift.total > 0);
+        ensure("Largest drift digits", 4*drift.max > drift.total);
+        ensure_equals("Compressed size without compression",
+                      drift.compressed, (double) drift.total);
+        ensure("Container class is reported",
+               report.GetClassSizes().count("CP::TDigitContainer"));
+        ensure("Event is larger than the datums",
+               report.GetEventSizes().total >= drift.total);
+
+        std::ostringstream out;
+        report.Print(out);
+        ensure("Report lists the drift digits",
+               out.str().find("~/digits/drift") != std::string::npos);
+        ensure("Report lists the largest event",
+               out.str().find("Large event") != std::string::npos);
+    }
+
+    // Test that files are merged in run and event order.  Files with
+    // separate ranges of events are fast cloned, and interleaved events are
+    // copied.
+    template<> template<>
+    void testEventIO::test<22> () {
+        const char* fileNames[] = {"./tutEventIOMerge1.root",
+                                   "./tutEventIOMerge2.root",
+                                   "./tutEventIOMerge3.root"};
+        const int runs[] = {2, 1, 1};
+        const int firstEvents[] = {1, 1, 2};
+        const int steps[] = {1, 2, 2};
+        for (int f = 0; f < 3; ++f) {
+            CP::TRootOutput* output
+                = new CP::TRootOutput(fileNames[f],"RECREATE");
+            TObjString commandLine(fileNames[f]);
+            output->WriteObject(&commandLine,"commandLine");
+            for (int i = 0; i < 3; ++i) {
+                CP::TEvent event;
+                event.SetRunId(runs[f]);
+                event.SetEventId(firstEvents[f] + steps[f]*i);
+                output->WriteEvent(event);
+            }
+            output->Close();
+            delete output;
+        }
+
+        const char* mergedName = "./tutEventIOMerged.root";
+        std::remove(mergedName);
+        CP::TEventFileMerger merger;
+        merger.SetSortEvents(true);
+        merger.AddInput(fileNames[0]);
+        merger.AddInput(fileNames[1]);
+        ensure_equals("Events merged", merger.Merge(mergedName), 6);
+        ensure_equals("Inputs fast cloned", merger.GetFastClonedInputs(), 2);
+        ensure_equals("Events copied", merger.GetCopiedEvents(), 0);
+        ensure("All inputs merged", merger.GetFailedInputs().empty());
+
+        CP::TRootInput* input = new CP::TRootInput(mergedName,"OLD");
+        CP::TEvent* event = input->FirstEvent();
+        ensure("First merged event is read", event);
+        ensure_equals("First merged event is from run 1",
+                      event->GetRunId(), 1U);
+        delete event;
+        event = input->ReadEvent(3);
+        ensure("Fourth merged event is read", event);
+        ensure_equals("Fourth merged event is from run 2",
+                      event->GetRunId(), 2U);
+        delete event;
+        int commandLines = 0;
+        int eventTrees = 0;
+        TIter next(input->GetFilePointer()->GetListOfKeys());
+        while (TKey* key = dynamic_cast<TKey*>(next())) {
+            if (std::string(key->GetName()) == "commandLine") ++commandLines;
+            if (std::string(key->GetName()) == "captainEventTree") {
+                ++eventTrees;
+            }
+        }
+        ensure_equals("Command lines of the inputs kept", commandLines, 2);
+        ensure_equals("One event tree in the merged file", eventTrees, 1);
+        input->Close();
+        delete input;
+
+        std::remove(mergedName);
+        CP::TEventFileMerger interleaved;
+        interleaved.SetSortEvents(true);
+        interleaved.AddInput(fileNames[2]);
+        interleaved.AddInput(fileNames[1]);
+        ensure_equals("Interleaved events merged",
+                      interleaved.Merge(mergedName), 6);
+        ensure_equals("Interleaved events copied",
+                      interleaved.GetCopiedEvents(), 6);
+
+        input = new CP::TRootInput(mergedName,"OLD");
+        for (int i = 0; i < 6; ++i) {
+            event = input->ReadEvent(i);
+            ensure("Interleaved event is read", event);
+            ensure_equals("Interleaved events are sorted",
+                          event->GetEventId(), (unsigned) i+1);
+            delete event;
+        }
+        input->Close();
+        delete input;
+    }
+
+    // Test that a catalogue finds events in a directory of files, and is
+    // updated as files are added and removed.
+    template<> template<>
+    void testEventIO::test<23> () {
+        const char* directory = "./tutEventIOCatalogue";
+        const char* fileNames[] = {"./tutEventIOCatalogue/run1.root",
+                                   "./tutEventIOCatalogue/run2.root"};
+        const char* catalogueName = "./tutEventIO.catalogue";
+        mkdir(directory, 0755);
+        for (int f = 0; f < 2; ++f) std::remove(fileNames[f]);
+        std::remove(catalogueName);
+
+        CP::TEventCatalogue catalogue;
+        for (int f = 0; f < 2; ++f) {
+            CP::TRootOutput* output
+                = new CP::TRootOutput(fileNames[f],"RECREATE");
+            for (int i = 0; i < 4; ++i) {
+                CP::TEvent event;
+                event.SetRunId(f+1);
+                event.SetEventId(10 - 2*i);
+                output->WriteEvent(event);
+            }
+            output->Close();
+            delete output;
+            ensure_equals("New file is read",
+                          catalogue.AddDirectory(directory), 1);
+        }
+        ensure_equals("Unchanged files are not read",
+                      catalogue.AddDirectory(directory), 0);
+        ensure_equals("Files in catalogue", catalogue.GetFileCount(), 2);
+        ensure_equals("Events in catalogue", catalogue.GetEventCount(), 8);
+        catalogue.Write(catalogueName);
+
+        CP::TEventCatalogue saved(catalogueName);
+        ensure_equals("Events in saved catalogue", saved.GetEventCount(), 8);
+        CP::TEventCatalogue::TLocation location;
+        ensure("Event 2,6 is found", saved.Find(2, 6, location));
+        ensure("Event 2,6 is in the second file",
+               location.file.find("run2.root") != std::string::npos);
+        ensure_equals("Entry of event 2,6", location.entry, 2);
+        ensure("Missing event is not found", !saved.Find(2, 7, location));
+        ensure("First event of run is found", saved.Find(1, -1, location));
+        ensure_equals("First event of run", location.event, 4U);
+        ensure_equals("Entry of first event of run", location.entry, 3);
+
+        CP::TRootInput* input = new CP::TRootInput(location.file.c_str());
+        CP::TEvent* event = input->ReadEvent(location.entry);
+        ensure("Catalogued event is read", event);
+        ensure_equals("Catalogued event number", event->GetEventId(), 4U);
+        delete event;
+        input->Close();
+        delete input;
+
+        std::remove(fileNames[0]);
+        ensure_equals("No files read after a removal",
+                      saved.AddDirectory(directory), 0);
+        ensure_equals("Removed file is dropped", saved.GetFileCount(), 1);
+        ensure_equals("Events of removed file are dropped",
+                      saved.GetEventCount(), 4);
+        ensure("Events of remaining file are found",
+               saved.Find(2, 10, location));
+        ensure_equals("Entry of remaining event", location.entry, 0);
+
+        // The event loop opens the file with the event from the catalogue
+        // and starts reading at its entry.  Event 3,7 is in the file twice,
+        // and the catalogue has the second one (sub-run 0), while a search
+        // from the start of the file finds the first one (sub-run 5).
+        const char* loopName = "./tutEventIOCatalogueLoop.root";
+        CP::TRootOutput* output = new CP::TRootOutput(loopName,"RECREATE");
+        WriteEvents(*output, 3, 6, 1, 1);
+        WriteEvents(*output, 3, 7, 1, 1, SetSubRun5);
+        WriteEvents(*output, 3, 8, 1, 1);
+        WriteEvents(*output, 3, 7, 1, 1);
+        output->Close();
+        delete output;
+        CP::TEventCatalogue loopCatalogue;
+        ensure_equals("Events in loop file",
+                      loopCatalogue.AddFile(loopName), 4);
+        ensure("Event 3,7 is found", loopCatalogue.Find(3, 7, location));
+        ensure_equals("Entry of event 3,7", location.entry, 3);
+        loopCatalogue.Write(catalogueName);
+
+        TRecordContext userCode;
+        const char* args[] = {"tutEventIO", "--catalogue", catalogueName,
+                              "-f", "3,7", "-n", "1", NULL};
+        optind = 1;
+        CP::eventLoop(7, const_cast<char**>(args), userCode);
+        ensure_equals("Events processed from the catalogue",
+                      userCode.fContexts.size(), 1U);
+        ensure_equals("Catalogued event number",
+                      userCode.fContexts[0].GetEvent(), 7U);
+        ensure_equals("Catalogued entry is read",
+                      userCode.fContexts[0].GetSubRun(), 0U);
+    }
+
+    // Test that events read ahead on a background thread come back in
+    // order, and that the file can be used while events are read ahead.
+    template<> template<>
+    void testEventIO::test<24> () {
+        const char* fileName = "./tutEventIOReadAhead.root";
+        WriteEmptyEvents(fileName);
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        input->SetReadAhead(3);
+        ensure_equals("Read-ahead depth", input->GetReadAhead(), 3);
+        for (int i = 0; i < 10; ++i) {
+            CP::TEvent* event = (i == 0) ? input->FirstEvent()
+                : input->NextEvent();
+            ensure("Read-ahead event is read", event);
+            ensure_equals("Read-ahead run number",
+                          event->GetRunId(), (unsigned) (i/5 + 1));
+            ensure_equals("Read-ahead event number",
+                          event->GetEventId(), (unsigned) (2*(i%5)));
+            delete event;
+            // The file is used while the thread is reading (the way the
+            // geometry is read).
+            ensure("Input file keys are read",
+                   input->GetFilePointer()->GetListOfKeys());
+            CP::TEventContext context;
+            ensure("Context is read while reading ahead",
+                   input->ReadContext(9 - i, context));
+        }
+        ensure("No events after the end", !input->NextEvent());
+        ensure("End of file", input->EndOfFile());
+
+        // Random access discards the events that were read ahead.
+        CP::TEvent* event = input->ReadEvent(2);
+        ensure("Event is read backwards", event);
+        ensure_equals("Event read backwards", event->GetEventId(), 4U);
+        delete event;
+        event = input->FindEvent(CP::TEventContext(CP::TEventContext::Invalid,
+                                                   2, 0, 6, 0, 0));
+        ensure("Event is found while reading ahead", event);
+        ensure_equals("Found event position", input->GetPosition(), 8);
+        delete event;
+        event = input->NextEvent();
+        ensure("Event after the found event is read", event);
+        ensure_equals("Event after the found event", event->GetEventId(), 8U);
+        delete event;
+
+        input->Close();
+        delete input;
+    }
+
+    // Test that events written by the asynchronous writer are all saved in
+    // order.
+    template<> template<>
+    void testEventIO::test<25> () {
+        const char* fileName = "./tutEventIOWriteBehind.root";
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        output->SetAsynchronous(4);
+        ensure_equals("Write-behind backlog", output->GetAsynchronous(), 4);
+        for (int i = 0; i < 50; ++i) {
+            CP::TEvent* event = new CP::TEvent;
+            event->SetRunId(1);
+            event->SetEventId(i);
+            output->AdoptEvent(event);
+        }
+        // A written event goes behind the backlog.
+        WriteEvents(*output, 2, 0, 1, 1);
+        ensure_equals("Write-behind events written",
+                      output->GetEventsWritten(), 51);
+        output->Close();
+        delete output;
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        ensure_equals("Write-behind events in file",
+                      input->GetEventsInFile(), 51);
+        for (int i = 0; i < 51; ++i) {
+            CP::TEvent* event = (i == 0) ? input->FirstEvent()
+                : input->NextEvent();
+            ensure("Write-behind event is read", event);
+            ensure_equals("Write-behind run number", event->GetRunId(),
+                          (i < 50) ? 1U: 2U);
+            ensure_equals("Write-behind event number", event->GetEventId(),
+                          (i < 50) ? (unsigned) i: 0U);
+            delete event;
+        }
+        input->Close();
+        delete input;
+    }
+
+    // Test that an output is rolled over by the number of events and by its
+    // size, that a full output isn't followed by an empty file, and that the
+    // user histograms are moved to the last file.
+    template<> template<>
+    void testEventIO::test<26> () {
+        const char* inputName = "./tutEventIORolloverInput.root";
+        WriteEvents(inputName, 1, 1, 1, 4);
+        const char* pieces[] = {"./tutEventIORollover.root",
+                                "./tutEventIORollover-001.root",
+                                "./tutEventIORollover-002.root",
+                                "./tutEventIORollover-003.root"};
+
+        for (int i = 0; i < 4; ++i) std::remove(pieces[i]);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "-o", pieces[0],
+                                  "--max-output-events", "2",
+                                  inputName, NULL};
+            optind = 1;
+            CP::eventLoop(6, const_cast<char**>(args), userCode);
+        }
+        ensure_equals("Events in first piece",
+                      CountFileEvents(pieces[0]), 2);
+        ensure_equals("Events in second piece",
+                      CountFileEvents(pieces[1]), 2);
+        ensure_equals("No empty piece after a full output",
+                      CountFileEvents(pieces[2]), -1);
+        {
+            TFile file(pieces[1],"READ");
+            TH1* histogram = dynamic_cast<TH1*>(file.Get("savedEvents"));
+            ensure("Histogram is saved in the last piece", histogram);
+            ensure_equals("Histogram has every event",
+                          histogram->GetEntries(), 4.0);
+            file.Close();
+        }
+        {
+            TFile file(pieces[0],"READ");
+            ensure("Histogram is not saved in the full piece",
+                   !file.Get("savedEvents"));
+            file.Close();
+        }
+
+        for (int i = 0; i < 4; ++i) std::remove(pieces[i]);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "-o", pieces[0],
+                                  "--max-output-size", "1", "-n", "3",
+                                  inputName, NULL};
+            optind = 1;
+            CP::eventLoop(8, const_cast<char**>(args), userCode);
+        }
+        for (int i = 0; i < 3; ++i) {
+            ensure_equals("One event in each piece of a small output",
+                          CountFileEvents(pieces[i]), 1);
+        }
+        ensure_equals("No piece after the last event",
+                      CountFileEvents(pieces[3]), -1);
+    }
+
+    // Test that a checkpoint is read back after it's written, including the
+    // checkpoint of a finished job that has no input file left to read.
+    template<> template<>
+    void testEventIO::test<27> () {
+        const char* fileName = "./tutEventIO.checkpoint";
+        std::remove(fileName);
+        {
+            CP::TEventLoopCheckpoint checkpoint(fileName);
+            ensure("Checkpoint file is missing", !checkpoint.Exists());
+            checkpoint.SetInput(1, "input file.root", 25);
+            checkpoint.SetTotals(125, 60);
+            checkpoint.SetOutput("output.root", 60);
+            checkpoint.Write();
+        }
+        {
+            CP::TEventLoopCheckpoint checkpoint(fileName);
+            ensure("Checkpoint file exists", checkpoint.Exists());
+            ensure("Checkpoint is read", checkpoint.Read());
+            ensure_equals("Checkpoint input index",
+                          checkpoint.GetInputIndex(), 1);
+            ensure_equals("Checkpoint input name",
+                          checkpoint.GetInputName(),
+                          std::string("input file.root"));
+            ensure_equals("Checkpoint next entry",
+                          checkpoint.GetNextEntry(), 25LL);
+            ensure_equals("Checkpoint events read",
+                          checkpoint.GetTotalRead(), 125);
+            ensure_equals("Checkpoint events written",
+                          checkpoint.GetTotalWritten(), 60);
+            ensure_equals("Checkpoint output events",
+                          checkpoint.GetOutput("output.root"), 60);
+            ensure_equals("Missing checkpoint output",
+                          checkpoint.GetOutput("other.root"), -1);
+            ensure("Checkpoint is not finished", !checkpoint.IsFinished());
+
+            checkpoint.SetInput(2, "", 0);
+            checkpoint.SetFinished(true);
+            checkpoint.Write();
+        }
+        {
+            CP::TEventLoopCheckpoint checkpoint(fileName);
+            ensure("Finished checkpoint is read", checkpoint.Read());
+            ensure_equals("Finished checkpoint input index",
+                          checkpoint.GetInputIndex(), 2);
+            ensure("Finished checkpoint has no input name",
+                   checkpoint.GetInputName().empty());
+            ensure("Checkpoint is finished", checkpoint.IsFinished());
+            ensure_equals("Finished checkpoint output events",
+                          checkpoint.GetOutput("output.root"), 60);
+        }
+        std::remove(fileName);
+    }
+
+    // Test that the hits referenced by a fit are still the hits in the
+    // event after it's read when the hits and fits are split.
+    template<> template<>
+    void testEventIO::test<28> () {
+        const char* fileName = "./tutEventIOSplitShared.root";
+        CP::TRootOutput* output = new CP::TRootOutput(fileName,"RECREATE");
+        output->SetSplitDatums("hits,fits");
+        CP::TEvent event;
+        event.SetRunId(1);
+        event.SetEventId(1);
+        FillEvent(event);
+        std::vector<std::string> names;
+        for (CP::TEvent::iterator d = event.begin(); d != event.end(); ++d) {
+            names.push_back((*d)->GetName());
+        }
+        output->WriteEvent(event);
+        output->Close();
+        delete output;
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        CP::TEvent* read = input->FirstEvent();
+        ensure("Event with shared hits is read", read);
+        std::vector<std::string> readNames;
+        for (CP::TEvent::iterator d = read->begin(); d != read->end(); ++d) {
+            readNames.push_back((*d)->GetName());
+        }
+        ensure("Event with shared hits has the original datum order",
+               names == readNames);
+        CP::THandle<CP::THitSelection> hits
+            = read->Get<CP::THitSelection>("~/hits/captain");
+        ensure("Hits are read", hits);
+        CP::THandle<CP::TAlgorithmResult> result = read->GetFit("firstResult");
+        ensure("Fit is read", result);
+        CP::THandle<CP::THitSelection> fitHits = result->GetHits();
+        ensure("Fit hits are read", fitHits);
+        ensure_equals("Fit has every hit", fitHits->size(), hits->size());
+        CP::THitSelection::iterator hit = hits->begin();
+        CP::THitSelection::iterator fitHit = fitHits->begin();
+        for (; hit != hits->end(); ++hit, ++fitHit) {
+            ensure_equals("Fit hit is the event hit",
+                          GetPointer(*fitHit), GetPointer(*hit));
+        }
+        delete read;
+        input->Close();
+        delete input;
+    }
+
+    // Test that the worker methods are called once on each thread, and that
+    // the events processed on several threads are saved in order.
+    template<> template<>
+    void testEventIO::test<29> () {
+        const char* inputName = "./tutEventIOThreadsInput.root";
+        const char* outputName = "./tutEventIOThreads.root";
+        WriteEvents(inputName, 1, 0, 1, 20);
+        std::remove(outputName);
+        TCountWorkers userCode;
+        const char* args[] = {"tutEventIO", "-j", "3", "-o", outputName,
+                              inputName, NULL};
+        optind = 1;
+        CP::eventLoop(6, const_cast<char**>(args), userCode);
+
+        ensure_equals("Every worker is initialized",
+                      userCode.fInitialized.size(), 3U);
+        ensure_equals("Every worker is finalized",
+                      userCode.fFinalized.size(), 3U);
+        int processed = 0;
+        for (int worker = 0; worker < 3; ++worker) {
+            ensure_equals("Worker is initialized once",
+                          userCode.fInitialized[worker], 1);
+            ensure_equals("Worker is finalized once",
+                          userCode.fFinalized[worker], 1);
+            processed += userCode.fProcessed[worker];
+        }
+        ensure_equals("Every event is processed on a worker", processed, 20);
+        ensure("No event is processed off a worker",
+               userCode.fProcessed.find(-1) == userCode.fProcessed.end());
+
+        CP::TRootInput* input = new CP::TRootInput(outputName,"OLD");
+        ensure_equals("Every event is saved", input->GetEventsInFile(), 20);
+        for (int i = 0; i < 20; ++i) {
+            CP::TEvent* event = (i == 0) ? input->FirstEvent()
+                : input->NextEvent();
+            ensure("Event is read", event);
+            ensure_equals("Events are saved in order",
+                          event->GetEventId(), (unsigned) i);
+            delete event;
+        }
+        input->Close();
+        delete input;
+    }
+
+    // Test that the shards of a job cover every entry of the input files
+    // once, in order, and that the entries of each file are found.
+    template<> template<>
+    void testEventIO::test<30> () {
+        const int inputEntries[] = {7, 0, 12, 4};
+        for (int shards = 1; shards < 8; ++shards) {
+            Long64_t next = 0;
+            for (int k = 0; k < shards; ++k) {
+                CP::TEventLoopSlice slice;
+                for (int i = 0; i < 4; ++i) slice.AddInput(inputEntries[i]);
+                std::ostringstream shard;
+                shard << k << "/" << shards;
+                ensure("Shard is valid", slice.SetShard(shard.str()));
+                ensure_equals("Shards are disjoint and in order",
+                              slice.GetBegin(), next);
+                ensure("Shard isn't reversed",
+                       slice.GetBegin() <= slice.GetEnd());
+                next = slice.GetEnd();
+            }
+            ensure_equals("Shards cover every entry", next, 23LL);
+        }
+
+        CP::TEventLoopSlice slice;
+        for (int i = 0; i < 4; ++i) slice.AddInput(inputEntries[i]);
+        ensure_equals("Total entries", slice.GetTotalEntries(), 23LL);
+        ensure_equals("Input of first entry", slice.FindInput(0), 0);
+        ensure_equals("Empty input is skipped", slice.FindInput(7), 2);
+        ensure_equals("Input of last entry", slice.FindInput(22), 3);
+        ensure_equals("Entry past the end", slice.FindInput(23), -1);
+        ensure("Shard must be less than the number of shards",
+               !slice.SetShard("4/4"));
+        ensure("Shard needs a count", !slice.SetShard("1"));
+        ensure("Entries need a separator", !slice.SetEntries("5"));
+
+        ensure("Entries are set", slice.SetEntries("5:20"));
+        ensure_equals("Entries begin", slice.GetBegin(), 5LL);
+        ensure_equals("Entries end", slice.GetEnd(), 20LL);
+        Long64_t begin = 0;
+        Long64_t end = 0;
+        ensure("First file has entries", slice.GetInputEntries(0,begin,end));
+        ensure_equals("First file begin", begin, 5LL);
+        ensure_equals("First file end", end, 7LL);
+        ensure("Empty file has no entries",
+               !slice.GetInputEntries(1,begin,end));
+        ensure("Third file has entries", slice.GetInputEntries(2,begin,end));
+        ensure_equals("Third file begin", begin, 0LL);
+        ensure_equals("Third file end", end, 12LL);
+        ensure("Last file has entries", slice.GetInputEntries(3,begin,end));
+        ensure_equals("Last file end", end, 1LL);
+
+        // The event loop only processes its shard.
+        const char* inputName = "./tutEventIOShardInput.root";
+        WriteEvents(inputName, 1, 0, 1, 10);
+        std::vector<unsigned int> seen;
+        for (int k = 0; k < 3; ++k) {
+            TRecordContext userCode;
+            std::ostringstream shard;
+            shard << k << "/3";
+            std::string shardArg = shard.str();
+            const char* args[] = {"tutEventIO", "--shard", shardArg.c_str(),
+                                  inputName, NULL};
+            optind = 1;
+            CP::eventLoop(4, const_cast<char**>(args), userCode);
+            for (std::size_t i = 0; i < userCode.fContexts.size(); ++i) {
+                seen.push_back(userCode.fContexts[i].GetEvent());
+            }
+        }
+        ensure_equals("Shards process every event once", seen.size(), 10U);
+        for (unsigned int i = 0; i < seen.size(); ++i) {
+            ensure_equals("Shards process the events in order", seen[i], i);
+        }
+    }
+
+    // Test that the outputs of the worker processes are merged in entry
+    // order, and that their temporary files are removed.
+    template<> template<>
+    void testEventIO::test<31> () {
+        CP::TEventLoopProcesses processes(3);
+        ensure_equals("Process count", processes.GetProcessCount(), 3);
+        ensure_equals("Parent isn't a worker", processes.GetWorker(), -1);
+        ensure("Worker names are different",
+               processes.GetWorkerName("out.root", 0)
+               != processes.GetWorkerName("out.root", 1));
+
+        const char* inputName = "./tutEventIOProcessesInput.root";
+        const char* outputName = "./tutEventIOProcesses.root";
+        WriteEvents(inputName, 1, 0, 1, 12);
+        std::remove(outputName);
+        TSaveEvents userCode;
+        const char* args[] = {"tutEventIO", "-P", "3", "-o", outputName,
+                              inputName, NULL};
+        optind = 1;
+        CP::eventLoop(6, const_cast<char**>(args), userCode);
+
+        for (int i = 0; i < 3; ++i) {
+            std::string workerName = processes.GetWorkerName(outputName, i);
+            ensure_equals("Worker output is removed",
+                          CountFileEvents(workerName.c_str()), -1);
+        }
+        CP::TRootInput* input = new CP::TRootInput(outputName,"OLD");
+        ensure_equals("Worker events are merged",
+                      input->GetEventsInFile(), 12);
+        for (int i = 0; i < 12; ++i) {
+            CP::TEvent* event = (i == 0) ? input->FirstEvent()
+                : input->NextEvent();
+            ensure("Merged event is read", event);
+            ensure_equals("Merged events are in entry order",
+                          event->GetEventId(), (unsigned) i);
+            delete event;
+        }
+        input->Close();
+        delete input;
+    }
+
+    // Test that the time of each stage is saved for every event with "-T".
+    template<> template<>
+    void testEventIO::test<32> () {
+        const char* inputName = "./tutEventIOTimingInput.root";
+        const char* outputName = "./tutEventIOTiming.root";
+        WriteEvents(inputName, 1, 0, 1, 5);
+        std::remove(outputName);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "-T", "-o", outputName,
+                                  inputName, NULL};
+            optind = 1;
+            CP::eventLoop(5, const_cast<char**>(args), userCode);
+        }
+
+        TFile file(outputName,"READ");
+        for (int stage = 0; stage < CP::TEventLoopTiming::kStageCount;
+             ++stage) {
+            std::string name = std::string("timing_")
+                + CP::TEventLoopTiming::GetStageName(stage);
+            TH1* histogram = dynamic_cast<TH1*>(file.Get(name.c_str()));
+            ensure("Stage timing is saved", histogram);
+            ensure_equals("Stage is timed for every event",
+                          histogram->GetNbinsX(), 5);
+            ensure("Stage time isn't negative",
+                   histogram->GetMinimum() >= 0.0);
+        }
+        ensure("Timing summary is saved", file.Get("timing_summary"));
+        file.Close();
+
+        // The timing isn't saved without "-T".
+        std::remove(outputName);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "-o", outputName,
+                                  inputName, NULL};
+            optind = 1;
+            CP::eventLoop(4, const_cast<char**>(args), userCode);
+        }
+        TFile untimed(outputName,"READ");
+        ensure("Timing isn't saved by default",
+               !untimed.Get("timing_summary"));
+        untimed.Close();
+    }
+
+    // Test that "-B" gives the events to ProcessBatch() in batches, and that
+    // an event without a return value isn't saved.
+    template<> template<>
+    void testEventIO::test<33> () {
+        const char* inputName = "./tutEventIOBatchInput.root";
+        const char* outputName = "./tutEventIOBatch.root";
+        WriteEvents(inputName, 1, 0, 1, 10);
+        std::remove(outputName);
+        TBatchEvents userCode;
+        const char* args[] = {"tutEventIO", "-B", "4", "-o", outputName,
+                              inputName, NULL};
+        optind = 1;
+        CP::eventLoop(6, const_cast<char**>(args), userCode);
+
+        ensure_equals("Number of batches", userCode.fBatchSizes.size(), 3U);
+        ensure_equals("First batch is full", userCode.fBatchSizes[0], 4);
+        ensure_equals("Second batch is full", userCode.fBatchSizes[1], 4);
+        ensure_equals("Last batch has the rest", userCode.fBatchSizes[2], 2);
+
+        // The last event of each batch isn't saved.
+        const unsigned int saved[] = {0, 1, 2, 4, 5, 6, 8};
+        CP::TRootInput* input = new CP::TRootInput(outputName,"OLD");
+        ensure_equals("Batch events are saved", input->GetEventsInFile(), 7);
+        for (int i = 0; i < 7; ++i) {
+            CP::TEvent* event = (i == 0) ? input->FirstEvent()
+                : input->NextEvent();
+            ensure("Batch event is read", event);
+            ensure_equals("Batch events are saved in order",
+                          event->GetEventId(), saved[i]);
+            delete event;
+        }
+        input->Close();
+        delete input;
+    }
+
+    // Test that every event of every input file is read in order when the
+    // next file is opened in the background.
+    template<> template<>
+    void testEventIO::test<34> () {
+        const char* inputNames[] = {"./tutEventIOPrefetch1.root",
+                                    "./tutEventIOPrefetch2.root",
+                                    "./tutEventIOPrefetch3.root"};
+        for (int i = 0; i < 3; ++i) WriteEvents(inputNames[i], i+1, 0, 1, 4);
+        TRecordContext userCode;
+        const char* args[] = {"tutEventIO", "--prefetch",
+                              inputNames[0], inputNames[1], inputNames[2],
+                              NULL};
+        optind = 1;
+        CP::eventLoop(5, const_cast<char**>(args), userCode);
+
+        ensure_equals("Every prefetched event is read",
+                      userCode.fContexts.size(), 12U);
+        for (unsigned int i = 0; i < userCode.fContexts.size(); ++i) {
+            ensure_equals("Prefetched files are read in order",
+                          userCode.fContexts[i].GetRun(), i/4 + 1);
+            ensure_equals("Prefetched events are read in order",
+                          userCode.fContexts[i].GetEvent(), i%4);
+        }
+    }
+
+    // Test that the metrics file has the progress of the event loop, and
+    // that it's replaced without leaving its temporary file.
+    template<> template<>
+    void testEventIO::test<35> () {
+        const char* metricsName = "./tutEventIOMetrics.json";
+        std::string tmpName = std::string(metricsName) + ".tmp";
+        std::remove(metricsName);
+        {
+            CP::TEventLoopMetrics metrics(metricsName);
+            ensure_equals("Metrics file name", metrics.GetFileName(),
+                          std::string(metricsName));
+            metrics.SetExpectedEvents(10);
+            metrics.BeginFile("input \"one\".root");
+            metrics.SetFileCounts(4, 3);
+            metrics.SetTotals(4, 3);
+            metrics.Write();
+        }
+        std::string running = ReadTextFile(metricsName);
+        ensure("Metrics are running",
+               running.find("\"status\": \"running\"") != std::string::npos);
+        ensure("Expected events are written",
+               running.find("\"expected_events\": 10,") != std::string::npos);
+        ensure("Time to completion is estimated",
+               running.find("\"eta_seconds\": null") == std::string::npos);
+        ensure("Input name is quoted",
+               running.find("\"input \\\"one\\\".root\"")
+               != std::string::npos);
+        ensure("File counts are written",
+               running.find("\"events_read\": 4, \"events_written\": 3")
+               != std::string::npos);
+        ensure_equals("Temporary metrics file is renamed",
+                      ReadTextFile(tmpName.c_str()), std::string());
+        int read = 0;
+        int written = 0;
+        ensure("Metrics totals are read",
+               CP::TEventLoopMetrics::ReadTotals(metricsName, read, written));
+        ensure_equals("Metrics events read", read, 4);
+        ensure_equals("Metrics events written", written, 3);
+
+        // The event loop writes the finished metrics.
+        const char* inputName = "./tutEventIOMetricsInput.root";
+        const char* outputName = "./tutEventIOMetrics.root";
+        WriteEvents(inputName, 1, 0, 1, 5);
+        std::remove(metricsName);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "--metrics", metricsName,
+                                  "-o", outputName, inputName, NULL};
+            optind = 1;
+            CP::eventLoop(6, const_cast<char**>(args), userCode);
+        }
+        std::string finished = ReadTextFile(metricsName);
+        ensure("Metrics are finished",
+               finished.find("\"status\": \"finished\"")
+               != std::string::npos);
+        ensure("Finished metrics have no time to completion",
+               finished.find("\"eta_seconds\": 0,") != std::string::npos);
+        ensure("Input file is in the metrics",
+               finished.find("tutEventIOMetricsInput.root")
+               != std::string::npos);
+        ensure("Event loop metrics totals are read",
+               CP::TEventLoopMetrics::ReadTotals(metricsName, read, written));
+        ensure_equals("Event loop events read", read, 5);
+        ensure_equals("Event loop events written", written, 5);
+        ensure_equals("Event loop leaves no temporary metrics file",
+                      ReadTextFile(tmpName.c_str()), std::string());
+        std::remove(metricsName);
+    }
+
+    // Test that the output compression and baskets are taken from the
+    // captEvent.output parameters, and that the command line overrides them.
+    template<> template<>
+    void testEventIO::test<36> () {
+        const char* inputName = "./tutEventIOSettingsInput.root";
+        const char* outputName = "./tutEventIOSettings.root";
+        WriteEvents(inputName, 1, 0, 1, 5);
+
+        std::remove(outputName);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "-o", outputName,
+                                  inputName, NULL};
+            optind = 1;
+            CP::eventLoop(4, const_cast<char**>(args), userCode);
+        }
+        CP::TRuntimeParameters& parameters = CP::TRuntimeParameters::Get();
+        {
+            TFile file(outputName,"READ");
+            int algorithm = CP::TRootOutput::GetCompressionAlgorithm(
+                parameters.GetParameterS(
+                    "captEvent.output.compressionAlgorithm"));
+            ensure_equals("Default compression",
+                          file.GetCompressionSettings(),
+                          100*algorithm + parameters.GetParameterI(
+                              "captEvent.output.compressionLevel"));
+            TTree* tree = dynamic_cast<TTree*>(file.Get("captainEventTree"));
+            ensure("Event tree is saved", tree);
+            ensure_equals("Default basket size",
+                          tree->GetBranch("Event")->GetBasketSize(),
+                          parameters.GetParameterI(
+                              "captEvent.output.basketSize"));
+            ensure_equals("Default auto flush", tree->GetAutoFlush(),
+                          (Long64_t) parameters.GetParameterI(
+                              "captEvent.output.autoFlush"));
+            file.Close();
+        }
+
+        std::remove(outputName);
+        {
+            TSaveEvents userCode;
+            const char* args[] = {"tutEventIO", "--compression", "lzma:5",
+                                  "--basket-size", "32000",
+                                  "--auto-flush", "2",
+                                  "-o", outputName, inputName, NULL};
+            optind = 1;
+            CP::eventLoop(10, const_cast<char**>(args), userCode);
+        }
+        {
+            TFile file(outputName,"READ");
+            ensure_equals("Command line compression",
+                          file.GetCompressionSettings(), 205);
+            TTree* tree = dynamic_cast<TTree*>(file.Get("captainEventTree"));
+            ensure("Event tree is saved with the command line settings",
+                   tree);
+            ensure_equals("Command line basket size",
+                          tree->GetBranch("Event")->GetBasketSize(), 32000);
+            ensure_equals("Command line auto flush", tree->GetAutoFlush(),
+                          2LL);
+            ensure_equals("Events are saved with the command line settings",
+                          tree->GetEntries(), 5LL);
+            file.Close();
+        }
+    }
+
+    // Test that the events are read through the tree cache, and that the
+    // reads through the cache are counted.
+    template<> template<>
+    void testEventIO::test<37> () {
+        const char* fileName = "./tutEventIOCache.root";
+        WriteEvents(fileName, 1, 0, 1, 50);
+
+        CP::TRootInput* input = new CP::TRootInput(fileName,"OLD");
+        input->SetCacheSize(1000000, 5);
+        ensure_equals("Cache size", input->GetCacheSize(), 1000000LL);
+        int events = 0;
+        for (CP::TEvent* event = input->FirstEvent();
+             !input->EndOfFile();
+             event = input->NextEvent()) {
+            ensure("Event is read through the cache", event);
+            ensure_equals("Events are read in order through the cache",
+                          event->GetEventId(), (unsigned) events);
+            ++events;
+            delete event;
+        }
+        ensure_equals("Every event is read through the cache", events, 50);
+        std::string statistics = input->GetCacheStatistics();
+        ensure("Cache reads are counted",
+               statistics.find("cache reads") != std::string::npos);
+        input->Close();
+        delete input;
+
+        input = new CP::TRootInput(fileName,"OLD");
+        input->SetCacheSize(0);
+        CP::TEvent* event = input->FirstEvent();
+        ensure("Event is read without the cache", event);
+        delete event;
+        ensure("Cache isn't used", input->GetCacheStatistics().empty());
+        input->Close();
+        delete input;
+
+        // The event loop reads every event through the cache.
+        TRecordContext userCode;
+        const char* args[] = {"tutEventIO", "--cache-size", "1000000",
+                              "--cache-learn", "5", fileName, NULL};
+        optind = 1;
+        CP::eventLoop(6, const_cast<char**>(args), userCode);
+        ensure_equals("Event loop reads every event through the cache",
+                      userCode.fContexts.size(), 50U);
+    }
 };